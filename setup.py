@@ -33,7 +33,7 @@ if sys.version_info[0] == 3:
     swig_opts += ['-py3']
 
 setup(name='xylib-py',
-      version='1.6.1',
+      version='1.7.0',
       description='Python bindings to xylib',
       long_description=long_description,
       classifiers=[
@@ -0,0 +1,335 @@
+// Checks the pdCIF reader on randomly generated files.
+// Licence: Lesser GNU Public License 2.1 (LGPL)
+//
+// Files with known values are written in various ways (quoting, text
+// fields, comments, line breaks, s.u. in parentheses) and read from memory
+// and from a stream. Block names, meta-data and columns must match.
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "xylib/fileio.h"
+#include "xylib/util.h"
+#include "xylib/xylib.h"
+
+using namespace std;
+using namespace xylib;
+using namespace xylib::util;
+
+static int n_errors = 0;
+
+struct ExpectedColumn
+{
+    string name;
+    vector<double> values;
+};
+
+struct ExpectedBlock
+{
+    string name;
+    vector<pair<string, string> > meta;
+    vector<ExpectedColumn> columns;
+};
+
+static string trim(string const& s)
+{
+    size_t b = 0, e = s.size();
+    while (b != e && isspace((unsigned char) s[b]))
+        ++b;
+    while (e != b && isspace((unsigned char) s[e-1]))
+        --e;
+    return s.substr(b, e - b);
+}
+
+class Generator
+{
+public:
+    explicit Generator(unsigned seed) : rng_(seed) {}
+
+    void file(string* cif, vector<ExpectedBlock>* blocks)
+    {
+        static const char* eols[] = { "\n", "\r\n", "\r" };
+        eol_ = eols[rand(3)];
+        out_.clear();
+        blocks->clear();
+        out_ += "#\\#CIF_1.1" + eol_;
+        for (int n = 1 + rand(3); n > 0; --n) {
+            blocks->resize(blocks->size() + 1);
+            block(&blocks->back());
+        }
+        if (rand(3) == 0)
+            out_ += "\x1A"; // the end of some files
+        cif->swap(out_);
+    }
+
+private:
+    mt19937 rng_;
+    string eol_;
+    string out_;
+
+    int rand(int n) { return (int) (rng_() % n); }
+
+    // whitespace between tokens, sometimes with comment
+    void space()
+    {
+        switch (rand(6)) {
+            case 0: out_ += eol_; break;
+            case 1: out_ += "\t"; break;
+            case 2: out_ += "  # comment 'x' _tag data_x" + eol_; break;
+            default: out_ += " ";
+        }
+    }
+
+    string number(double x)
+    {
+        char buf[32];
+        snprintf(buf, sizeof(buf), rand(4) ? "%.4f" : "%.3e", x);
+        return buf;
+    }
+
+    // number with standard uncertainty, e.g. 12.345(6);
+    // returns value and the uncertainty
+    string number_with_su(double* val, double* err)
+    {
+        char buf[32];
+        int su = 1 + rand(99);
+        int decimals = rand(5);
+        snprintf(buf, sizeof(buf), "%.*f", decimals, *val);
+        *val = strtod(buf, NULL);
+        *err = decimals == 0 ? su : su * pow(10., -decimals);
+        return string(buf) + "(" + S(su) + ")";
+    }
+
+    // value that is not a number; returns the text stored in meta-data
+    string text_value()
+    {
+        static const char* words[] = { "abc", "mode-A/b", "x1y", "d.e" };
+        switch (rand(5)) {
+            case 0: {
+                string s = words[rand(4)];
+                out_ += s;
+                return s;
+            }
+            case 1: {
+                string s = " it's a 'value' ";
+                out_ += "\"" + s + "\"";
+                return trim(s);
+            }
+            case 2: {
+                string s = "say \"hi\"";
+                out_ += "'" + s + "'";
+                return s;
+            }
+            default: {
+                string s = " text field" + eol_ + "  line 2; data_x"
+                           + eol_ + "loop_ _tag" + eol_;
+                out_ += eol_ + ";" + s + ";" + eol_;
+                return trim(s);
+            }
+        }
+    }
+
+    void block(ExpectedBlock* blk)
+    {
+        blk->name = "b" + S(rand(1000));
+        out_ += eol_ + (rand(2) ? "data_" : "DATA_") + blk->name + eol_;
+        for (int i = rand(5); i > 0; --i)
+            meta_item(blk, i);
+        loop(blk);
+        for (int i = rand(3); i > 0; --i)
+            meta_item(blk, 10 + i);
+    }
+
+    void meta_item(ExpectedBlock* blk, int i)
+    {
+        string tag = "pd_spec_info_" + S(i);
+        out_ += "_" + tag;
+        space();
+        string value;
+        int k = rand(5);
+        if (k == 0) {
+            string s = number(rand(10000) / 8.);
+            out_ += s;
+            value = S(strtod(s.c_str(), NULL));
+        } else if (k == 1) {
+            double x = rand(10000) / 3., err;
+            value = number_with_su(&x, &err);
+            out_ += value;
+        } else if (k == 2) {
+            out_ += rand(2) ? "?" : ".";
+            out_ += eol_;
+            return; // not stored
+        } else {
+            value = text_value();
+        }
+        out_ += eol_;
+        blk->meta.push_back(make_pair(tag, value));
+    }
+
+    void loop(ExpectedBlock* blk)
+    {
+        static const char* data_tags[] = { "pd_meas_2theta_scan",
+                                           "pd_meas_intensity_total",
+                                           "pd_proc_ls_weight",
+                                           "pd_calc_intensity_total" };
+        // kind of column: 0 - not stored (text), 1 - numbers,
+        // 2 - numbers with s.u.
+        vector<int> kinds;
+        vector<string> tags;
+        int ncol = 1 + rand(4);
+        for (int i = 0; i < ncol; ++i) {
+            int kind = rand(3);
+            tags.push_back(kind == 0 ? "pd_proc_info_" + S(i)
+                                     : data_tags[i]);
+            kinds.push_back(kind);
+        }
+        // at least one column is stored, otherwise the block is skipped
+        if (kinds[0] == 0) {
+            kinds[0] = 1;
+            tags[0] = data_tags[0];
+        }
+        int nrow = 1 + rand(200);
+        vector<vector<double> > vals(ncol), errs(ncol);
+        vector<char> known(ncol, 0);
+
+        out_ += "loop_" + eol_;
+        for (int i = 0; i < ncol; ++i)
+            out_ += " _" + tags[i] + eol_;
+        for (int row = 0; row < nrow; ++row) {
+            for (int i = 0; i < ncol; ++i) {
+                space();
+                double x = ((double) rng_() - 2e9) / (1 + rand(1000));
+                double err = 0.;
+                if (kinds[i] == 0) {
+                    text_value();
+                } else if (rand(20) == 0) { // unknown value is read as 0
+                    out_ += rand(2) ? "?" : ".";
+                    x = 0.;
+                } else if (kinds[i] == 1) {
+                    string s = number(x);
+                    out_ += s;
+                    x = strtod(s.c_str(), NULL);
+                    known[i] = 1;
+                } else {
+                    out_ += number_with_su(&x, &err);
+                    known[i] = 1;
+                }
+                vals[i].push_back(x);
+                errs[i].push_back(err);
+            }
+        }
+        out_ += eol_;
+
+        for (int i = 0; i < ncol; ++i) {
+            if (kinds[i] == 0 || !known[i])
+                continue;
+            ExpectedColumn col;
+            col.name = tags[i].substr(3);
+            col.values = vals[i];
+            blk->columns.push_back(col);
+            if (kinds[i] == 2) {
+                col.name += "_err";
+                col.values = errs[i];
+                blk->columns.push_back(col);
+            }
+        }
+        // all columns have only unknown values, the block is skipped
+        if (blk->columns.empty())
+            blk->name.clear();
+    }
+};
+
+static string compare(DataSet const* ds, vector<ExpectedBlock> const& exp)
+{
+    int n = 0;
+    for (size_t i = 0; i != exp.size(); ++i) {
+        ExpectedBlock const& e = exp[i];
+        if (e.name.empty())
+            continue;
+        if (n >= ds->get_block_count())
+            return "too few blocks";
+        Block const* blk = ds->get_block(n++);
+        if (blk->get_name() != e.name)
+            return "block name " + blk->get_name() + " != " + e.name;
+        if (blk->meta.size() != e.meta.size())
+            return "meta size in block " + e.name;
+        for (size_t j = 0; j != e.meta.size(); ++j)
+            if (!blk->meta.has_key(e.meta[j].first) ||
+                    blk->meta.get(e.meta[j].first) != e.meta[j].second)
+                return "meta " + e.meta[j].first + " in block " + e.name;
+        if (blk->get_column_count() != (int) e.columns.size())
+            return "column count in block " + e.name;
+        for (size_t j = 0; j != e.columns.size(); ++j) {
+            Column const& col = blk->get_column(j + 1);
+            ExpectedColumn const& ec = e.columns[j];
+            if (col.get_name() != ec.name)
+                return "column name " + col.get_name() + " != " + ec.name;
+            if (col.get_point_count() != (int) ec.values.size())
+                return "point count of " + ec.name;
+            for (size_t k = 0; k != ec.values.size(); ++k)
+                if (col.get_value(k) != ec.values[k])
+                    return "value #" + S(k) + " of " + ec.name + " in block "
+                           + e.name + ": " + S(col.get_value(k)) + " != "
+                           + S(ec.values[k]);
+        }
+    }
+    if (n != ds->get_block_count())
+        return "too many blocks";
+    return "";
+}
+
+static void check(int idx, string const& cif,
+                  vector<ExpectedBlock> const& expected)
+{
+    for (int from_memory = 0; from_memory != 2; ++from_memory) {
+        string err;
+        try {
+            std::unique_ptr<DataSet> ds;
+            if (from_memory) {
+                OwnedBuffer* buf = new OwnedBuffer(cif.size());
+                file_buffer_ptr ptr(buf);
+                memcpy(buf->wdata(), cif.data(), cif.size());
+                buf->set_size(cif.size());
+                buffer_istreambuf sb(ptr);
+                istream is(&sb);
+                ds.reset(load_stream(is, "pdcif"));
+            } else {
+                ds.reset(load_string(cif, "pdcif"));
+            }
+            err = compare(ds.get(), expected);
+        } catch (std::exception& e) {
+            err = e.what();
+        }
+        if (!err.empty()) {
+            if (n_errors < 5)
+                printf("file #%d (read from %s): %s\n", idx,
+                       from_memory ? "memory" : "stream", err.c_str());
+            ++n_errors;
+        }
+    }
+}
+
+int main()
+{
+    Generator gen(3);
+    for (int i = 0; i < 300; ++i) {
+        string cif;
+        vector<ExpectedBlock> expected;
+        gen.file(&cif, &expected);
+        check(i, cif, expected);
+    }
+    if (n_errors != 0) {
+        printf("%d files were not read correctly\n", n_errors);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,72 @@
+// Checks that fast_strtod() gives the same results as strtod().
+// Licence: Lesser GNU Public License 2.1 (LGPL)
+//
+// Random numbers are printed in various formats, some of them are
+// corrupted (a character is replaced), and both functions must return
+// the same value (bit by bit) and the same end pointer.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+#include "xylib/util.h"
+
+using namespace std;
+using xylib::util::fast_strtod;
+
+static int n_errors = 0;
+
+static void check(const char* s)
+{
+    char *end1, *end2;
+    double a = strtod(s, &end1);
+    double b = fast_strtod(s, &end2);
+    if (end1 != end2 || memcmp(&a, &b, sizeof(double)) != 0) {
+        if (n_errors < 10)
+            printf("\"%s\": strtod %.17g (%d chars), fast_strtod %.17g "
+                   "(%d chars)\n", s, a, (int) (end1 - s), b,
+                   (int) (end2 - s));
+        ++n_errors;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    long n = argc > 1 ? atol(argv[1]) : 1000000;
+    static const char* formats[] = { "%.0f", "%.1f", "%.3f", "%.6f", "%.9g",
+                                     "%.15g", "%.17g", "%g", "%e", "%.3e",
+                                     "%.10e", "%+.2f" };
+    const int n_formats = sizeof(formats) / sizeof(formats[0]);
+    static const char chars[] = "0123456789.e-+xE \tn";
+    mt19937_64 rng(5);
+    char buf[64];
+    for (long i = 0; i < n; ++i) {
+        double x = ldexp((double) (rng() >> 11), (int) (rng() % 100) - 80);
+        if (rng() & 1)
+            x = -x;
+        snprintf(buf, sizeof(buf), formats[i % n_formats], x);
+        if (i % 7 == 0) {
+            size_t len = strlen(buf);
+            buf[rng() % len] = chars[rng() % (sizeof(chars) - 1)];
+        }
+        check(buf);
+    }
+
+    static const char* special[] = {
+        "", "-", "+", ".", "-.", "e5", ".e1", "1e", "1e+", "1.5E-3x",
+        "0x1p3", "-0X10", "inf", "-Infinity", "nan", "NAN(123)", "0",
+        "-0", "00012.500", "1e22", "1e23", "1e-22", "1e-23",
+        "9007199254740993", "12345678901234567890", "1e400", "1e-400", "4.9e-324", "1.5e9999999",
+        "123456789012345678901234567890e-10", " 1", "1 2", "1,5", "1\n" };
+    for (size_t i = 0; i != sizeof(special) / sizeof(special[0]); ++i)
+        check(special[i]);
+
+    if (n_errors != 0) {
+        printf("%d differences found\n", n_errors);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
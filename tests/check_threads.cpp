@@ -0,0 +1,183 @@
+// Checks that a cached dataset can be read from many threads at once.
+// Licence: Lesser GNU Public License 2.1 (LGPL)
+//
+// Values that are computed lazily in const functions (column statistics,
+// formatted meta-data, VAMAS ordinates, ...) are requested by all threads
+// at the same time. Each thread must get the same results as a single
+// thread reading a separately loaded copy of the file. Then the files are
+// loaded concurrently through the Cache. Data races are reported when the
+// library is built with ThreadSanitizer (option SANITIZE_THREAD in CMake).
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "xylib/xylib.h"
+#include "xylib/cache.h"
+
+using namespace std;
+using namespace xylib;
+
+#ifndef SAMPLES_DIR
+# define SAMPLES_DIR "samples"
+#endif
+
+static const char* sample_files[] = {
+    "mjr9_116a.vms", "mjr9_59c.vms", // ordinates parsed when accessed
+    "BT86.raw", "format1.raw",       // columns mapped to file buffer
+    "1d-1.spe", "SMP00011.CNF", "03yag02.mca", "Spectra.1",
+    "empyrean.xrdml", "XSYGExample.xsyg", "1517474.cif", "BT86_.UXD",
+    "D1A5.dat", "mm-specs.xy", "test1.csv", "with_sigma.txt"
+};
+static const size_t n_samples = sizeof(sample_files) / sizeof(sample_files[0]);
+static const int n_threads = 8;
+
+// FNV-1a hash of all the values that are read
+class Hash
+{
+public:
+    Hash() : h_(14695981039346656037ULL) {}
+    uint64_t value() const { return h_; }
+    void add(const void* p, size_t n)
+    {
+        const unsigned char* c = static_cast<const unsigned char*>(p);
+        for (size_t i = 0; i != n; ++i)
+            h_ = (h_ ^ c[i]) * 1099511628211ULL;
+    }
+    void add(double x) { add(&x, sizeof(x)); }
+    void add(int n) { add(&n, sizeof(n)); }
+    void add(string const& s) { add(s.data(), s.size()); }
+
+private:
+    uint64_t h_;
+};
+
+static void read_meta(MetaData const& meta, Hash& h)
+{
+    for (size_t i = 0; i != meta.size(); ++i) {
+        h.add(meta.get_key(i));
+        h.add(meta.get_value(i));
+    }
+}
+
+static void read_column(Column const& col, int n, Hash& h)
+{
+    ColumnStats st = col.get_stats(n);
+    h.add(st.count);
+    h.add(st.nan_count);
+    h.add(st.min);
+    h.add(st.max);
+    h.add(st.sum);
+    h.add(st.order);
+    h.add(col.get_sort_order());
+    if (col.get_point_count() != -1) {
+        h.add(col.get_min());
+        h.add(col.get_max());
+        pair<int, int> r = col.find_range(st.min, (st.min + st.max) / 2);
+        h.add(r.first);
+        h.add(r.second);
+    }
+    vector<double> values(n);
+    if (n != 0)
+        col.get_values(0, n, &values[0]);
+    for (int i = 0; i < n; ++i) {
+        h.add(values[i]);
+        h.add(col.get_value(i));
+    }
+}
+
+// reads everything that can be computed lazily
+static uint64_t read_all(DataSet const& ds)
+{
+    Hash h;
+    read_meta(ds.meta, h);
+    for (int i = 0; i < ds.get_block_count(); ++i) {
+        Block const* blk = ds.get_block(i);
+        read_meta(blk->meta, h);
+        int n = blk->get_point_count();
+        for (int c = 1; c <= blk->get_column_count(); ++c) {
+            Column const& col = blk->get_column(c);
+            h.add(col.get_name());
+            int count = col.get_point_count();
+            read_column(col, count != -1 ? count : n, h);
+        }
+    }
+    return h.value();
+}
+
+int main()
+{
+    int n_errors = 0;
+    int n_files = 0;
+    Cache::Get()->set_max_size(n_samples);
+    for (size_t i = 0; i != n_samples; ++i) {
+        string path = string(SAMPLES_DIR) + "/" + sample_files[i];
+        uint64_t expected;
+        try {
+            unique_ptr<DataSet> copy(load_file(path));
+            expected = read_all(*copy);
+        } catch (std::exception& e) {
+            printf("%s: %s\n", path.c_str(), e.what());
+            ++n_errors;
+            continue;
+        }
+        ++n_files;
+        dataset_shared_ptr ds = Cache::Get()->load_file(path);
+        vector<uint64_t> results(n_threads);
+        vector<thread> threads;
+        for (int t = 0; t < n_threads; ++t)
+            threads.push_back(thread([&ds, &results, t] {
+                results[t] = read_all(*ds);
+            }));
+        for (int t = 0; t < n_threads; ++t)
+            threads[t].join();
+        for (int t = 0; t < n_threads; ++t)
+            if (results[t] != expected) {
+                printf("%s: thread %d read different values\n", path.c_str(),
+                       t);
+                ++n_errors;
+                break;
+            }
+    }
+    if (n_files == 0) {
+        printf("no sample files found in %s\n", SAMPLES_DIR);
+        return 77; // skipped
+    }
+
+    // all threads load all files through the Cache, in different order
+    Cache::Get()->clear_cache();
+    vector<thread> threads;
+    vector<int> block_counts(n_threads, 0);
+    for (int t = 0; t < n_threads; ++t)
+        threads.push_back(thread([&block_counts, t] {
+            for (size_t i = 0; i != n_samples; ++i) {
+                string path = string(SAMPLES_DIR) + "/"
+                              + sample_files[(i + t) % n_samples];
+                try {
+                    dataset_shared_ptr ds = Cache::Get()->load_file(path);
+                    block_counts[t] += ds->get_block_count();
+                } catch (std::exception&) {
+                    // files that can't be loaded were reported above
+                }
+            }
+        }));
+    for (int t = 0; t < n_threads; ++t)
+        threads[t].join();
+    for (int t = 1; t < n_threads; ++t)
+        if (block_counts[t] != block_counts[0]) {
+            printf("thread %d loaded %d blocks, thread 0 loaded %d\n", t,
+                   block_counts[t], block_counts[0]);
+            ++n_errors;
+        }
+
+    if (n_errors != 0) {
+        printf("%d errors found\n", n_errors);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
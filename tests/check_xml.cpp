@@ -0,0 +1,364 @@
+// Checks XmlReader on fixed and on randomly generated documents.
+// Licence: Lesser GNU Public License 2.1 (LGPL)
+//
+// Each document is read from memory and from a stream (in chunks, so that
+// tokens are split between chunks in large documents). The events are
+// written as text and compared with the text that the generator expects.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+
+#include "xylib/xmlreader.h"
+#include "xylib/util.h"
+#include "xylib/xylib.h"
+
+using namespace std;
+using namespace xylib::util;
+
+static int n_errors = 0;
+
+// events as text: <name a=value>, </name>; text of <t> is read with
+// read_text() and numbers in <n> with read_number()
+static string dump(istream& f)
+{
+    string out;
+    XmlReader r(f);
+    for (;;) {
+        XmlReader::Node node = r.next();
+        if (node == XmlReader::XML_EOF)
+            break;
+        if (node == XmlReader::XML_END) {
+            out += "</" + r.name() + ">";
+            continue;
+        }
+        out += "<" + r.name();
+        static const char* attr_names[] = { "a", "b" };
+        for (int i = 0; i != 2; ++i)
+            if (string const* value = r.find_attr(attr_names[i]))
+                out += string(" ") + attr_names[i] + "=" + *value;
+        out += ">";
+        if (r.name() == "t") {
+            out += "{" + r.read_text() + "}";
+        } else if (r.name() == "n") {
+            double v;
+            while (r.read_number(&v, " ,\t\r\n"))
+                out += " " + S(v);
+            r.skip_element();
+        }
+    }
+    return out;
+}
+
+// returns dump() of xml read from memory and from a stream (in chunks),
+// or "ERROR" if XmlReader throws an exception
+static string dump_both(string const& xml, string* from_stream)
+{
+    try {
+        istringstream is(xml);
+        *from_stream = dump(is);
+    } catch (xylib::FormatError&) {
+        *from_stream = "ERROR";
+    }
+    OwnedBuffer* buf = new OwnedBuffer(xml.size());
+    file_buffer_ptr ptr(buf);
+    memcpy(buf->wdata(), xml.data(), xml.size());
+    buf->set_size(xml.size());
+    buffer_istreambuf sb(ptr);
+    istream is(&sb);
+    try {
+        return dump(is);
+    } catch (xylib::FormatError&) {
+        return "ERROR";
+    }
+}
+
+static void check(string const& name, string const& xml,
+                  string const& expected)
+{
+    string from_stream;
+    string from_memory = dump_both(xml, &from_stream);
+    if (from_memory != expected || from_stream != expected) {
+        if (n_errors < 5)
+            printf("%s\n  expected: %.300s\n  memory:   %.300s\n"
+                   "  stream:   %.300s\n", name.c_str(), expected.c_str(),
+                   from_memory.c_str(), from_stream.c_str());
+        ++n_errors;
+    }
+}
+
+static void append_utf8(string& s, unsigned long cp)
+{
+    if (cp < 0x80) {
+        s += (char) cp;
+    } else if (cp < 0x800) {
+        s += (char) (0xC0 | (cp >> 6));
+        s += (char) (0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        s += (char) (0xE0 | (cp >> 12));
+        s += (char) (0x80 | ((cp >> 6) & 0x3F));
+        s += (char) (0x80 | (cp & 0x3F));
+    } else {
+        s += (char) (0xF0 | (cp >> 18));
+        s += (char) (0x80 | ((cp >> 12) & 0x3F));
+        s += (char) (0x80 | ((cp >> 6) & 0x3F));
+        s += (char) (0x80 | (cp & 0x3F));
+    }
+}
+
+// generates random document and the expected output of dump()
+class Generator
+{
+public:
+    explicit Generator(unsigned seed) : rng_(seed) {}
+
+    void document(size_t min_size, string* xml, string* expected)
+    {
+        xml_.clear();
+        exp_.clear();
+        if (rand(4) == 0)
+            xml_ += "\xEF\xBB\xBF";
+        if (rand(2))
+            xml_ += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+        if (rand(3) == 0)
+            xml_ += "<!DOCTYPE r [\n<!ENTITY e 'x'>\n<!ELEMENT r ANY>\n]>";
+        junk();
+        open("r");
+        while (xml_.size() < min_size)
+            element(0);
+        close("r");
+        junk();
+        xml->swap(xml_);
+        expected->swap(exp_);
+    }
+
+private:
+    mt19937 rng_;
+    string xml_;
+    string exp_;
+
+    int rand(int n) { return (int) (rng_() % n); }
+
+    void space()
+    {
+        static const char* spaces[] = { "", " ", "\n", "\t", "\r\n  " };
+        xml_ += spaces[rand(5)];
+    }
+
+    // characters of text or of attribute value, without '<' and '&'
+    void plain(string* out, char quote)
+    {
+        static const char chars[] = "abc xyz\n\t123;:=/\"'>]#?!-";
+        int n = rand(12);
+        for (int i = 0; i < n; ++i) {
+            char c = chars[rand(sizeof(chars) - 1)];
+            if (c == quote)
+                c = '_';
+            xml_ += c;
+            *out += c;
+        }
+    }
+
+    void entity(string* out)
+    {
+        static const char* names[] = { "lt", "gt", "amp", "quot", "apos" };
+        static const char values[] = "<>&\"'";
+        int k = rand(8);
+        if (k < 5) {
+            xml_ += string("&") + names[k] + ";";
+            *out += values[k];
+        } else if (k == 5) {
+            static const unsigned long cps[] = { 65, 0xE9, 0x263A,
+                                                 0x1F600 };
+            unsigned long cp = cps[rand(4)];
+            char buf[16];
+            snprintf(buf, sizeof(buf), rand(2) ? "&#%lu;" : "&#x%lX;", cp);
+            xml_ += buf;
+            append_utf8(*out, cp);
+        } else { // unknown entity is kept as is
+            xml_ += "&e;";
+            *out += "&e;";
+        }
+    }
+
+    // text that is skipped by XmlReader
+    void junk()
+    {
+        string ignored;
+        for (int n = rand(3); n > 0; --n) {
+            switch (rand(5)) {
+                case 0: plain(&ignored, 0); break;
+                case 1: entity(&ignored); break;
+                case 2: xml_ += "<!-- comment <a> & -- -->"; break;
+                case 3: xml_ += "<?pi <a> ?>"; break;
+                case 4: xml_ += "<![CDATA[ <a> & ]] ]]>"; break;
+            }
+        }
+    }
+
+    void open(string const& name)
+    {
+        xml_ += "<" + name;
+        exp_ += "<" + name;
+        attributes();
+        space();
+        xml_ += ">";
+        exp_ += ">";
+    }
+
+    void close(string const& name)
+    {
+        xml_ += "</" + name;
+        space();
+        xml_ += ">";
+        exp_ += "</" + name + ">";
+    }
+
+    void attributes()
+    {
+        bool has_a = rand(2), has_b = rand(3) == 0;
+        if (rand(2))
+            attribute("id", NULL);
+        if (has_a)
+            attribute("a", &exp_);
+        if (rand(3) == 0)
+            attribute("id2", NULL);
+        if (has_b)
+            attribute("b", &exp_);
+    }
+
+    void attribute(string const& name, string* out)
+    {
+        string value;
+        xml_ += " ";
+        space();
+        xml_ += name;
+        space();
+        xml_ += "=";
+        space();
+        char quote = rand(2) ? '"' : '\'';
+        xml_ += quote;
+        for (int n = rand(4); n > 0; --n) {
+            if (rand(3))
+                plain(&value, quote);
+            else
+                entity(&value);
+        }
+        xml_ += quote;
+        if (out)
+            *out += " " + name + "=" + value;
+    }
+
+    void element(int depth)
+    {
+        junk();
+        int kind = rand(depth < 4 ? 6 : 3);
+        if (kind == 0) {
+            text_element();
+        } else if (kind == 1) {
+            number_element();
+        } else if (kind == 2) { // empty element
+            string name = rand(2) ? "a" : "b";
+            xml_ += "<" + name;
+            exp_ += "<" + name;
+            attributes();
+            space();
+            xml_ += "/>";
+            exp_ += "></" + name + ">";
+        } else {
+            string name = kind == 3 ? "a" : kind == 4 ? "b" : "c";
+            open(name);
+            for (int n = rand(5); n > 0; --n)
+                element(depth + 1);
+            junk();
+            close(name);
+        }
+        junk();
+    }
+
+    // read_text() returns characters, entities and CDATA; comments,
+    // PIs and nested elements are skipped
+    void text_element()
+    {
+        open("t");
+        exp_ += "{";
+        for (int n = rand(6); n > 0; --n) {
+            switch (rand(7)) {
+                case 0:
+                case 1: plain(&exp_, 0); break;
+                case 2: entity(&exp_); break;
+                case 3: {
+                    static const char* cdata[] = { "<x>", "a&b", "]]",
+                                                   "] ]>", "" };
+                    string s = cdata[rand(5)];
+                    xml_ += "<![CDATA[" + s + "]]>";
+                    exp_ += s;
+                    break;
+                }
+                case 4: xml_ += "<!-- <t> -->"; break;
+                case 5: xml_ += "<?pi?>"; break;
+                case 6: xml_ += "<q a='1'>nested<t>text</t></q>"; break;
+            }
+        }
+        exp_ += "}";
+        xml_ += "</t>";
+    }
+
+    // numbers separated with blanks and commas
+    void number_element()
+    {
+        open("n");
+        static const char* seps[] = { " ", ",", ", ", "\n", "\t", "\r\n" };
+        for (int n = rand(20); n > 0; --n) {
+            char buf[32];
+            int k = rand(3);
+            double x = ((double) rng_() - 2e9) / (rand(2) ? 7. : 1e6);
+            if (k == 0)
+                snprintf(buf, sizeof(buf), "%d", (int) x);
+            else
+                snprintf(buf, sizeof(buf), k == 1 ? "%.6g" : "%.3e", x);
+            xml_ += seps[rand(6)];
+            xml_ += buf;
+            if (rand(10) == 0)
+                xml_ += "<!-- x -->";
+            exp_ += " " + S(strtod(buf, NULL));
+        }
+        xml_ += seps[rand(6)];
+        xml_ += "</n>";
+    }
+};
+
+int main()
+{
+    check("all kinds of nodes",
+          "\xEF\xBB\xBF<?xml version='1.0'?><!DOCTYPE r [<!ENTITY e 'x'>]>"
+          "<!-- c --><r a='1&amp;2'><t>a&lt;b&#65;&#x263A;<![CDATA[<x>]]>"
+          "c<q>ignored</q>d<!-- c -->e</t><e/><n> 1, 2.5 <?pi?> 3 </n></r>",
+          "<r a=1&2><t>{a<bA\xE2\x98\xBA<x>cde}<e></e><n> 1 2.5 3</r>");
+    check("mismatched tags", "<r><a></b></r>", "ERROR");
+    check("not closed", "<r><a>", "ERROR");
+    check("not a number", "<r><n>1 x</n></r>", "ERROR");
+    check("unterminated attribute", "<r a=\"x></r>", "ERROR");
+    check("bad character reference", "<r><t>&#xZZ;</t></r>", "ERROR");
+    check("eof in comment", "<r><!-- </r>", "ERROR");
+    check("eof in CDATA", "<r><t><![CDATA[ </t></r>", "ERROR");
+
+    Generator gen(7);
+    for (int i = 0; i < 60; ++i) {
+        string xml, expected;
+        // large documents don't fit in one chunk of the stream reader
+        gen.document(i % 4 == 0 ? 300000 : 100, &xml, &expected);
+        check("random document #" + S(i), xml, expected);
+    }
+
+    if (n_errors != 0) {
+        printf("%d documents were not read correctly\n", n_errors);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
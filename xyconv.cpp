@@ -128,7 +128,7 @@ void export_metadata(FILE *f, xylib::MetaData const& meta)
 {
     for (size_t i = 0; i != meta.size(); ++i) {
         const string& key = meta.get_key(i);
-        const string& value = meta.get(key);
+        const string& value = meta.get_value(i);
         string::size_type pos = 0;
         for (;;) {
             string::size_type new_pos = value.find('\n', pos);
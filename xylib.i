@@ -8,6 +8,8 @@
 %}
 %include "std_string.i"
 %include "std_except.i"
+%include "std_pair.i"
+%template(IndexRange) std::pair<int, int>;
 
 /* possible improvements:
  *  - better __str__/__repr__
@@ -45,4 +47,16 @@
 %#endif // python3
 #endif // SWIGPYTHON
 
+// C++ iteration over MetaData, use size(), get_key() and get_value()
+%ignore xylib::MetaData::const_iterator;
+%ignore xylib::MetaData::begin;
+%ignore xylib::MetaData::end;
+
+// functions for use in filetype implementations
+%ignore xylib::Block::add_column;
+%ignore xylib::Block::del_column;
+%ignore xylib::Block::get_column_ptr;
+%ignore xylib::slice_column;
+%ignore xylib::concat_columns;
+
 %include "xylib/xylib.h"
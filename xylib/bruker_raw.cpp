@@ -5,6 +5,7 @@
 #include "bruker_raw.h"
 #include <sstream>
 #include "util.h"
+#include "fileio.h"
 
 using namespace std;
 using namespace xylib::util;
@@ -24,7 +25,7 @@ const FormatInfo BrukerRawDataSet::fmt_info(
 
 bool BrukerRawDataSet::check(istream &f, string* details)
 {
-    string head = read_string(f, 4);
+    string head = read_string_nothrow(f, 4);
     if (head == "RAW ") {
         if (details)
             *details = "ver. 1";
@@ -35,12 +36,12 @@ bool BrukerRawDataSet::check(istream &f, string* details)
             *details = "ver. 2";
         return true;
     }
-    else if (head == "RAW1" && read_string(f, 3) == ".01") {
+    else if (head == "RAW1" && read_string_nothrow(f, 3) == ".01") {
         if (details)
             *details = "ver. 3";
         return true;
     }
-    else if (head == "RAW4" && read_string(f, 3) == ".00") {
+    else if (head == "RAW4" && read_string_nothrow(f, 3) == ".00") {
         if (details)
             *details = "ver. 4";
         return true;
@@ -50,6 +51,19 @@ bool BrukerRawDataSet::check(istream &f, string* details)
 }
 
 
+// Adds fixed-step x column and y column with steps floats read from f.
+// Only points requested with options x-range or index-range are read.
+static void add_xy_columns(DataSet* ds, Block* blk, istream &f,
+                           double x_start, double x_step, int steps)
+{
+    shared_ptr<Column> xcol(new StepColumn(x_start, x_step, steps));
+    pair<int, int> range = ds->get_point_range(*xcol, steps);
+    blk->add_column(slice_column(xcol, range.first,
+                                 range.second - range.first));
+    blk->add_column(read_le_column<float>(f, steps, range));
+}
+
+
 void BrukerRawDataSet::load_data(std::istream &f, const char*)
 {
     string head = read_string(f, 4);
@@ -84,42 +98,33 @@ void BrukerRawDataSet::load_version1(std::istream &f)
                 cur_range_steps = read_uint32_le(f);
         }
 
-        blk->meta["MEASUREMENT_TIME_PER_STEP"] = S(read_flt_le(f));
+        blk->meta.set_float("MEASUREMENT_TIME_PER_STEP", read_flt_le(f));
         float x_step = read_flt_le(f);
-        blk->meta["SCAN_MODE"] = Su(read_uint32_le(f));
+        blk->meta.set_int("SCAN_MODE", read_uint32_le(f));
         f.ignore(4);
         float x_start = read_flt_le(f);
 
-        StepColumn *xcol = new StepColumn(x_start, x_step);
-        blk->add_column(xcol);
-
         float t = read_flt_le(f);
         // documentation says: "-1.E6 = unknown"
         if (-1e6 != t)
-            blk->meta["THETA_START"] = S(t);
+            blk->meta.set_float("THETA_START", t);
 
         t = read_flt_le(f);
         if (-1e6 != t)
-            blk->meta["KHI_START"] = S(t);
+            blk->meta.set_float("KHI_START", t);
 
         t = read_flt_le(f);
         if (-1e6 != t)
-            blk->meta["PHI_START"] = S(t);
+            blk->meta.set_float("PHI_START", t);
 
         blk->meta["SAMPLE_NAME"] = read_string(f, 32);
-        blk->meta["K_ALPHA1"] = S(read_flt_le(f));
-        blk->meta["K_ALPHA2"] = S(read_flt_le(f));
+        blk->meta.set_float("K_ALPHA1", read_flt_le(f));
+        blk->meta.set_float("K_ALPHA2", read_flt_le(f));
 
         f.ignore(72);   // unused fields
         following_range = read_uint32_le(f);
 
-        VecColumn *ycol = new VecColumn();
-
-        for(unsigned i = 0; i < cur_range_steps; ++i) {
-            float y = read_flt_le(f);
-            ycol->add_val(y);
-        }
-        blk->add_column(ycol);
+        add_xy_columns(this, blk, f, x_start, x_step, cur_range_steps);
 
         add_block(blk);
     }
@@ -135,11 +140,11 @@ void BrukerRawDataSet::load_version2(std::istream &f)
     f.ignore(162);
     meta["DATE_TIME_MEASURE"] = read_string(f, 20);
     meta["CEMICAL SYMBOL FOR TUBE ANODE"] = read_string(f, 2);
-    meta["LAMDA1"] = S(read_flt_le(f));
-    meta["LAMDA2"] = S(read_flt_le(f));
-    meta["INTENSITY_RATIO"] = S(read_flt_le(f));
+    meta.set_float("LAMDA1", read_flt_le(f));
+    meta.set_float("LAMDA2", read_flt_le(f));
+    meta.set_float("INTENSITY_RATIO", read_flt_le(f));
     f.ignore(8);
-    meta["TOTAL_SAMPLE_RUNTIME_IN_SEC"] = S(read_flt_le(f));
+    meta.set_float("TOTAL_SAMPLE_RUNTIME_IN_SEC", read_flt_le(f));
 
     f.ignore(42);   // move ptr to the start of 1st block
     for (unsigned cur_range = 0; cur_range < range_cnt; ++cur_range) {
@@ -151,23 +156,16 @@ void BrukerRawDataSet::load_version2(std::istream &f)
 
         unsigned cur_range_steps = read_uint16_le(f);
         f.ignore(4);
-        blk->meta["SEC_PER_STEP"] = S(read_flt_le(f));
+        blk->meta.set_float("SEC_PER_STEP", read_flt_le(f));
 
         float x_step = read_flt_le(f);
         float x_start = read_flt_le(f);
-        StepColumn *xcol = new StepColumn(x_start, x_step);
-        blk->add_column(xcol);
 
         f.ignore(26);
-        blk->meta["TEMP_IN_K"] = Su(read_uint16_le(f));
+        blk->meta.set_int("TEMP_IN_K", read_uint16_le(f));
 
         f.ignore(cur_header_len - 48);  // move ptr to the data_start
-        VecColumn *ycol = new VecColumn;
-        for(unsigned i = 0; i < cur_range_steps; ++i) {
-            float y = read_flt_le(f);
-            ycol->add_val(y);
-        }
-        blk->add_column(ycol);
+        add_xy_columns(this, blk, f, x_start, x_step, cur_range_steps);
 
         add_block(blk);
     }
@@ -218,14 +216,14 @@ void BrukerRawDataSet::load_version1_01(std::istream &f)
     f.ignore(4); // secondary monochromator     // address 604
     meta["ANODE_MATERIAL"] = read_string(f,4);  // address 608
     f.ignore(4); // unused                      // address 612
-    meta["ALPHA_AVERAGE"] = S(read_dbl_le(f));  // address 616
-    meta["ALPHA1"] = S(read_dbl_le(f));         // address 624
-    meta["ALPHA2"] = S(read_dbl_le(f));         // address 632
-    meta["BETA"] = S(read_dbl_le(f));           // address 640
-    meta["ALPHA_RATIO"] = S(read_dbl_le(f));    // address 648
+    meta.set_double("ALPHA_AVERAGE", read_dbl_le(f));  // address 616
+    meta.set_double("ALPHA1", read_dbl_le(f));         // address 624
+    meta.set_double("ALPHA2", read_dbl_le(f));         // address 632
+    meta.set_double("BETA", read_dbl_le(f));           // address 640
+    meta.set_double("ALPHA_RATIO", read_dbl_le(f));    // address 648
     f.ignore(4); // (C4) unit name              // address 656
     f.ignore(4); // (R4) intensity beta:a1      // address 660
-    meta["measurement time"] = S(read_flt_le(f)); // address 664
+    meta.set_float("measurement time", read_flt_le(f)); // address 664
     f.ignore(43); // unused                     // address 668
     f.ignore(1); // hardware dependency ...     // address 711
     //assert(f.tellg() == 712);
@@ -236,11 +234,11 @@ void BrukerRawDataSet::load_version1_01(std::istream &f)
         int header_len = read_uint32_le(f);     // address 0
         format_assert(this, header_len == 304);
         int steps = read_uint32_le(f);          // address 4
-        blk->meta["STEPS"] = S(steps);
+        blk->meta.set_int("STEPS", steps);
         double start_theta = read_dbl_le(f);    // address 8
-        blk->meta["START_THETA"]= S(start_theta);
+        blk->meta.set_double("START_THETA", start_theta);
         double start_2theta = read_dbl_le(f);   // address 16
-        blk->meta["START_2THETA"] = S(start_2theta);
+        blk->meta.set_double("START_2THETA", start_2theta);
 
         f.ignore(8); // Chi drive start         // address 24
         f.ignore(8); // Phi drive start         // address 32
@@ -254,9 +252,9 @@ void BrukerRawDataSet::load_version1_01(std::istream &f)
         f.ignore(6);                            // address 88
         f.ignore(2); // unused                  // address 94
         f.ignore(4); // detector code           // address 96
-        blk->meta["HIGH_VOLTAGE"] = S(read_flt_le(f)); // address 100
-        blk->meta["AMPLIFIER_GAIN"] = S(read_flt_le(f)); // 104
-        blk->meta["DISCRIMINATOR_1_LOWER_LEVEL"] = S(read_flt_le(f)); // 108
+        blk->meta.set_float("HIGH_VOLTAGE", read_flt_le(f)); // address 100
+        blk->meta.set_float("AMPLIFIER_GAIN", read_flt_le(f)); // 104
+        blk->meta.set_float("DISCRIMINATOR_1_LOWER_LEVEL", read_flt_le(f)); // 108
         f.ignore(4);                            // address 112
         f.ignore(4);                            // address 116
         f.ignore(8);                            // address 120
@@ -270,21 +268,21 @@ void BrukerRawDataSet::load_version1_01(std::istream &f)
         f.ignore(4);                            // address 168
         f.ignore(4); // unused                  // address 172
         double step_size = read_dbl_le(f);      // address 176
-        blk->meta["STEP_SIZE"] = S(step_size);
+        blk->meta.set_double("STEP_SIZE", step_size);
         f.ignore(8);                            // address 184
-        blk->meta["TIME_PER_STEP"] = S(read_flt_le(f)); // 192
+        blk->meta.set_float("TIME_PER_STEP", read_flt_le(f)); // 192
         f.ignore(4);                            // address 196
         f.ignore(4);                            // address 200
         f.ignore(4);                            // address 204
-        blk->meta["ROTATION_SPEED [rpm]"] = S(read_flt_le(f));  // 208
+        blk->meta.set_float("ROTATION_SPEED [rpm]", read_flt_le(f)); // 208
         f.ignore(4);                            // address 212
         f.ignore(4);                            // address 216
         f.ignore(4);                            // address 220
-        blk->meta["GENERATOR_VOLTAGE"] = Su(read_uint32_le(f)); // 224
-        blk->meta["GENERATOR_CURRENT"] = Su(read_uint32_le(f)); // 228
+        blk->meta.set_int("GENERATOR_VOLTAGE", read_uint32_le(f)); // 224
+        blk->meta.set_int("GENERATOR_CURRENT", read_uint32_le(f)); // 228
         f.ignore(4);                            // address 232
         f.ignore(4); // unused                  // address 236
-        blk->meta["USED_LAMBDA"] = S(read_dbl_le(f)); // 240
+        blk->meta.set_double("USED_LAMBDA", read_dbl_le(f)); // 240
         f.ignore(4);                            // address 248
         f.ignore(4);                            // address 252
         int supplementary_headers_size = read_uint32_le(f); // address 256
@@ -298,15 +296,7 @@ void BrukerRawDataSet::load_version1_01(std::istream &f)
         if (supplementary_headers_size > 0)
             f.ignore(supplementary_headers_size);
 
-        StepColumn *xcol = new StepColumn(start_2theta, step_size);
-        blk->add_column(xcol);
-
-        VecColumn *ycol = new VecColumn;
-        for (int i = 0; i < steps; ++i) {
-            float y = read_flt_le(f);
-            ycol->add_val(y);
-        }
-        blk->add_column(ycol);
+        add_xy_columns(this, blk, f, start_2theta, step_size, steps);
 
         add_block(blk);
     }
@@ -346,11 +336,11 @@ void BrukerRawDataSet::load_version4(std::istream &f)
         else if (segment_type == 30) { // HardwareConfiguration
             assert(segment_len >= 120);
             f.ignore(64);                               // offset +8
-            meta["ALPHA_AVERAGE"] = S(read_dbl_le(f));  // offset +72
-            meta["ALPHA1"] = S(read_dbl_le(f));         // offset +80
-            meta["ALPHA2"] = S(read_dbl_le(f));         // offset +88
-            meta["BETA"] = S(read_dbl_le(f));           // offset +96
-            meta["ALPHA_RATIO"] = S(read_dbl_le(f));    // offset +104
+            meta.set_double("ALPHA_AVERAGE", read_dbl_le(f));  // offset +72
+            meta.set_double("ALPHA1", read_dbl_le(f));         // offset +80
+            meta.set_double("ALPHA2", read_dbl_le(f));         // offset +88
+            meta.set_double("BETA", read_dbl_le(f));           // offset +96
+            meta.set_double("ALPHA_RATIO", read_dbl_le(f));    // offset +104
             f.ignore(4);                                // offset +112
             meta["ANODE_MATERIAL"] = read_string(f,4);  // offset +116
             f.ignore(segment_len-120);                  // offset +120
@@ -362,8 +352,8 @@ void BrukerRawDataSet::load_version4(std::istream &f)
             f.ignore(32);                               // offset +36
             double delta = read_dbl_le(f);              // offset +68
             f.ignore(segment_len-76);
-            meta["DRIVE" + S(drive_num) + "_ALIGN_FLAG"] = S(align_flag);
-            meta["DRIVE" + S(drive_num) + "_DELTA"] = S(delta);
+            meta.set_int("DRIVE" + S(drive_num) + "_ALIGN_FLAG", align_flag);
+            meta.set_double("DRIVE" + S(drive_num) + "_DELTA", delta);
             drive_num++;
         }
         else { // skip others
@@ -379,17 +369,17 @@ void BrukerRawDataSet::load_version4(std::istream &f)
         blk->meta["SCAN_TYPE"] = read_string(f,24); // offset +32
         f.ignore(16);                               // offset +56
         double start_angle = read_dbl_le(f);        // offset +72
-        blk->meta["START_ANGLE"] = S(start_angle);
+        blk->meta.set_double("START_ANGLE", start_angle);
         double step_size = read_dbl_le(f);          // offset +80
-        blk->meta["STEP_SIZE"] = S(step_size);
+        blk->meta.set_double("STEP_SIZE", step_size);
         int steps = read_uint32_le(f);              // offset +88
-        blk->meta["STEPS"] = S(steps);
-        blk->meta["TIME_PER_STEP"] = S(read_flt_le(f)); // offset +92
+        blk->meta.set_int("STEPS", steps);
+        blk->meta.set_float("TIME_PER_STEP", read_flt_le(f)); // offset +92
         f.ignore(4);                                // offset +96
-        blk->meta["GENERATOR_VOLTAGE"] = S(read_flt_le(f)); // +100
-        blk->meta["GENERATOR_CURRENT"] = S(read_flt_le(f)); // +104
+        blk->meta.set_float("GENERATOR_VOLTAGE", read_flt_le(f)); // +100
+        blk->meta.set_float("GENERATOR_CURRENT", read_flt_le(f)); // +104
         f.ignore(4);                                // offset +108
-        blk->meta["USED_LAMBDA"] = S(read_dbl_le(f));     // offset +112
+        blk->meta.set_double("USED_LAMBDA", read_dbl_le(f));     // offset +112
         f.ignore(16);                               // offset +120
         int datum_size = read_uint32_le(f);         // offset +136
         int hdr_size = read_uint32_le(f);           // offset +140
@@ -410,37 +400,37 @@ void BrukerRawDataSet::load_version4(std::istream &f)
                     string segment_name = read_string(f,24); // offset +12
                     if (segment_name == "Theta") {
                         f.ignore(20);               // offset +36
-                        blk->meta["START_THETA"] = S(read_dbl_le(f)); // +56
+                        blk->meta.set_double("START_THETA", read_dbl_le(f)); // +56
                         f.ignore(segment_len-64);
                     }
                     else if (segment_name == "2Theta") {
                         f.ignore(20);               // offset +36
-                        blk->meta["START_2THETA"] = S(read_dbl_le(f)); // +56
+                        blk->meta.set_double("START_2THETA", read_dbl_le(f)); // +56
                         f.ignore(segment_len-64);
                     }
                     else if (segment_name == "Chi") {
                         f.ignore(20);               // offset +36
-                        blk->meta["START_CHI"] = S(read_dbl_le(f)); // +56
+                        blk->meta.set_double("START_CHI", read_dbl_le(f)); // +56
                         f.ignore(segment_len-64);
                     }
                     else if (segment_name == "Phi") {
                         f.ignore(20);               // offset +36
-                        blk->meta["START_PHI"] = S(read_dbl_le(f)); // +56
+                        blk->meta.set_double("START_PHI", read_dbl_le(f)); // +56
                         f.ignore(segment_len-64);
                     }
                     else if (segment_name == "BeamTranslation") {
                         f.ignore(20);               // offset +36
-                        blk->meta["START_BEAM_TRANSLATION"] = S(read_dbl_le(f)); // +56
+                        blk->meta.set_double("START_BEAM_TRANSLATION", read_dbl_le(f)); // +56
                         f.ignore(segment_len-64);
                     }
                     else if (segment_name == "Z-Drive") {
                         f.ignore(20);               // offset +36
-                        blk->meta["START_Z-DRIVE"] = S(read_dbl_le(f)); // +56
+                        blk->meta.set_double("START_Z-DRIVE", read_dbl_le(f)); // +56
                         f.ignore(segment_len-64);
                     }
                     else if (segment_name == "Divergence Slit") {
                         f.ignore(20);               // offset +36
-                        blk->meta["DIVERGENCE_SLIT"] = S(read_dbl_le(f)); // +56
+                        blk->meta.set_double("DIVERGENCE_SLIT", read_dbl_le(f)); // +56
                         f.ignore(segment_len-64);
                     }
                     else { // ignore others
@@ -456,16 +446,8 @@ void BrukerRawDataSet::load_version4(std::istream &f)
             }
 
             // Now compute the x values and read the y values
-            StepColumn *xcol = new StepColumn(start_angle, step_size);
-            blk->add_column(xcol);
-
-            VecColumn *ycol = new VecColumn;
             assert(datum_size == 4);
-            for (int i = 0; i < steps; ++i) {
-                float y = read_flt_le(f);
-                ycol->add_val(y);
-            }
-            blk->add_column(ycol);
+            add_xy_columns(this, blk, f, start_angle, step_size, steps);
         }
         else { // Skip ranges we don't understand
             blk->meta["UNKNOWN_RANGE_SCAN_TYPE"] = "true";
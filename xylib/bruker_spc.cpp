@@ -32,17 +32,14 @@ bool BrukerSpcDataSet::check(std::istream&, std::string*)
 void BrukerSpcDataSet::load_data(std::istream &f, const char* path)
 {
     // (1) read y-data from the SPC-file
-    VecColumn *ycol = new VecColumn;
+    TypedVecColumn<int32_t> *ycol = new TypedVecColumn<int32_t>;
 
-    int i = 0;
-    while (i == 0) {
-        try { // read until read_int32_be throws error
-            int y = read_int32_be(f);
-            ycol->add_val(y);
-
-        } catch (const FormatError&) {
-             break;
-        }
+    // read big-endian integers until the end of file
+    char buf[16384];
+    while (f) {
+        f.read(buf, sizeof(buf));
+        size_t n = f.gcount() / 4;
+        decode_array<int32_t>(buf, n, ycol->extend(n), true);
     }
 
     Block* blk = new Block;
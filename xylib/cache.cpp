@@ -6,6 +6,7 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <mutex>
 #include <vector>
 
 #include "xylib.h"
@@ -55,15 +56,16 @@ struct CacheImp
 {
     size_t max_size_;
     std::vector<CachedFile> cache_;
+    std::mutex mutex_; // guards the members above
 };
 
 Cache* Cache::instance_ = NULL;
 
 Cache* Cache::Get()
 {
-    if (instance_ == NULL)
-        instance_ = new Cache();
-    return instance_;
+    // initialization of function-local static is thread-safe
+    static Cache* const cache = (instance_ = new Cache());
+    return cache;
 }
 
 Cache::Cache()
@@ -77,12 +79,15 @@ Cache::~Cache()
     delete imp_;
 }
 
-// not thread-safe
+// Can be called from many threads. The file is loaded without holding
+// the lock, so the same file could be loaded twice at the same time.
+// Returned dataset is immutable and can be shared between threads.
 dataset_shared_ptr Cache::load_file(string const& path,
                                            string const& format_name,
                                            string const& options)
 {
     std::vector<CachedFile>& cache_ = imp_->cache_;
+    std::unique_lock<std::mutex> lock(imp_->mutex_);
     vector<CachedFile>::iterator iter;
     for (iter = cache_.begin(); iter < cache_.end(); ++iter) {
         if (path == iter->path_ && format_name == iter->format_name_
@@ -101,8 +106,10 @@ dataset_shared_ptr Cache::load_file(string const& path,
             }
         }
     }
+    lock.unlock();
     // this can throw exception
     dataset_shared_ptr ds(xylib::load_file(path, format_name, options));
+    lock.lock();
 
     if (cache_.size() >= imp_->max_size_)
         cache_.erase(cache_.begin());
@@ -112,19 +119,22 @@ dataset_shared_ptr Cache::load_file(string const& path,
 
 void Cache::set_max_size(size_t max_size)
 {
+    std::lock_guard<std::mutex> lock(imp_->mutex_);
     std::vector<CachedFile>& cache_ = imp_->cache_;
     imp_->max_size_ = max_size;
-    if (max_size > cache_.size())
+    if (max_size < cache_.size())
         cache_.erase(cache_.begin() + max_size, cache_.end());
 }
 
 size_t Cache::get_max_size() const
 {
+    std::lock_guard<std::mutex> lock(imp_->mutex_);
     return imp_->max_size_;
 }
 
 void Cache::clear_cache()
 {
+    std::lock_guard<std::mutex> lock(imp_->mutex_);
     imp_->cache_.clear();
 }
 
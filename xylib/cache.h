@@ -27,7 +27,7 @@ using dataset_shared_ptr = std::shared_ptr<const xylib::DataSet>;
 
 struct CacheImp;
 
-// singleton
+// singleton; its functions can be called from different threads
 class XYLIB_API Cache
 {
 public:
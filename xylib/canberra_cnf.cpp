@@ -4,7 +4,6 @@
 #define BUILDING_XYLIB
 #include "canberra_cnf.h"
 
-#include <ctime>
 #include <cstring>
 #include <memory>  // for unique_ptr
 #include <cstdint>
@@ -63,17 +62,11 @@ Column* read_energy_callibration(const char* p, Block *blk, int n_channels)
     if (coef[1] == 0.)
         return NULL;
     for (int i = 0; i != 3; ++i)
-        blk->meta["energy calib "+S(i)] = format1<double,16>("%.7g", coef[i]);
-    if (coef[2] != 0.) { // quadr term
-        VecColumn *vc = new VecColumn;
+        blk->meta.set_float("energy calib "+S(i), (float) coef[i]);
+    if (coef[2] != 0.) // quadr term
         // Comparing results with FitzPeaks and and Cambio 4.0
         // the first channel should have number 1 (not 0).
-        for (int i = 1; i <= n_channels; i++) {
-            double x = coef[0] + coef[1] * i + coef[2] * i * i;
-            vc->add_val(x);
-        }
-        return vc;
-    }
+        return new PolyColumn(vector<double>(coef, coef+3), 1, n_channels);
     else
         // since we start from ch1, the first value is coef[0] + coef[1]
         return new StepColumn(coef[0]+coef[1], coef[1]);
@@ -101,17 +94,12 @@ bool is_printable(const string &s)
 // > the energy coefficients).
 //
 static
-string convert_date(const char* p)
+long long convert_date(const char* p)
 {
     uint64_t d;
     memcpy(&d, p, sizeof(d));
     le_to_host(&d, sizeof(d));
-    time_t t = d / 10000000 - 3506716800u; // time since the Epoch
-    char s[64];
-    size_t r = strftime(s, sizeof(s), "%a, %Y-%m-%d %H:%M:%S", gmtime(&t));
-    if (r == 0)
-        throw FormatError("reading date failed.");
-    return string(s);
+    return (long long) (d / 10000000) - 3506716800LL; // time since the Epoch
 }
 
 // comment from Stefan Schneider-Kennedy:
@@ -227,7 +215,7 @@ void CanberraCnfDataSet::load_data(std::istream &f, const char*)
     // dates and times
     const char* date_ptr = acq_ptr+48+offset2+1;
     format_assert(this, date_ptr + 3*8 < end);
-    blk->meta["date and time"] = convert_date(date_ptr); // when taken
+    blk->meta.set_time("date and time", convert_date(date_ptr)); // when taken
     float real_time = convert_time(date_ptr + 8);
     blk->meta["real time (s)"] = format1<float, 16>("%.2f", real_time);
     float live_time = convert_time(date_ptr + 16);
@@ -241,7 +229,7 @@ void CanberraCnfDataSet::load_data(std::istream &f, const char*)
                                         blk.get(), n_channels);
     if (xcol == NULL) {
         warn("Warning. Energy Calibration not found.\n");
-        xcol = new StepColumn(1, 1);
+        xcol = new StepColumn(1, 1, n_channels);
     }
 
     // code from JF is also reading detector name, but it's not needed here
@@ -254,20 +242,21 @@ void CanberraCnfDataSet::load_data(std::istream &f, const char*)
         delete xcol;
         throw FormatError("Channel data not found.");
     }
-    VecColumn *ycol = new VecColumn;
+    // only this range of points is read (options x-range, index-range)
+    pair<int, int> range = get_point_range(*xcol, n_channels);
+    int count = range.second - range.first;
+    TypedVecColumn<uint32_t> *ycol = new TypedVecColumn<uint32_t>;
+    uint32_t *y = ycol->extend(count);
+    decode_array<uint32_t>(chan_ptr+512 + 4*range.first, count, y);
     // the two first channels sometimes contain live and real time
-    for (int i = 0; i < 2; ++i) {
-        uint32_t y = from_le<uint32_t>(chan_ptr+512+4*i);
-        if ((int) y == iround(real_time) || (int) y == iround(live_time))
-            y = 0;
-        ycol->add_val(y);
-    }
-    for (int i = 2; i < n_channels; ++i) {
-        uint32_t y = from_le<uint32_t>(chan_ptr+512+4*i);
-        ycol->add_val(y);
+    for (int i = range.first; i < 2 && i < range.second; ++i) {
+        uint32_t& v = y[i - range.first];
+        if ((int) v == iround(real_time) || (int) v == iround(live_time))
+            v = 0;
     }
 
-    blk->add_column(xcol);
+    blk->add_column(slice_column(shared_ptr<Column>(xcol), range.first,
+                                 count));
     blk->add_column(ycol);
     add_block(blk.release());
 }
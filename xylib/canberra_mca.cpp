@@ -8,6 +8,7 @@
 #include <cstdint>
 
 #include "util.h"
+#include "fileio.h"
 
 using namespace std;
 using namespace xylib::util;
@@ -60,27 +61,42 @@ void CanberraMcaDataSet::load_data(std::istream &f, const char*)
 
     Column *xcol = NULL;
     if (energy_quadr) {
-        VecColumn *vc = new VecColumn;
-        for (int i = 1; i <= 2048; i++) {
-            //FIXME should it be from 1 ?
-            // perhaps from 0 to 2047, description was not clear.
-            double x = energy_offset + energy_slope * i + energy_quadr * i * i;
-            vc->add_val(x);
-        }
-        xcol = vc;
+        vector<double> coef(3);
+        coef[0] = energy_offset;
+        coef[1] = energy_slope;
+        coef[2] = energy_quadr;
+        //FIXME should it be from 1 ?
+        // perhaps from 0 to 2047, description was not clear.
+        xcol = new PolyColumn(coef, 1, 2048);
     }
     else {
-        xcol = new StepColumn(energy_offset+energy_slope, energy_slope);
+        xcol = new StepColumn(energy_offset+energy_slope, energy_slope, 2048);
     }
-    blk->add_column(xcol);
+    // only this range of points is read (options x-range, index-range)
+    pair<int, int> range = get_point_range(*xcol, 2048);
+    int count = range.second - range.first;
+    blk->add_column(slice_column(shared_ptr<Column>(xcol), range.first,
+                                 count));
 
-    VecColumn *ycol = new VecColumn;
     uint16_t data_offset = from_le<uint16_t>(all_data+24);
-    for (int i = 0; i < 2048; i++) {
-        uint32_t y = from_le<uint32_t>(all_data + data_offset + 4*i);
-        ycol->add_val(y);
+    Column *ycol = NULL;
+    if (get_file_buffer(f)) {
+        // refer to the data in the file buffer, don't copy it
+        delete [] all_data;
+        f.seekg(data_offset + 4 * range.first);
+        ycol = read_le_column<uint32_t>(f, count);
+    } else {
+        if (data_offset + 2048*4 > file_size) {
+            delete [] all_data;
+            delete blk;
+            throw FormatError("Unexpected end of file.");
+        }
+        TypedVecColumn<uint32_t> *vc = new TypedVecColumn<uint32_t>;
+        decode_array<uint32_t>(all_data + data_offset + 4 * range.first,
+                               count, vc->extend(count));
+        delete [] all_data;
+        ycol = vc;
     }
-    delete [] all_data;
     blk->add_column(ycol);
 
     add_block(blk);
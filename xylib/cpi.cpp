@@ -4,6 +4,7 @@
 #define BUILDING_XYLIB
 #include "cpi.h"
 #include "util.h"
+#include "fileio.h"
 
 using namespace std;
 using namespace xylib::util;
@@ -52,26 +53,26 @@ void CpiDataSet::load_data(std::istream &f, const char*)
 
     Block* blk = new Block;
 
-    string s;
-    getline (f, s); // first line
-    getline (f, s);//xmin
-    double xmin = my_strtod(s);
-    getline (f, s); //xmax
-    getline (f, s); //xstep
-    double xstep = my_strtod(s);
+    LineReader reader(f);
+    StrView s;
+    reader.next(&s); // first line
+    reader.next(&s); //xmin
+    double xmin = my_strtod(s.str());
+    reader.next(&s); //xmax
+    reader.next(&s); //xstep
+    double xstep = my_strtod(s.str());
     StepColumn *xcol = new StepColumn(xmin, xstep);
     blk->add_column(xcol);
 
     // ignore the rest of the header
-    while (getline(f, s))
-        if (str_startwith(s, "SCANDATA"))
-            break;
-    format_assert(this, !f.eof(), "missing SCANDATA");
+    bool has_data = false;
+    while (!has_data && reader.next(&s))
+        has_data = str_startwith(s, "SCANDATA");
+    format_assert(this, has_data, "missing SCANDATA");
 
     // data
     VecColumn *ycol = new VecColumn();
-    while (getline(f, s))
-        ycol->add_val(my_strtod(s));
+    reader.read_values(ycol);
 
     blk->add_column(ycol);
     add_block(blk);
@@ -101,10 +101,12 @@ int count_csv_numbers(const string& line, char sep, int *number_count,
     return out.size() == 1 ? (int)out[0].size() : 0;
 }
 
+// returns 0 and sets *error if the lines can't be read
 static
 char read_4lines(istream &f, bool& decimal_comma,
                  vector<vector<double> > *out,
-                 vector<string> *column_names)
+                 vector<string> *column_names,
+                 string *error)
 {
     // We set a limit on the line length because if we get a large file
     // with no new lines we don't want to read it all.
@@ -114,8 +116,10 @@ char read_4lines(istream &f, bool& decimal_comma,
     buffer[buflen-1] = '\0';
     for (int line_no = 1, cnt = 0; cnt < 4; ++line_no) {
         f.getline(buffer, buflen);
-        if (!f || buffer[buflen-1] != '\0')
-            throw FormatError("reading line " + S(line_no) + " failed.");
+        if (!f || buffer[buflen-1] != '\0') {
+            *error = "reading line " + S(line_no) + " failed.";
+            return 0;
+        }
         if (is_space_or_end(buffer))
             continue;
         lines[cnt] = buffer;
@@ -186,20 +190,16 @@ char read_4lines(istream &f, bool& decimal_comma,
 
 bool CsvDataSet::check(istream &f, string* details)
 {
-    try {
-        bool decimal_comma = false;
-        char sep = read_4lines(f, decimal_comma, NULL, NULL);
-        if (sep != 0 && details) {
-            *details = "separator: " +
-                       (sep == '\t' ? S("TAB") : "'" + S(sep) + "'");
-            if (decimal_comma)
-                *details += ", decimal comma";
-        }
-        return sep != 0;
-    }
-    catch (FormatError &) {
-        return false;
+    bool decimal_comma = false;
+    string error;
+    char sep = read_4lines(f, decimal_comma, NULL, NULL, &error);
+    if (sep != 0 && details) {
+        *details = "separator: " +
+                   (sep == '\t' ? S("TAB") : "'" + S(sep) + "'");
+        if (decimal_comma)
+            *details += ", decimal comma";
     }
+    return sep != 0;
 }
 
 
@@ -212,7 +212,10 @@ void CsvDataSet::load_data(istream &f, const char*)
     string line;
     line.reserve(100);
 
-    char sep = read_4lines(f, decimal_comma, &data, &column_names);
+    string error;
+    char sep = read_4lines(f, decimal_comma, &data, &column_names, &error);
+    if (!error.empty())
+        throw FormatError(error);
     size_t n_col = data[0].size();
     while (getline(f, line)) {
         if (is_space_or_end(line.c_str()))
@@ -8,6 +8,7 @@
 #include <cstdlib>
 
 #include "util.h"
+#include "fileio.h"
 
 using namespace std;
 using namespace xylib::util;
@@ -59,20 +60,20 @@ void DbwsDataSet::load_data(std::istream &f, const char*)
 {
     Block* blk = new Block;
 
-    string s;
-    getline(f, s); // first line
+    LineReader reader(f);
+    StrView s;
+    reader.next(&s); // first line
     format_assert(this, s.size() >= 3*8);
-    blk->set_name(str_trim(s.substr(24)));
-    double start = my_strtod(s.substr(0, 8));
-    double step = my_strtod(s.substr(8, 8));
+    blk->set_name(str_trim(s.substr(24)).str());
+    double start = my_strtod(s.substr(0, 8).str());
+    double step = my_strtod(s.substr(8, 8).str());
     StepColumn *xcol = new StepColumn(start, step);
     blk->add_column(xcol);
 
     // data
     VecColumn *ycol = new VecColumn;
-    while (getline(f, s))
-        // numbers delimited by commas or spaces.
-        ycol->add_values_from_str(s, ',');
+    // numbers delimited by commas or spaces.
+    reader.read_values(ycol, -1, ',');
     blk->add_column(ycol);
 
     add_block(blk);
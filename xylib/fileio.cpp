@@ -0,0 +1,756 @@
+// private helpers for reading whole files into memory (namespace xylib::util)
+// Licence: Lesser GNU Public License 2.1 (LGPL)
+
+#define BUILDING_XYLIB
+#include "fileio.h"
+
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <new>  // bad_alloc
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#ifndef _WIN32
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+# include <sys/types.h>
+# include <sys/stat.h>
+#endif
+
+#ifdef HAVE_IO_URING
+# include <sys/syscall.h>
+# include <linux/io_uring.h>
+#endif
+
+using namespace std;
+
+namespace xylib { namespace util {
+
+OwnedBuffer::OwnedBuffer(size_t capacity)
+    : buf_((char*) malloc(capacity != 0 ? capacity : 1)), capacity_(capacity)
+{
+    if (!buf_)
+        throw bad_alloc();
+    data_ = buf_;
+}
+
+OwnedBuffer::~OwnedBuffer()
+{
+    free(buf_);
+}
+
+void OwnedBuffer::reserve(size_t n)
+{
+    if (n <= capacity_)
+        return;
+    char* p = (char*) realloc(buf_, n);
+    if (!p)
+        throw bad_alloc();
+    data_ = buf_ = p;
+    capacity_ = n;
+}
+
+
+buffer_istreambuf::buffer_istreambuf(file_buffer_ptr const& buf)
+    : buf_(buf)
+{
+    char* p = const_cast<char*>(buf_->data());
+    setg(p, p, p + buf_->size());
+}
+
+buffer_istreambuf::pos_type
+buffer_istreambuf::seekoff(off_type off, ios_base::seekdir dir,
+                           ios_base::openmode which)
+{
+    if (!(which & ios_base::in))
+        return pos_type(off_type(-1));
+    off_type base = 0;
+    if (dir == ios_base::cur)
+        base = gptr() - eback();
+    else if (dir == ios_base::end)
+        base = egptr() - eback();
+    off_type pos = base + off;
+    if (pos < 0 || pos > egptr() - eback())
+        return pos_type(off_type(-1));
+    setg(eback(), eback() + pos, egptr());
+    return pos_type(pos);
+}
+
+buffer_istreambuf::pos_type
+buffer_istreambuf::seekpos(pos_type sp, ios_base::openmode which)
+{
+    return seekoff(off_type(sp), ios_base::beg, which);
+}
+
+file_buffer_ptr get_file_buffer(istream& f)
+{
+    buffer_istreambuf* sb = dynamic_cast<buffer_istreambuf*>(f.rdbuf());
+    return sb ? sb->buffer() : file_buffer_ptr();
+}
+
+const char* buffer_at_stream_pos(istream& f, file_buffer_ptr* buf)
+{
+    *buf = get_file_buffer(f);
+    streamoff pos = *buf ? (streamoff) f.tellg() : -1;
+    if (pos < 0 || (size_t) pos > (*buf)->size()) {
+        buf->reset();
+        return NULL;
+    }
+    return (*buf)->data() + pos;
+}
+
+
+namespace {
+
+template<typename T>
+void decode_le(const char* p, int stride, int count, double* out)
+{
+    if (stride == (int) sizeof(T)) {
+        decode_array<T>(p, count, out);
+        return;
+    }
+    for (int i = 0; i < count; ++i)
+        out[i] = from_le<T>(p + (size_t) i * stride);
+}
+
+} // anonymous namespace
+
+MappedColumn::MappedColumn(file_buffer_ptr const& buf, const char* ptr,
+                           DataType dt, int count, int stride)
+    : ColumnWithName(0.), buf_(buf), ptr_(ptr), dt_(dt), count_(count),
+      stride_(stride != 0 ? stride : get_dtype_size(dt))
+{
+    assert(count == 0 || (ptr >= buf->data() &&
+           ptr + (size_t) (count - 1) * stride_ + get_dtype_size(dt)
+                                          <= buf->data() + buf->size()));
+}
+
+double MappedColumn::get_value(int n) const
+{
+    if (n < 0 || n >= count_)
+        throw RunTimeError("index out of range in MappedColumn");
+    double val;
+    get_values(n, 1, &val);
+    return val;
+}
+
+void MappedColumn::get_values(int first, int count, double* out) const
+{
+    if (first < 0 || count < 0 || first + count > count_)
+        throw RunTimeError("index out of range in MappedColumn");
+    const char* p = ptr_ + (size_t) first * stride_;
+    switch (dt_) {
+        case DT_FLOAT64: decode_le<double>(p, stride_, count, out); break;
+        case DT_FLOAT32: decode_le<float>(p, stride_, count, out); break;
+        case DT_INT32: decode_le<int32_t>(p, stride_, count, out); break;
+        case DT_UINT32: decode_le<uint32_t>(p, stride_, count, out); break;
+        case DT_INT16: decode_le<int16_t>(p, stride_, count, out); break;
+        case DT_UINT16: decode_le<uint16_t>(p, stride_, count, out); break;
+    }
+}
+
+const void* MappedColumn::get_raw_data() const
+{
+    // the values can be used directly only if they are packed,
+    // aligned and in the host byte order
+    int size = get_dtype_size(dt_);
+    if (count_ == 0 || stride_ != size || (uintptr_t) ptr_ % size != 0 ||
+            XYLIB_BIG_ENDIAN)
+        return NULL;
+    return ptr_;
+}
+
+double MappedColumn::get_min() const
+{
+    return calculate_stats().min;
+}
+
+double MappedColumn::get_max(int /*point_count*/) const
+{
+    return calculate_stats().max;
+}
+
+int MappedColumn::get_sort_order() const
+{
+    return calculate_stats().order;
+}
+
+ColumnStats MappedColumn::get_stats(int /*point_count*/) const
+{
+    return calculate_stats();
+}
+
+ColumnStats const& MappedColumn::calculate_stats() const
+{
+    return stats_.get([this]() {
+        ValueScanner vs;
+        vs.add_column(*this, 0, count_);
+        return vs.get_stats();
+    });
+}
+
+Column* map_le_column(istream& f, DataType dt, int count)
+{
+    file_buffer_ptr buf = get_file_buffer(f);
+    if (!buf)
+        return NULL;
+    if (count < 0)
+        throw FormatError("negative number of values");
+    streamoff pos = f.tellg();
+    size_t nbytes = (size_t) count * get_dtype_size(dt);
+    if (pos < 0 || (size_t) pos > buf->size() || nbytes > buf->size() - pos)
+        throw FormatError("unexpected eof");
+    f.seekg(pos + (streamoff) nbytes);
+    return new MappedColumn(buf, buf->data() + pos, dt, count);
+}
+
+void read_value_lines(istream& f, VecColumn* col, int line_count, char sep)
+{
+    file_buffer_ptr buf;
+    if (const char* start = buffer_at_stream_pos(f, &buf)) {
+        const char* p = col->add_values_from_lines(start,
+                                                   buf->data() + buf->size(),
+                                                   line_count, 1, sep);
+        f.seekg(p - buf->data());
+    } else if (line_count == -1) {
+        string rest((istreambuf_iterator<char>(f)), istreambuf_iterator<char>());
+        col->add_values_from_lines(rest.data(), rest.data() + rest.size(),
+                                   -1, 1, sep);
+    } else {
+        string line;
+        for (int i = 0; i < line_count; ++i) {
+            if (!getline(f, line))
+                throw FormatError("unexpected end of file");
+            line += '\n';
+            col->add_values_from_lines(line.data(), line.data() + line.size(),
+                                       1, 1, sep);
+        }
+    }
+}
+
+LineReader::LineReader(istream& f)
+    : copy_last_(true)
+{
+    p_ = buffer_at_stream_pos(f, &buf_);
+    if (p_ != NULL) {
+        end_ = buf_->data() + buf_->size();
+    } else {
+        copy_last_ = false;
+        content_.assign(istreambuf_iterator<char>(f),
+                        istreambuf_iterator<char>());
+        p_ = content_.c_str();
+        end_ = p_ + content_.size();
+    }
+}
+
+bool LineReader::next(StrView* line)
+{
+    if (p_ == end_) {
+        *line = StrView();
+        return false;
+    }
+    const char* eol = p_;
+    while (eol != end_ && *eol != '\n' && *eol != '\r')
+        ++eol;
+    if (eol == end_ && copy_last_) {
+        // the next character could be anything, let's make it NUL
+        last_.assign(p_, eol);
+        *line = StrView(last_);
+    } else {
+        *line = StrView(p_, eol);
+    }
+    p_ = eol;
+    if (p_ != end_ && *p_ == '\r')
+        ++p_;
+    if (p_ != end_ && *p_ == '\n')
+        ++p_;
+    return true;
+}
+
+bool LineReader::next_valid(StrView* line, char comment_char)
+{
+    while (next(line)) {
+        const char* b = line->begin();
+        const char* e = line->end();
+        while (b != e && isspace((unsigned char) *b))
+            ++b;
+        if (b == e || *b == comment_char)
+            continue;
+        const char* c = (const char*) memchr(b, comment_char, e - b);
+        if (c != NULL)
+            e = c;
+        while (isspace((unsigned char) e[-1]))
+            --e;
+        *line = StrView(b, e);
+        return true;
+    }
+    return false;
+}
+
+void LineReader::read_values(VecColumn* col, int line_count, char sep)
+{
+    p_ = col->add_values_from_lines(p_, end_, line_count, 1, sep);
+}
+
+
+#ifndef _WIN32
+
+namespace {
+
+// the same messages as in load_file()
+string open_error(string const& path)
+{
+    return "can't open input file: " + path;
+}
+
+string directory_error(string const& path)
+{
+    return "It is a directory, not a file: " + path;
+}
+
+// files of at least this size are memory-mapped by read_file()
+const size_t mmap_threshold = 1 << 20;
+
+class MappedFile : public FileBuffer
+{
+public:
+    MappedFile(void* addr, size_t size) : addr_(addr)
+    {
+        data_ = static_cast<const char*>(addr);
+        size_ = size;
+    }
+    ~MappedFile() { munmap(addr_, size_); }
+
+private:
+    void* addr_;
+};
+
+// Reads until EOF (or until `size' bytes are read if `size' is known).
+// Files in /proc and pipes report size 0, so the buffer may need to grow.
+file_buffer_ptr read_fd(int fd, size_t size, string const& path,
+                        string* error)
+{
+    shared_ptr<OwnedBuffer> buf(new OwnedBuffer(size != 0 ? size : 4096));
+    size_t n = 0;
+    for (;;) {
+        if (n == buf->capacity()) {
+            if (size != 0)
+                break;
+            buf->reserve(2 * n);
+        }
+        ssize_t r = ::read(fd, buf->wdata() + n, buf->capacity() - n);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            *error = open_error(path);
+            return file_buffer_ptr();
+        }
+        if (r == 0)
+            break;
+        n += r;
+    }
+    buf->set_size(n);
+    return buf;
+}
+
+} // anonymous namespace
+
+file_buffer_ptr read_file(string const& path, string* error, bool allow_mmap)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        *error = open_error(path);
+        return file_buffer_ptr();
+    }
+    // one fstat() instead of stat() before opening the file
+    struct stat sb;
+    if (fstat(fd, &sb) != 0) {
+        *error = open_error(path);
+        ::close(fd);
+        return file_buffer_ptr();
+    }
+    if (S_ISDIR(sb.st_mode)) {
+        *error = directory_error(path);
+        ::close(fd);
+        return file_buffer_ptr();
+    }
+    file_buffer_ptr buf;
+    if (allow_mmap && S_ISREG(sb.st_mode) &&
+            (size_t) sb.st_size >= mmap_threshold) {
+        void* addr = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            buf.reset(new MappedFile(addr, sb.st_size));
+            ::close(fd);
+            return buf;
+        }
+        // if mmap() failed, try to read the file
+    }
+    try {
+        buf = read_fd(fd, S_ISREG(sb.st_mode) ? sb.st_size : 0, path, error);
+    } catch (bad_alloc&) {
+        *error = "Can't allocate memory for file: " + path;
+    }
+    ::close(fd);
+    return buf;
+}
+
+#else // _WIN32
+
+// Paths are in utf8, it's handled by load_file().
+file_buffer_ptr read_file(string const&, string*, bool)
+{
+    return file_buffer_ptr();
+}
+
+#endif // _WIN32
+
+
+#ifdef HAVE_IO_URING
+namespace {
+
+// Minimal io_uring wrapper based on raw syscalls, liburing is not required.
+class IoUring
+{
+public:
+    IoUring() : fd_(-1), sq_ptr_(MAP_FAILED), cq_ptr_(MAP_FAILED),
+                sqes_(NULL), to_submit_(0) {}
+    ~IoUring();
+    bool init(unsigned entries);
+    // number of SQEs that can be queued before the next submit
+    unsigned sq_space() const;
+    // returns NULL if the submission queue is full
+    io_uring_sqe* get_sqe();
+    // submits queued SQEs and waits for at least one completion
+    bool submit_and_wait();
+    // returns NULL if there is no completion
+    io_uring_cqe* peek_cqe();
+    void cqe_seen();
+
+private:
+    int fd_;
+    io_uring_params params_;
+    void* sq_ptr_;
+    size_t sq_len_;
+    void* cq_ptr_;
+    size_t cq_len_;
+    io_uring_sqe* sqes_;
+    size_t sqes_len_;
+    unsigned *sq_head_, *sq_tail_, *sq_mask_, *sq_array_;
+    unsigned *cq_head_, *cq_tail_, *cq_mask_;
+    io_uring_cqe* cqes_;
+    unsigned to_submit_;
+};
+
+IoUring::~IoUring()
+{
+    if (sqes_ != NULL)
+        munmap(sqes_, sqes_len_);
+    if (cq_ptr_ != MAP_FAILED && cq_ptr_ != sq_ptr_)
+        munmap(cq_ptr_, cq_len_);
+    if (sq_ptr_ != MAP_FAILED)
+        munmap(sq_ptr_, sq_len_);
+    if (fd_ >= 0)
+        ::close(fd_);
+}
+
+bool IoUring::init(unsigned entries)
+{
+    memset(&params_, 0, sizeof(params_));
+    fd_ = (int) syscall(__NR_io_uring_setup, entries, &params_);
+    if (fd_ < 0) // ENOSYS, or disabled with sysctl, or seccomp
+        return false;
+    sq_len_ = params_.sq_off.array + params_.sq_entries * sizeof(unsigned);
+    cq_len_ = params_.cq_off.cqes + params_.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = (params_.features & IORING_FEAT_SINGLE_MMAP);
+    if (single_mmap && cq_len_ > sq_len_)
+        sq_len_ = cq_len_;
+    sq_ptr_ = mmap(NULL, sq_len_, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sq_ptr_ == MAP_FAILED)
+        return false;
+    if (single_mmap)
+        cq_ptr_ = sq_ptr_;
+    else {
+        cq_ptr_ = mmap(NULL, cq_len_, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+        if (cq_ptr_ == MAP_FAILED)
+            return false;
+    }
+    sqes_len_ = params_.sq_entries * sizeof(io_uring_sqe);
+    void* p = mmap(NULL, sqes_len_, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (p == MAP_FAILED)
+        return false;
+    sqes_ = (io_uring_sqe*) p;
+    char* sq = (char*) sq_ptr_;
+    sq_head_ = (unsigned*) (sq + params_.sq_off.head);
+    sq_tail_ = (unsigned*) (sq + params_.sq_off.tail);
+    sq_mask_ = (unsigned*) (sq + params_.sq_off.ring_mask);
+    sq_array_ = (unsigned*) (sq + params_.sq_off.array);
+    char* cq = (char*) cq_ptr_;
+    cq_head_ = (unsigned*) (cq + params_.cq_off.head);
+    cq_tail_ = (unsigned*) (cq + params_.cq_off.tail);
+    cq_mask_ = (unsigned*) (cq + params_.cq_off.ring_mask);
+    cqes_ = (io_uring_cqe*) (cq + params_.cq_off.cqes);
+    return true;
+}
+
+unsigned IoUring::sq_space() const
+{
+    unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    return params_.sq_entries - (*sq_tail_ + to_submit_ - head);
+}
+
+io_uring_sqe* IoUring::get_sqe()
+{
+    if (sq_space() == 0)
+        return NULL;
+    unsigned idx = (*sq_tail_ + to_submit_) & *sq_mask_;
+    io_uring_sqe* sqe = &sqes_[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array_[idx] = idx;
+    ++to_submit_;
+    return sqe;
+}
+
+bool IoUring::submit_and_wait()
+{
+    __atomic_store_n(sq_tail_, *sq_tail_ + to_submit_, __ATOMIC_RELEASE);
+    unsigned n = to_submit_;
+    to_submit_ = 0;
+    for (;;) {
+        long r = syscall(__NR_io_uring_enter, fd_, n, 1,
+                         IORING_ENTER_GETEVENTS, NULL, 0);
+        if (r >= 0)
+            return true;
+        if (errno != EINTR)
+            return false;
+        n = 0; // SQEs were consumed before the wait was interrupted
+    }
+}
+
+io_uring_cqe* IoUring::peek_cqe()
+{
+    unsigned head = *cq_head_;
+    if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE))
+        return NULL;
+    return &cqes_[head & *cq_mask_];
+}
+
+void IoUring::cqe_seen()
+{
+    __atomic_store_n(cq_head_, *cq_head_ + 1, __ATOMIC_RELEASE);
+}
+
+
+// state of a file being read
+struct PendingFile
+{
+    size_t idx;
+    int fd;
+    int open_res;
+    int statx_res;
+    int waiting;  // number of operations in flight
+    struct statx stx;
+    shared_ptr<OwnedBuffer> buf;
+    size_t size;
+    size_t done;
+};
+
+enum { op_open, op_statx, op_read, op_close };
+
+// user_data of SQE: slot number and operation
+inline __u64 make_user_data(size_t slot, int op) { return (slot << 2) | op; }
+
+// Returns false if io_uring can't be used. Files that were not passed
+// to the callback have delivered[i] == false.
+bool read_files_with_io_uring(vector<string> const& paths, size_t window,
+                              read_callback_type const& callback,
+                              vector<bool>& delivered)
+{
+    if (window == 0)
+        window = 1;
+    IoUring ring;
+    // A file has at most 2 SQEs in flight (open+statx or read).
+    // When it's finished, it needs an SQE for close and its slot is reused.
+    if (!ring.init((unsigned) (3 * window)))
+        return false;
+
+    // If io_uring_enter() fails, operations in flight may still write
+    // to the slots, so in such case the slots are leaked deliberately.
+    vector<PendingFile>& slots = *new vector<PendingFile>(window);
+    vector<size_t> free_slots;
+    for (size_t i = 0; i != window; ++i) {
+        slots[i].fd = -1;
+        free_slots.push_back(window - 1 - i);
+    }
+    size_t next = 0;
+    size_t in_flight = 0;  // files and close operations
+
+    while (next < paths.size() || in_flight > 0) {
+        // start reading new files, as many as the window allows
+        while (next < paths.size() && !free_slots.empty() &&
+               ring.sq_space() >= 2) {
+            size_t s = free_slots.back();
+            io_uring_sqe* open_sqe = ring.get_sqe();
+            io_uring_sqe* statx_sqe = ring.get_sqe();
+            free_slots.pop_back();
+            PendingFile& pf = slots[s];
+            pf.idx = next++;
+            pf.fd = -1;
+            pf.waiting = 2;
+            pf.buf.reset();
+            pf.size = pf.done = 0;
+            const char* path = paths[pf.idx].c_str();
+            open_sqe->opcode = IORING_OP_OPENAT;
+            open_sqe->fd = AT_FDCWD;
+            open_sqe->addr = (__u64) (uintptr_t) path;
+            open_sqe->open_flags = O_RDONLY | O_CLOEXEC;
+            open_sqe->user_data = make_user_data(s, op_open);
+            statx_sqe->opcode = IORING_OP_STATX;
+            statx_sqe->fd = AT_FDCWD;
+            statx_sqe->addr = (__u64) (uintptr_t) path;
+            statx_sqe->len = STATX_TYPE | STATX_SIZE;
+            statx_sqe->off = (__u64) (uintptr_t) &pf.stx;
+            statx_sqe->user_data = make_user_data(s, op_statx);
+            ++in_flight;
+        }
+
+        if (!ring.submit_and_wait()) {
+            // the kernel keeps its own references to files in use,
+            // so the descriptors can be closed
+            for (size_t i = 0; i != window; ++i)
+                if (slots[i].fd >= 0)
+                    ::close(slots[i].fd);
+            return false;
+        }
+
+        io_uring_cqe* cqe;
+        while ((cqe = ring.peek_cqe()) != NULL) {
+            size_t s = (size_t) (cqe->user_data >> 2);
+            int op = (int) (cqe->user_data & 3);
+            int res = cqe->res;
+            ring.cqe_seen();
+            if (op == op_close) {
+                --in_flight;
+                continue;
+            }
+            PendingFile& pf = slots[s];
+            if (op == op_open) {
+                pf.open_res = res;
+                if (res >= 0)
+                    pf.fd = res;
+            }
+            else if (op == op_statx)
+                pf.statx_res = res;
+            if (--pf.waiting > 0)
+                continue;
+
+            string const& path = paths[pf.idx];
+            string error;
+            bool finished = true;
+            if (op != op_read) { // both open and statx are done
+                if (pf.open_res == -EINVAL || pf.statx_res == -EINVAL) {
+                    // operation not supported by this kernel, read it later
+                } else if (pf.open_res < 0 || pf.statx_res < 0) {
+                    error = open_error(path);
+                } else if (S_ISDIR(pf.stx.stx_mode)) {
+                    error = directory_error(path);
+                } else if (!S_ISREG(pf.stx.stx_mode) ||
+                           pf.stx.stx_size == 0) {
+                    // pipes, devices, files in /proc, etc. - read it later
+                } else {
+                    pf.size = (size_t) pf.stx.stx_size;
+                    try {
+                        pf.buf.reset(new OwnedBuffer(pf.size));
+                        finished = false;
+                    } catch (bad_alloc&) {
+                        error = "Can't allocate memory for file: " + path;
+                    }
+                }
+            } else if (res < 0 && res != -EINTR && res != -EAGAIN) {
+                error = open_error(path);
+            } else {
+                if (res > 0)
+                    pf.done += res;
+                // stop on EOF; the file could be truncated in the meantime
+                finished = (res == 0 || pf.done == pf.size);
+            }
+
+            io_uring_sqe* sqe = NULL;
+            if (!finished && (sqe = ring.get_sqe()) != NULL) {
+                sqe->opcode = IORING_OP_READ;
+                sqe->fd = pf.fd;
+                sqe->addr = (__u64) (uintptr_t) (pf.buf->wdata() + pf.done);
+                sqe->len = (unsigned) (pf.size - pf.done);
+                sqe->off = pf.done;
+                sqe->user_data = make_user_data(s, op_read);
+                pf.waiting = 1;
+                continue;
+            }
+            if (!finished) // no room in the ring, read it later
+                pf.buf.reset();
+
+            if (pf.fd >= 0) {
+                sqe = ring.get_sqe();
+                if (sqe) {
+                    sqe->opcode = IORING_OP_CLOSE;
+                    sqe->fd = pf.fd;
+                    sqe->user_data = make_user_data(s, op_close);
+                    ++in_flight;
+                } else {
+                    ::close(pf.fd);
+                }
+                pf.fd = -1;
+            }
+            --in_flight;
+            file_buffer_ptr buf;
+            if (pf.buf && error.empty()) {
+                pf.buf->set_size(pf.done);
+                buf = pf.buf;
+            }
+            pf.buf.reset();
+            free_slots.push_back(s);
+            // empty buf and error mean that the file must be read by caller
+            if (!buf && error.empty())
+                buf = read_file(path, &error);
+            delivered[pf.idx] = true;
+            callback(pf.idx, buf, error);
+        }
+    }
+    delete &slots;
+    return true;
+}
+
+} // anonymous namespace
+#endif // HAVE_IO_URING
+
+
+void read_files(vector<string> const& paths, size_t window,
+                read_callback_type const& callback)
+{
+    vector<bool> delivered(paths.size(), false);
+#ifdef HAVE_IO_URING
+    if (read_files_with_io_uring(paths, window, callback, delivered))
+        return;
+#else
+    (void) window;
+#endif
+    // plain blocking reads
+    for (size_t i = 0; i != paths.size(); ++i) {
+        if (delivered[i])
+            continue;
+        string error;
+        file_buffer_ptr buf = read_file(paths[i], &error);
+        callback(i, buf, error);
+    }
+}
+
+} } // namespace xylib::util
@@ -0,0 +1,217 @@
+// private helpers for reading whole files into memory (namespace xylib::util)
+// Licence: Lesser GNU Public License 2.1 (LGPL)
+
+#ifndef XYLIB_FILEIO_H_
+#define XYLIB_FILEIO_H_
+
+#include <cstddef>
+#include <functional>
+#include <istream>
+#include <memory>  // for shared_ptr
+#include <string>
+#include <vector>
+
+#include "util.h"
+
+namespace xylib { namespace util {
+
+/// Read-only content of a whole file kept in memory.
+class FileBuffer
+{
+public:
+    FileBuffer() : data_(NULL), size_(0) {}
+    virtual ~FileBuffer() {}
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+protected:
+    const char* data_;
+    size_t size_;
+
+private:
+    FileBuffer(const FileBuffer&); // disallow
+    void operator=(const FileBuffer&); // disallow
+};
+
+typedef std::shared_ptr<const FileBuffer> file_buffer_ptr;
+
+/// FileBuffer that owns malloc'ed memory
+class OwnedBuffer : public FileBuffer
+{
+public:
+    explicit OwnedBuffer(size_t capacity);
+    ~OwnedBuffer();
+    char* wdata() { return buf_; }
+    size_t capacity() const { return capacity_; }
+    void set_size(size_t n) { size_ = n; }
+    void reserve(size_t n); // can be called only before buffer is shared
+
+private:
+    char* buf_;
+    size_t capacity_;
+};
+
+/// Input stream buffer reading from FileBuffer. It keeps a reference to
+/// the FileBuffer, so loaders can access the memory directly,
+/// see get_file_buffer().
+class buffer_istreambuf : public std::streambuf
+{
+public:
+    explicit buffer_istreambuf(file_buffer_ptr const& buf);
+    file_buffer_ptr const& buffer() const { return buf_; }
+
+protected:
+    virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                             std::ios_base::openmode which);
+    virtual pos_type seekpos(pos_type sp, std::ios_base::openmode which);
+
+private:
+    file_buffer_ptr buf_;
+};
+
+/// Returns FileBuffer that backs stream f, or empty pointer if the stream
+/// doesn't read from memory.
+file_buffer_ptr get_file_buffer(std::istream& f);
+
+/// If f reads from FileBuffer, sets *buf to this buffer and returns pointer
+/// to the data at the current position of f. Otherwise, resets *buf and
+/// returns NULL.
+const char* buffer_at_stream_pos(std::istream& f, file_buffer_ptr* buf);
+
+/// Reads the whole file. On error returns empty pointer and sets *error.
+/// If allow_mmap is true, large files are memory-mapped (if it's supported).
+/// Columns can keep the mapping after the file is loaded, and if the file
+/// is truncated in the meantime, accessing them raises SIGBUS. So mapping
+/// is used only for binary formats, which benefit from MappedColumn.
+file_buffer_ptr read_file(std::string const& path, std::string* error,
+                          bool allow_mmap=false);
+
+/// Called when reading a file is finished. idx is index in paths.
+/// If buf is empty and error is empty, the file should be read by the
+/// consumer (e.g. compressed files, or the platform is not supported).
+typedef std::function<void (size_t idx, file_buffer_ptr const& buf,
+                            std::string const& error)> read_callback_type;
+
+/// Reads many files, with at most `window` files being read at once.
+/// Uses io_uring on Linux (if available), blocking reads otherwise.
+/// The callback is called in the calling thread, in order of completion.
+void read_files(std::vector<std::string> const& paths, size_t window,
+                read_callback_type const& callback);
+
+/// Column that refers to little-endian numbers in FileBuffer.
+/// Values are decoded when accessed; the column keeps the buffer alive.
+class MappedColumn : public ColumnWithName
+{
+public:
+    /// count values of type dt start at ptr (in buf), the distance between
+    /// consecutive values is stride bytes (0 means packed values)
+    MappedColumn(file_buffer_ptr const& buf, const char* ptr, DataType dt,
+                 int count, int stride=0);
+
+    // implementation of the base interface
+    int get_point_count() const { return count_; }
+    double get_value(int n) const;
+    double get_min() const;
+    double get_max(int point_count=0) const;
+    int get_sort_order() const;
+    ColumnStats get_stats(int point_count=0) const;
+    DataType get_dtype() const { return dt_; }
+    const void* get_raw_data() const;
+    void get_values(int first, int count, double* out) const;
+
+private:
+    file_buffer_ptr buf_;
+    const char* ptr_;
+    DataType dt_;
+    int count_;
+    int stride_;
+    LazyValue<ColumnStats> stats_;
+
+    ColumnStats const& calculate_stats() const;
+};
+
+/// If f reads from FileBuffer, returns MappedColumn with count values of
+/// type dt that start at the current position and moves f after these
+/// values. Otherwise, returns NULL.
+Column* map_le_column(std::istream& f, DataType dt, int count);
+
+/// Returns column with count little-endian values of type T read from f.
+/// The values are not copied if f reads from FileBuffer.
+template<typename T>
+Column* read_le_column(std::istream& f, int count)
+{
+    Column *mapped = map_le_column(f, DTypeOf<T>::value, count);
+    if (mapped)
+        return mapped;
+    if (count < 0)
+        throw FormatError("negative number of values");
+    TypedVecColumn<T> *col = new TypedVecColumn<T>;
+    try {
+        col->add_values_from_le(f, count);
+    } catch (...) {
+        delete col;
+        throw;
+    }
+    return col;
+}
+
+/// The same as above, but only values with indices in [range.first,
+/// range.second) are stored in the column; f is moved after all count values.
+template<typename T>
+Column* read_le_column(std::istream& f, int count,
+                       std::pair<int, int> const& range)
+{
+    f.ignore((std::streamsize) range.first * sizeof(T));
+    Column *col = read_le_column<T>(f, range.second - range.first);
+    f.ignore((std::streamsize) (count - range.second) * sizeof(T));
+    return col;
+}
+
+/// Reads numbers written in lines of text, see
+/// VecColumn::add_values_from_lines(), and moves f after these lines.
+/// If f reads from FileBuffer, the numbers are parsed directly from memory.
+void read_value_lines(std::istream& f, VecColumn* col, int line_count=-1,
+                      char sep=0);
+
+/// Reads lines of text directly from FileBuffer or, if the stream doesn't
+/// read from FileBuffer, from the rest of the stream read into memory.
+/// Lines can end with \n, \r\n or \r. Returned lines are valid as long as
+/// the reader exists. The character after a line is not a part of number
+/// (it's EOL, NUL, blank or comment character), so numbers can be parsed
+/// with strtod() directly from the line. The stream is not moved.
+class LineReader
+{
+public:
+    explicit LineReader(std::istream& f);
+    /// reads lines from [begin, end), which is a part of text from other
+    /// LineReader (for example, a section found by a pre-scan)
+    LineReader(const char* begin, const char* end)
+        : copy_last_(true), p_(begin), end_(end) {}
+
+    /// position of the next line
+    const char* pos() const { return p_; }
+    const char* end() const { return end_; }
+
+    /// reads the next line (without EOL), returns false at EOF
+    bool next(StrView* line);
+
+    /// Like get_valid_line(): skips blank lines and comments, the returned
+    /// line is trimmed and the comment is removed from it.
+    bool next_valid(StrView* line, char comment_char);
+
+    /// parses numbers from the next lines (that end with \n or \r\n),
+    /// see VecColumn::add_values_from_lines()
+    void read_values(VecColumn* col, int line_count=-1, char sep=0);
+
+private:
+    file_buffer_ptr buf_;
+    std::string content_; // used if the stream has no FileBuffer
+    std::string last_; // copy of the last line, if it doesn't end with EOL
+    bool copy_last_; // false if the text is followed by NUL
+    const char* p_;
+    const char* end_;
+};
+
+} } // namespace xylib::util
+
+#endif // XYLIB_FILEIO_H_
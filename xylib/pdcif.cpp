@@ -4,31 +4,16 @@
 #define BUILDING_XYLIB
 #include "pdcif.h"
 
-#include <map>
-//#define BOOST_SPIRIT_DEBUG
-#include <boost/version.hpp>
-
-#if BOOST_VERSION >= 103800
-
-#include <boost/spirit/include/classic_core.hpp>
-#include <boost/spirit/include/classic_chset.hpp>
-#include <boost/spirit/include/classic_increment_actor.hpp>
-using namespace boost::spirit::classic;
-
-#else
-
-#include <boost/spirit/core.hpp>
-#include <boost/spirit/utility/chset.hpp>
-#include <boost/spirit/actor/increment_actor.hpp>
-using namespace boost::spirit;
-
-#endif
+#include <cctype>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <memory>  // for unique_ptr
 
 #include "util.h"
-
-#ifdef _MSC_VER
-#pragma warning (disable : 4355) // this used in base member initializer list
-#endif
+#include "fileio.h"
 
 using namespace std;
 using namespace xylib::util;
@@ -63,22 +48,18 @@ bool PdCifDataSet::check(istream &f, string*)
 namespace {
 
 // Based on: http://www.iucr.org/resources/cif/spec/version1.1/cifsyntax
-// "Appendix A: A formal grammar for CIF"
-// assuming that:
-// - in <DataItems> there should be <WhiteSpace> between <LoopHeader> and
-//   <LoopBody>
-// - the extra "|" in <TokenizedComments> (...<eol> |}...) should be ignored
+// The file is split into whitespace-separated tokens by hand-written
+// lexer that works directly on the file content in memory.
 //
 // This parser is not strict:
-//  - <Comments> may end with EOF (not only with EOL)
-//  - SkipLine rule was added to skip (some of) invalid lines
+//  - <Comments> may end with EOF (not only with EOL),
+//  - invalid lines (e.g. a tag without value) are skipped,
+//  - any non-blank character can be used in unquoted strings,
+//  - SemiColonTextField don't have to start after EOL.
 //
 // Limitations (that make parser simpler):
 // - UnquotedString can't start with semicolon,
-//   and SemiColonTextField don't have to start after EOL.
-// - SingleQuotedString and DoubleQuotedString cannot include
-//   corresponding quote symbols
-//
+// - save frames (used only in dictionary files) are not supported.
 
 // types of <Value>
 const int v_inapplicable = 0;
@@ -87,193 +68,6 @@ const int v_numeric = 2;
 const int v_numeric_with_err = 3;
 const int v_text = 4;
 
-template <typename Actions>
-struct CifGrammar : public grammar<CifGrammar<Actions> >
-{
-    CifGrammar(Actions& actions_)
-        : actions(actions_) {}
-
-    template <typename ScannerT>
-    struct definition
-    {
-        definition(CifGrammar const& self)
-        {
-            // CIF 'syntactic units' that have equivalent Spirit parsers:
-            //            CIF            |        Spirit
-            //      ---------------------+---------------------------
-            //     <Digit>               |        digit_p
-            //     <UnsignedInteger>     |        uint_p
-            //     <Integer>             |        int_p
-            //     <Float>               |        real_p
-            //     DATA_                 |        as_lower_d["data_"]
-            //
-            //     (LOOP_, GLOBAL_, SAVE_, STOP_ are similar to DATA_)
-
-            Actions& actions = self.actions;
-
-            chset<> OrdinaryChar("a-zA-Z0-9!%&()*+,./:<=>?@\\`^{|}~-");
-            chset<> NonBlankChar("\"#$'_;[]"
-                                 "a-zA-Z0-9!%&()*+,./:<=>?@\\`^{|}~-");
-            chset<> AnyPrintChar("\"#$'_;[] \t"
-                                 "a-zA-Z0-9!%&()*+,./:<=>?@\\`^{|}~-");
-            //<TextLeadChar> is AnyPrintChar - ";"
-
-            BOOST_SPIRIT_DEBUG_NODE(CIF);
-            BOOST_SPIRIT_DEBUG_NODE(DataBlock);
-            BOOST_SPIRIT_DEBUG_NODE(DataBlockHeading);
-            BOOST_SPIRIT_DEBUG_NODE(SaveFrame);
-            BOOST_SPIRIT_DEBUG_NODE(SaveFrameHeading);
-            BOOST_SPIRIT_DEBUG_NODE(DataItems);
-            BOOST_SPIRIT_DEBUG_NODE(LoopHeader);
-            BOOST_SPIRIT_DEBUG_NODE(LoopBody);
-            BOOST_SPIRIT_DEBUG_NODE(Tag);
-            BOOST_SPIRIT_DEBUG_NODE(Value);
-            BOOST_SPIRIT_DEBUG_NODE(CharString);
-            BOOST_SPIRIT_DEBUG_NODE(TextField);
-            BOOST_SPIRIT_DEBUG_NODE(WhiteSpace);
-            BOOST_SPIRIT_DEBUG_NODE(Comments);
-            BOOST_SPIRIT_DEBUG_NODE(TokenizedComments);
-            BOOST_SPIRIT_DEBUG_NODE(SkipLine);
-            BOOST_SPIRIT_DEBUG_NODE(PeekNoReservedWord);
-
-            CIF
-                = !Comments >> !WhiteSpace
-                  >> !( DataBlock >> *(WhiteSpace >> DataBlock) >> !WhiteSpace
-                      )
-                ;
-
-            DataBlock
-                = DataBlockHeading
-                  >> *( WhiteSpace >> (DataItems
-                                   // | SaveFrame
-                                      )
-                      )
-                  >> eps_p [actions.on_block_finish]
-                ;
-
-            DataBlockHeading
-                = as_lower_d["data_"]
-                  >> (+NonBlankChar) [actions.on_block_start]
-                ;
-
-            // Save frames may only be used in dictionary files,
-            // so we don't care about it
-
-            //SaveFrame
-            //    = SaveFrameHeading
-            //      >> +( WhiteSpace >> DataItems )
-            //      >> WhiteSpace >> as_lower_d["save_"]
-            //    ;
-
-            //SaveFrameHeading
-            //    = as_lower_d["save_"] >> +NonBlankChar
-            //    ;
-
-            DataItems
-                = (Tag >> WhiteSpace >> Value) [actions.on_tag_value_finish]
-                | (LoopHeader >> LoopBody) [actions.on_loop_finish]
-                | SkipLine // ignore invalid lines
-                ;
-
-            // There is a lot of invalid CIF files in the world. It's not
-            // very suprising - if the spec contains so many errors
-            // who would bother to implement it properly. It's not clear
-            // to me if there is a kind of informal spec all CIF tools
-            // conform to.
-            // The most common bug is a missing or non-standard value in
-            // tag-value pair.
-            SkipLine
-                = PeekNoReservedWord >> +AnyPrintChar
-                                   [increment_a(actions.invalid_line_counter)]
-                ;
-
-
-            LoopHeader
-                = as_lower_d["loop_"]
-                  >> + ( WhiteSpace >> Tag ) [actions.on_loop_tag]
-                ;
-
-            LoopBody
-                //= + ( WhiteSpace >> Value ) [actions.on_loop_value]
-                // we allow loop without values - to parse invalid files
-                = * ( WhiteSpace >> Value ) [actions.on_loop_value]
-                ;
-
-            Tag
-                = '_' >> (+NonBlankChar) [assign_a(actions.last_tag)]
-                ;
-
-            // The special values of '.' and '?' represent data that are
-            // inapplicable or unknown, respectively.
-            Value
-                = (real_p  [assign_a(actions.value_real)]
-                   >> ( ( '(' >> uint_p  >> ch_p(')')
-                           [assign_a(actions.last_value, v_numeric_with_err)]
-                        )
-                      | eps_p [assign_a(actions.last_value, v_numeric)]
-                      )
-                  ) [assign_a(actions.value_string)]
-                  >> eps_p(space_p)
-                | ch_p('.')  [assign_a(actions.last_value, v_unknown)]
-                | ch_p('?')  [assign_a(actions.last_value, v_inapplicable)]
-                | CharString [assign_a(actions.last_value, v_text)]
-                | TextField  [assign_a(actions.last_value, v_text)]
-                ;
-
-            PeekNoReservedWord
-                = ~eps_p(as_lower_d[str_p("data_") | "loop_" | "global_"
-                                   | "save_" | "stop_"])
-                ;
-
-
-            CharString
-                  // UnquotedString (we don't check for preceding ';')
-                = PeekNoReservedWord
-                  >> (OrdinaryChar >> *NonBlankChar)
-                                              [assign_a(actions.value_string)]
-                  // SingleQuotedString
-                | ch_p('\'')
-                  >> ( *chset<>(AnyPrintChar - '\'') )
-                                              [assign_a(actions.value_string)]
-                  >> '\'' >> eps_p(space_p)
-                  // DoubleQuotedString
-                | ch_p('"')
-                  >> ( *chset<>(AnyPrintChar - '"') )
-                                              [assign_a(actions.value_string)]
-                  >> ch_p('"') >> eps_p(space_p)
-                ;
-
-            TextField
-                = ch_p(';')
-                  >> ( *AnyPrintChar>> +eol_p
-                       >>   *( chset<>(AnyPrintChar - ';') >> *AnyPrintChar
-                               >> +eol_p)
-                     ) [assign_a(actions.value_string)]
-                  >> ';';
-                ;
-
-            WhiteSpace
-                = +(+space_p >> !Comments)
-                ;
-            Comments
-                = + ('#' >> *AnyPrintChar >> (eol_p | end_p))
-                ;
-        }
-
-        rule<ScannerT> CIF, DataBlock, DataBlockHeading, SaveFrame,
-                       SaveFrameHeading, DataItems, LoopHeader, LoopBody,
-                       Tag, Value,
-                       CharString, TextField,
-                       WhiteSpace, TokenizedComments, Comments,
-                       PeekNoReservedWord, SkipLine;
-
-        rule<ScannerT> const& start() const { return CIF; }
-    };
-
-    Actions& actions;
-};
-
-
 bool is_pd_data_tag(string const& s)
 {
     // interesting data - data names without _pd_ prefix
@@ -316,230 +110,457 @@ bool is_pd_data_tag(string const& s)
     return false;
 }
 
-struct DatasetActions;
-
-#define DECLARE_DATASET_ACTION(name) \
-struct name { \
-    DatasetActions &da; \
-    name(DatasetActions &da_) : da(da_) {} \
-    template <typename IteratorT> \
-    void operator()(IteratorT, IteratorT b) const; \
+// length of number at the beginning of [p, end) in the form
+// [+-]digits[.digits][(e|E)[+-]digits], 0 if there is no number
+size_t real_length(const char* p, const char* end)
+{
+    const char* s = p;
+    if (s != end && (*s == '+' || *s == '-'))
+        ++s;
+    const char* digits = s;
+    while (s != end && isdigit((unsigned char) *s))
+        ++s;
+    bool has_digits = (s != digits);
+    if (s != end && *s == '.') {
+        ++s;
+        const char* frac = s;
+        while (s != end && isdigit((unsigned char) *s))
+            ++s;
+        has_digits = has_digits || s != frac;
+    }
+    if (!has_digits)
+        return 0;
+    if (s != end && (*s == 'e' || *s == 'E')) {
+        const char* e = s + 1;
+        if (e != end && (*e == '+' || *e == '-'))
+            ++e;
+        const char* exp_digits = e;
+        while (e != end && isdigit((unsigned char) *e))
+            ++e;
+        if (e != exp_digits)
+            s = e;
+    }
+    return s - p;
 }
 
-DECLARE_DATASET_ACTION(t_on_block_start);
-DECLARE_DATASET_ACTION(t_on_block_finish);
-DECLARE_DATASET_ACTION(t_on_tag_value_finish);
-DECLARE_DATASET_ACTION(t_on_loop_tag);
-DECLARE_DATASET_ACTION(t_on_loop_value);
-DECLARE_DATASET_ACTION(t_on_loop_finish);
+bool starts_with_nocase(const char* p, const char* end, const char* word)
+{
+    for (; *word != '\0'; ++p, ++word)
+        if (p == end || tolower((unsigned char) *p) != *word)
+            return false;
+    return true;
+}
 
-struct LoopValue
+// Splits CIF into tokens. The file content must stay in memory.
+class CifLexer
 {
-    int kind;
-    double val;
-    double err;
-    LoopValue(int kind_) : kind(kind_) {}
-    LoopValue(int kind_, double val_) : kind(kind_), val(val_) {}
-    LoopValue(int kind_, string const& s);
+public:
+    enum Token { T_EOF, T_DATA, T_LOOP, T_RESERVED, T_TAG, T_VALUE };
+
+    CifLexer(const char* begin, const char* end)
+        : begin_(begin), p_(begin), end_(end), tok_(begin) {}
+
+    // reads the next token
+    Token next();
+
+    // text of the token: name of data block, tag without '_' or value
+    // (without quotes)
+    string text() const { return string(text_begin_, text_end_); }
+    const char* text_begin() const { return text_begin_; }
+    const char* text_end() const { return text_end_; }
+
+    // for T_VALUE: kind of value (v_*) and numeric value with error
+    int kind() const { return kind_; }
+    double value() const { return value_; }
+    double err() const { return err_; }
+
+    // position of the token in the file
+    long position() const { return (long) (tok_ - begin_); }
+
+    // moves to the end of line where the last token started
+    void skip_line()
+    {
+        p_ = tok_;
+        while (p_ != end_ && *p_ != '\n' && *p_ != '\r')
+            ++p_;
+    }
+
+private:
+    const char* begin_;
+    const char* p_;
+    const char* end_;
+    const char* tok_;
+    const char* text_begin_;
+    const char* text_end_;
+    int kind_;
+    double value_;
+    double err_;
+
+    void skip_whitespace();
+    void read_quoted();
+    void read_text_field();
+    void classify_unquoted();
 };
 
-// parsing format 143.910(26)
-LoopValue::LoopValue(int kind_, string const& s)
-    : kind(kind_)
+void CifLexer::skip_whitespace()
 {
-    assert (kind == v_numeric_with_err);
-    string::size_type lb_pos = s.find('(');
-    string val_s = s.substr(0, lb_pos);
-    string err_s = s.substr(lb_pos + 1, s.size() - lb_pos - 2);
-    val = my_strtod(val_s);
-    int ierr = my_strtol(err_s);
-    string::size_type dot_pos = val_s.find('.');
-    if (dot_pos == string::npos) {
-        err = ierr;
-    } else {
-        int frac_len = (int) (val_s.size() - dot_pos - 1);
-        err = ierr * pow(10., -frac_len);
+    for (;;) {
+        while (p_ != end_ && isspace((unsigned char) *p_))
+            ++p_;
+        if (p_ == end_ || *p_ != '#')
+            break;
+        while (p_ != end_ && *p_ != '\n' && *p_ != '\r')
+            ++p_;
     }
 }
 
-struct DatasetActions
+// quoted string ends with the quote followed by whitespace,
+// if it's not closed in the same line, the rest of the line is taken
+void CifLexer::read_quoted()
 {
-    string last_tag;
-    int last_value;
-    double value_real;
-    string value_string;
-    vector<string> loop_tags;
-    vector<LoopValue> loop_values;
-    int invalid_line_counter;
-
-    t_on_block_start on_block_start;
-    t_on_block_finish on_block_finish;
-    t_on_tag_value_finish on_tag_value_finish;
-    t_on_loop_tag on_loop_tag;
-    t_on_loop_value on_loop_value;
-    t_on_loop_finish on_loop_finish;
+    char quote = *p_;
+    text_begin_ = ++p_;
+    while (p_ != end_ && *p_ != '\n' && *p_ != '\r') {
+        if (*p_ == quote && (p_ + 1 == end_ || isspace((unsigned char) p_[1])))
+            break;
+        ++p_;
+    }
+    text_end_ = p_;
+    if (p_ != end_ && *p_ == quote)
+        ++p_;
+}
 
-    Block *block;
-    vector<Block*> block_list;
+// text field ends with semicolon at the beginning of line
+void CifLexer::read_text_field()
+{
+    text_begin_ = ++p_;
+    for (;;) {
+        while (p_ != end_ && *p_ != '\n' && *p_ != '\r')
+            ++p_;
+        while (p_ != end_ && (*p_ == '\n' || *p_ == '\r'))
+            ++p_;
+        if (p_ == end_)
+            throw FormatError("Unterminated text field at character "
+                              + S(position()));
+        if (*p_ == ';')
+            break;
+    }
+    text_end_ = p_;
+    ++p_;
+}
 
-    DatasetActions()
-        : invalid_line_counter(0),
-          on_block_start(*this),
-          on_block_finish(*this),
-          on_tag_value_finish(*this),
-          on_loop_tag(*this),
-          on_loop_value(*this),
-          on_loop_finish(*this),
-          block(NULL) {}
-};
+// sets kind_ (and value_, err_) of unquoted value
+void CifLexer::classify_unquoted()
+{
+    const char* b = text_begin_;
+    const char* e = text_end_;
+    size_t len = e - b;
+    size_t n = real_length(b, e);
+    kind_ = v_text;
+    if (n == len) {
+        kind_ = v_numeric;
+        value_ = my_strtod(b, n);
+    } else if (n != 0 && b[n] == '(' && e[-1] == ')' && len > n + 2) {
+        // format 143.910(26)
+        const char* d = b + n + 1;
+        while (d != e - 1 && isdigit((unsigned char) *d))
+            ++d;
+        if (d != e - 1)
+            return;
+        kind_ = v_numeric_with_err;
+        value_ = my_strtod(b, n);
+        int ierr = my_strtol(string(b + n + 1, e - 1));
+        const char* dot = (const char*) memchr(b, '.', n);
+        if (dot == NULL) {
+            err_ = ierr;
+        } else {
+            int frac_len = (int) (b + n - dot - 1);
+            err_ = ierr * pow(10., -frac_len);
+        }
+    } else if (len == 1 && *b == '.') {
+        kind_ = v_unknown;
+    } else if (len == 1 && *b == '?') {
+        kind_ = v_inapplicable;
+    }
+}
 
-template <typename IteratorT>
-void t_on_block_start::operator()(IteratorT a, IteratorT b) const
+CifLexer::Token CifLexer::next()
 {
-    assert(da.block == NULL);
-    da.block = new Block;
-    da.block->set_name(string(a, b));
+    skip_whitespace();
+    tok_ = p_;
+    if (p_ == end_)
+        return T_EOF;
+    if (*p_ == '\'' || *p_ == '"') {
+        read_quoted();
+        kind_ = v_text;
+        return T_VALUE;
+    }
+    if (*p_ == ';') {
+        read_text_field();
+        kind_ = v_text;
+        return T_VALUE;
+    }
+    while (p_ != end_ && !isspace((unsigned char) *p_))
+        ++p_;
+    text_begin_ = tok_;
+    text_end_ = p_;
+    if (*tok_ == '_' && p_ - tok_ > 1) {
+        ++text_begin_;
+        return T_TAG;
+    }
+    if (starts_with_nocase(tok_, p_, "data_")) {
+        text_begin_ += 5;
+        return T_DATA;
+    }
+    if (starts_with_nocase(tok_, p_, "loop_"))
+        return p_ - tok_ == 5 ? T_LOOP : T_RESERVED;
+    if (starts_with_nocase(tok_, p_, "global_") ||
+            starts_with_nocase(tok_, p_, "save_") ||
+            starts_with_nocase(tok_, p_, "stop_"))
+        return T_RESERVED;
+    classify_unquoted();
+    return T_VALUE;
 }
 
-template <typename IteratorT>
-void t_on_block_finish::operator()(IteratorT, IteratorT) const
+// column of loop_ with one of interesting tags (see is_pd_data_tag());
+// values are stored directly in VecColumns, as they are read
+struct LoopColumn
 {
-    assert(da.block != NULL);
-    MetaData const& meta = da.block->meta;
+    string tag;
+    int kind; // v_unknown until the first known value is read
+    int mixed_row; // first row with value of other kind, or -1
+    std::unique_ptr<VecColumn> val; // NULL if kind is v_text
+    std::unique_ptr<VecColumn> err; // created when v_numeric_with_err is read
 
-    static const char* step_tags[] = { "pd_meas_2theta_range_",
-                                       "pd_proc_2theta_range_" };
-    for (size_t i = 0; i < sizeof(step_tags) / sizeof(step_tags[0]); ++i) {
-        string t = step_tags[i];
-        if (meta.has_key(t + "min") && meta.has_key(t + "max")
-                && meta.has_key(t + "inc")) {
-            double start = my_strtod(meta.get(t + "min"));
-            double step = my_strtod(meta.get(t + "inc"));
-            double end = my_strtod(meta.get(t + "max"));
-            int count = int ((end - start) / step + 0.5) + 1;
-            StepColumn* c = new StepColumn(start, step, count);
-            c->set_name(t.substr(3, 11));
-            da.block->add_column(c, false);
+    explicit LoopColumn(string const& tag_)
+        : tag(tag_), kind(v_unknown), mixed_row(-1), val(new VecColumn) {}
+
+    // returns false if the value has a different kind than previous ones
+    bool add(CifLexer const& lex, int row)
+    {
+        if (mixed_row != -1) // this and next rows won't be used anyway
+            return true;
+        int k = lex.kind();
+        bool known = (k != v_unknown && k != v_inapplicable);
+        if (known && kind == v_unknown) {
+            kind = k;
+            if (kind == v_text)
+                val.reset();
+        }
+        if (known && k != kind) {
+            mixed_row = row;
+            return false;
+        }
+        if (!val)
+            return true;
+        if (k == v_numeric_with_err && !err) {
+            err.reset(new VecColumn);
+            for (int i = 0; i < row; ++i)
+                err->add_val(0.);
         }
+        val->add_val(known ? lex.value() : 0.);
+        if (err)
+            err->add_val(k == v_numeric_with_err ? lex.err() : 0.);
+        return true;
     }
-    if (da.block->get_column_count() > 0)
-        da.block_list.push_back(da.block);
-    else
-        delete da.block;
-    da.block = NULL;
+
+    // moves columns with the first nrow values to the block
+    void move_to(Block* block, int nrow)
+    {
+        string col_title = tag.substr(3); // skip "pd_"
+        if (kind == v_numeric || kind == v_numeric_with_err) {
+            val->truncate(nrow);
+            val->shrink_to_fit();
+            val->set_name(col_title);
+            block->add_column(val.release());
+        }
+        if (kind == v_numeric_with_err) {
+            err->truncate(nrow);
+            err->shrink_to_fit();
+            err->set_name(col_title + "_err");
+            block->add_column(err.release());
+        }
+    }
+};
+
+class CifReader
+{
+public:
+    vector<Block*> block_list;
+    int invalid_line_counter;
+
+    explicit CifReader(DataSet const* ds) : invalid_line_counter(0), ds_(ds) {}
+    ~CifReader() { purge_all_elements(block_list); }
+    void read(const char* begin, const char* end);
+
+private:
+    DataSet const* ds_;
+    std::unique_ptr<Block> block_;
+
+    void finish_block();
+    CifLexer::Token read_loop(CifLexer& lex);
+    void check_mixed(vector<LoopColumn*> const& cols, int nrow);
+    void set_meta(string const& tag, CifLexer const& lex);
+};
+
+void CifReader::read(const char* begin, const char* end)
+{
+    CifLexer lex(begin, end);
+    CifLexer::Token t = lex.next();
+    while (t != CifLexer::T_EOF) {
+        if (t == CifLexer::T_DATA) {
+            finish_block();
+            block_.reset(new Block);
+            block_->set_name(lex.text());
+            t = lex.next();
+        } else if (!block_ || t == CifLexer::T_RESERVED) {
+            format_assert(ds_, false,
+                          "Parse error at character " + S(lex.position()));
+        } else if (t == CifLexer::T_TAG) {
+            string tag = lex.text();
+            t = lex.next();
+            if (t == CifLexer::T_VALUE) {
+                set_meta(tag, lex);
+                t = lex.next();
+            } else {
+                ++invalid_line_counter; // tag without value is ignored
+            }
+        } else if (t == CifLexer::T_LOOP) {
+            t = read_loop(lex);
+        } else { // T_VALUE that doesn't belong to any tag
+            ++invalid_line_counter;
+            lex.skip_line();
+            t = lex.next();
+        }
+    }
+    finish_block();
 }
 
-template <typename IteratorT>
-void t_on_tag_value_finish::operator()(IteratorT, IteratorT) const
+void CifReader::set_meta(string const& tag, CifLexer const& lex)
 {
     string s;
-    if (da.last_value == v_numeric)
-        s = S(da.value_real);
-    else if (da.last_value == v_numeric_with_err)
-        s = da.value_string;
-    else if (da.last_value == v_text)
-        s = str_trim(da.value_string);
+    if (lex.kind() == v_numeric)
+        s = S(lex.value());
+    else if (lex.kind() == v_numeric_with_err)
+        s = lex.text();
+    else if (lex.kind() == v_text)
+        s = str_trim(lex.text());
     else
         // if it is inapplicable and unknown value, we do nothing
         return;
-    da.block->meta[da.last_tag] = s;
+    block_->meta[tag] = s;
 }
 
-template <typename IteratorT>
-void t_on_loop_tag::operator()(IteratorT, IteratorT) const
+// reads tags and values of loop_, returns the token that follows the loop;
+// only columns with interesting tags are kept, other values are skipped
+CifLexer::Token CifReader::read_loop(CifLexer& lex)
 {
-    da.loop_tags.push_back(da.last_tag);
+    vector<LoopColumn*> cols; // NULL for columns that are not stored
+    CifLexer::Token t;
+    try {
+        while ((t = lex.next()) == CifLexer::T_TAG) {
+            string tag = lex.text();
+            cols.push_back(is_pd_data_tag(tag) ? new LoopColumn(tag) : NULL);
+        }
+        if (cols.empty())
+            format_assert(ds_, false,
+                          "Parse error at character " + S(lex.position()));
+        int ncol = (int) cols.size();
+        int mixed_row = INT_MAX; // the first row with mixed value types
+        int n = 0; // number of values
+        for (; t == CifLexer::T_VALUE; t = lex.next(), ++n) {
+            int row = n / ncol;
+            LoopColumn *col = cols[n - row * ncol];
+            // mixed values are not accepted in complete rows
+            if (row > mixed_row)
+                check_mixed(cols, row);
+            if (col != NULL && !col->add(lex, row))
+                mixed_row = min(mixed_row, row);
+        }
+        int nrow = n / ncol;
+        check_mixed(cols, nrow);
+        for (int i = 0; nrow != 0 && i < ncol; ++i)
+            if (cols[i] != NULL)
+                cols[i]->move_to(block_.get(), nrow);
+    } catch (...) {
+        purge_all_elements(cols);
+        throw;
+    }
+    purge_all_elements(cols);
+    return t;
 }
 
-template <typename IteratorT>
-void t_on_loop_value::operator()(IteratorT, IteratorT) const
+// throws exception if one of the first nrow rows has mixed value types
+void CifReader::check_mixed(vector<LoopColumn*> const& cols, int nrow)
 {
-    if (da.last_value == v_numeric)
-        da.loop_values.push_back(LoopValue(da.last_value, da.value_real));
-    else if (da.last_value == v_numeric_with_err)
-        da.loop_values.push_back(LoopValue(da.last_value, da.value_string));
-    else
-        da.loop_values.push_back(LoopValue(da.last_value));
+    for (size_t i = 0; i < cols.size(); ++i)
+        if (cols[i] != NULL && cols[i]->mixed_row != -1
+                && cols[i]->mixed_row < nrow)
+            throw FormatError("Mixed value types in loop for " + cols[i]->tag
+                              + " in block " + block_->get_name());
 }
 
-template <typename IteratorT>
-void t_on_loop_finish::operator()(IteratorT, IteratorT) const
+void CifReader::finish_block()
 {
-    int ncol = (int) da.loop_tags.size();
-    if (ncol == 0)
+    if (!block_)
         return;
-    int nrow = (int) da.loop_values.size() / ncol;
-    if (nrow == 0)
-        return;
-    for (int i = 0; i < ncol; ++i) {
-        string const& name = da.loop_tags[i];
-        if (!is_pd_data_tag(name))
-            continue;
-
-        // find what kind of column it is
-        int col_kind = v_unknown;
-        for (int j = 0; j != nrow; ++j) {
-            LoopValue const& lv = da.loop_values[j * ncol + i];
-            if (lv.kind == v_unknown || lv.kind == v_inapplicable)
-                continue;
-            if (col_kind == v_unknown)
-                col_kind = lv.kind;
-            else if (col_kind != lv.kind)
-                throw FormatError("Mixed value types in loop for " + name
-                                  + " in block " + da.block->get_name());
-        }
+    MetaData const& meta = block_->meta;
 
-        string col_title = name.substr(3); // skip "pd_"
-        if (col_kind == v_numeric || col_kind == v_numeric_with_err) {
-            VecColumn* c = new VecColumn();
-            for (int j = 0; j != nrow; ++j) {
-                LoopValue const& lv = da.loop_values[j * ncol + i];
-                c->add_val(lv.kind == col_kind ? lv.val : 0.);
-            }
-            c->set_name(col_title);
-            da.block->add_column(c);
-        }
-
-        if (col_kind == v_numeric_with_err) {
-            VecColumn* c = new VecColumn();
-            for (int j = 0; j != nrow; ++j) {
-                LoopValue const& lv = da.loop_values[j * ncol + i];
-                c->add_val(lv.kind == col_kind ? lv.err : 0.);
-            }
-            c->set_name(col_title + "_err");
-            da.block->add_column(c);
+    static const char* step_tags[] = { "pd_meas_2theta_range_",
+                                       "pd_proc_2theta_range_" };
+    for (size_t i = 0; i < sizeof(step_tags) / sizeof(step_tags[0]); ++i) {
+        string t = step_tags[i];
+        if (meta.has_key(t + "min") && meta.has_key(t + "max")
+                && meta.has_key(t + "inc")) {
+            double start = my_strtod(meta.get(t + "min"));
+            double step = my_strtod(meta.get(t + "inc"));
+            double end = my_strtod(meta.get(t + "max"));
+            int count = int ((end - start) / step + 0.5) + 1;
+            StepColumn* c = new StepColumn(start, step, count);
+            c->set_name(t.substr(3, 11));
+            block_->add_column(c, false);
         }
     }
-    da.loop_values.clear();
-    da.loop_tags.clear();
+    if (block_->get_column_count() > 0)
+        block_list.push_back(block_.release());
+    else
+        block_.reset();
 }
 
 } // anonymous namespace
 
+// The file is tokenized in memory, values in loops are parsed directly
+// into columns.
 void PdCifDataSet::load_data(std::istream &f, const char*)
 {
-    // read file into vector<char>
-    f.unsetf(ios::skipws);
-    vector<char> vec;
-    std::copy(istream_iterator<char>(f), istream_iterator<char>(),
-              std::back_inserter(vec));
-    format_assert(this, vec.size() > 5);
+    const char *begin, *end;
+    string content; // used if the file is not in memory already
+    file_buffer_ptr buf;
+    begin = buffer_at_stream_pos(f, &buf);
+    if (begin != NULL) {
+        end = buf->data() + buf->size();
+    } else {
+        content.assign(istreambuf_iterator<char>(f),
+                       istreambuf_iterator<char>());
+        begin = content.data();
+        end = begin + content.size();
+    }
+    format_assert(this, end - begin > 5);
     // some CIF files have 0x1A character at the end, let's ignore it
-    while (vec.back() == 0x1A)
-        vec.pop_back();
-    DatasetActions actions;
-    CifGrammar<DatasetActions> p(actions);
-    parse_info<vector<char>::const_iterator> info =
-        parse(vec.begin(), vec.end(), p);
-    int stop = info.stop - vec.begin();
-    format_assert(this, info.full, "Parse error at character " + S(stop));
-    int n = (int) actions.block_list.size();
+    while (end != begin && end[-1] == 0x1A)
+        --end;
+    CifReader reader(this);
+    reader.read(begin, end);
+    int n = (int) reader.block_list.size();
     if (n == 0)
         throw RunTimeError("pdCIF file was read, "
-                           + S(actions.invalid_line_counter) + " invalid lines,"
+                           + S(reader.invalid_line_counter) + " invalid lines,"
                            " no data found");
     for (int i = 0; i < n; ++i) {
-        vector<Block*> sb = split_on_column_length(actions.block_list[i]);
+        Block *block = reader.block_list[i];
+        reader.block_list[i] = NULL;
+        vector<Block*> sb = split_on_column_length(block);
+        delete block;
         for (vector<Block*>::iterator j = sb.begin(); j != sb.end(); ++j)
             add_block(*j);
     }
@@ -6,6 +6,8 @@
 //
 // This file doesn't implement full CIF grammar. The parser may fail to read
 // some valid files and read invalid ones.
+// The file is tokenized in memory and numeric values from loops are parsed
+// directly into columns, only loops with powder data (_pd_*) are stored.
 //
 // There may be more than one data-blocks in one block (defined by the format
 // specification), and the point counts of these data-blocks are different.
@@ -23,7 +23,7 @@ const FormatInfo PhilipsRawDataSet::fmt_info(
 
 bool PhilipsRawDataSet::check(istream &f, string*)
 {
-    string head = read_string(f, 4);
+    string head = read_string_nothrow(f, 4);
     return head == "V3RD" || head == "V5RD";
 }
 
@@ -76,14 +76,18 @@ void PhilipsRawDataSet::load_data(std::istream &f, const char*)
         f.ignore(810 - 214 - 8*3);
     }
 
-    VecColumn *ycol = new VecColumn;
-    for (unsigned i = 0; i < pt_cnt; ++i) {
+    TypedVecColumn<uint32_t> *ycol = new TypedVecColumn<uint32_t>;
+    blk->add_column(ycol);
+    const unsigned chunk = 4096;
+    uint16_t packed[chunk];
+    for (unsigned i = 0; i < pt_cnt; i += chunk) {
+        unsigned n = min(chunk, pt_cnt - i);
+        read_array<uint16_t>(f, n, packed);
+        uint32_t *y = ycol->extend(n);
         // intensities are packed into 2-byte integers in this interesting way
-        int packed_y = read_uint16_le(f);
-        double y = floor(0.01 * packed_y * packed_y);
-        ycol->add_val(y);
+        for (unsigned j = 0; j < n; ++j)
+            y[j] = (uint32_t) floor(0.01 * packed[j] * packed[j]);
     }
-    blk->add_column(ycol);
 
     add_block(blk);
 }
@@ -3,8 +3,9 @@
 
 #define BUILDING_XYLIB
 #include "philips_udf.h"
-#include <sstream>
+#include <cctype>
 #include "util.h"
+#include "fileio.h"
 
 using namespace std;
 using namespace xylib::util;
@@ -24,7 +25,7 @@ const FormatInfo UdfDataSet::fmt_info(
 
 bool UdfDataSet::check (istream &f, string*)
 {
-    string head = read_string(f, 11);
+    string head = read_string_nothrow(f, 11);
     return head == "SampleIdent";
 }
 
@@ -51,29 +52,32 @@ void UdfDataSet::load_data(std::istream &f, const char*)
 
     double x_start = 0;
     double x_step = 0;
+    LineReader reader(f);
+    StrView line;
     // read header
     while (true) {
-        string line = str_trim(read_line(f));
+        if (!reader.next(&line))
+            throw FormatError("unexpected end of file");
+        line = str_trim(line);
         if (line == "RawScan") // indicates XY data start
             break;
 
-        string::size_type pos1 = line.find(',');
-        string::size_type pos2 = line.rfind(',');
+        size_t pos1 = line.find(',');
+        size_t pos2 = line.rfind(',');
         // there should be at least two ',' in a key-value line
         format_assert(this, pos1 != pos2);
-        string key = str_trim(line.substr(0, pos1));
-        string val = str_trim(line.substr(pos1 + 1, pos2 - pos1 - 1));
+        string key = str_trim(line.substr(0, pos1)).str();
+        StrView val = str_trim(line.substr(pos1 + 1, pos2 - pos1 - 1));
 
         if (key == "DataAngleRange") {
             // both start and end value are given, separated with ','
-            string::size_type pos = val.find_first_of(",");
-            x_start = my_strtod(val.substr(0, pos));
+            x_start = my_strtod(val.substr(0, val.find(',')).str());
         }
         else if (key == "ScanStepSize") {
-            x_step = my_strtod(val);
+            x_step = my_strtod(val.str());
         }
         else {
-            blk->meta[key] = val;
+            blk->meta[key] = val.str();
         }
     }
 
@@ -82,25 +86,16 @@ void UdfDataSet::load_data(std::istream &f, const char*)
     blk->add_column(xcol);
 
     VecColumn *ycol = new VecColumn;
-    string line;
-    while (getline(f, line)) {
-        bool has_slash = false;
-        for (string::iterator i = line.begin(); i != line.end(); ++i) {
-            if (*i == ',')
-                *i = ' ';
-            else if (*i == '/')
-                has_slash = true;
-            // format checking: only space and digit allowed
-            else if (!isdigit(*i) && !isspace(*i))
+    while (reader.next(&line)) {
+        size_t slash = line.find('/');
+        StrView values = line.substr(0, slash);
+        // format checking: only space, digit and ',' allowed
+        for (const char* i = values.begin(); i != values.end(); ++i)
+            if (!isdigit((unsigned char) *i) && !isspace((unsigned char) *i)
+                    && *i != ',')
                 throw FormatError("unexpected char when reading data");
-        }
-
-        istringstream ss(line);
-        double d;
-        while (ss >> d)
-            ycol->add_val(d);
-
-        if (has_slash)
+        ycol->add_values_from_str(values, ',');
+        if (slash != StrView::npos)
             break;
     }
     ycol->set_name("raw scan");
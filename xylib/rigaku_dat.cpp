@@ -3,7 +3,13 @@
 
 #define BUILDING_XYLIB
 #include "rigaku_dat.h"
+
+#include <exception>
+#include <utility>
+#include <vector>
+
 #include "util.h"
+#include "fileio.h"
 
 using namespace std;
 using namespace xylib::util;
@@ -24,7 +30,7 @@ const FormatInfo RigakuDataSet::fmt_info(
 // return true if is this type, false otherwise
 bool RigakuDataSet::check(istream &f, string*)
 {
-    string head = read_string(f, 5);
+    string head = read_string_nothrow(f, 5);
     return head == "*TYPE";
 }
 
@@ -63,64 +69,199 @@ and "*STEP" included).The data body of one group begins after "*COUNT=XXX").
 *EOF
 ///////////////////////////////////////////////////////////////////////////////
 */
-void RigakuDataSet::load_data(std::istream &f, const char*)
+namespace {
+
+// Parses lines of Rigaku .dat file. Blocks (*BEGIN ... *END) can be parsed
+// by separate parsers (in_section=true) if they set START, STEP and COUNT.
+class RigakuParser
 {
-    Block *blk = NULL;
-    VecColumn *ycol = NULL;
-    int grp_cnt = 0;
-    double start = 0., step = 0.;
-    int count = 0;
-    string line;
-
-    while (get_valid_line(f, line, '#')) {
+public:
+    RigakuParser(const DataSet* ds, bool in_section)
+        : ds_(ds), in_section_(in_section), blk_(NULL), ycol_(NULL),
+          grp_cnt_(0), start_(0.), step_(0.), count_(0),
+          has_grp_cnt_(false), has_start_(false), has_step_(false),
+          has_count_(false) {}
+
+    ~RigakuParser()
+    {
+        purge_all_elements(blocks_);
+        delete blk_;
+        delete ycol_;
+    }
+
+    // returns false if *EOF was reached
+    bool parse(LineReader& reader, MetaData* ds_meta);
+
+    // takes blocks and parameters from parser of the next section
+    void append(RigakuParser& section);
+
+    bool in_block() const { return blk_ != NULL; }
+    int group_count() const { return grp_cnt_; }
+    vector<Block*>& blocks() { return blocks_; }
+
+private:
+    const DataSet* ds_;
+    bool in_section_;
+    vector<Block*> blocks_;
+    Block *blk_;
+    VecColumn *ycol_;
+    int grp_cnt_;
+    double start_, step_;
+    int count_;
+    bool has_grp_cnt_, has_start_, has_step_, has_count_;
+};
+
+bool RigakuParser::parse(LineReader& reader, MetaData* ds_meta)
+{
+    StrView line;
+    while (reader.next_valid(&line, '#')) {
         if (line[0] == '*') {
             if (str_startwith(line, "*BEGIN")) {   // block starts
-                ycol = new VecColumn;
-                blk = new Block;
+                delete blk_;
+                delete ycol_;
+                ycol_ = new VecColumn;
+                blk_ = new Block;
             }
             else if (str_startwith(line, "*END")) { // block ends
-                format_assert(this, blk != NULL, "*END without *BEGIN");
-                format_assert(this, count == ycol->get_point_count(),
+                format_assert(ds_, blk_ != NULL, "*END without *BEGIN");
+                if (in_section_ && !(has_start_ && has_step_ && has_count_))
+                    throw IrregularSection();
+                format_assert(ds_, count_ == ycol_->get_point_count(),
                               "count of x and y differ");
-                StepColumn *xcol = new StepColumn(start, step, count);
-                blk->add_column(xcol);
-                blk->add_column(ycol);
-                add_block(blk);
-                blk = NULL;
-                ycol = NULL;
+                StepColumn *xcol = new StepColumn(start_, step_, count_);
+                blk_->add_column(xcol);
+                blk_->add_column(ycol_);
+                ycol_ = NULL;
+                blocks_.push_back(blk_);
+                blk_ = NULL;
             }
             else if (str_startwith(line, "*EOF")) { // file ends
-                break;
+                return false;
             }
             else { // meta key-value pair
-                string key, val;
+                StrView key_view, val_view;
                 // parse "*KEY = VALUE"
-                str_split(line.substr(1), '=', key, val);
-                if (key == "START")
-                    start = my_strtod(val);
-                else if (key == "STEP")
-                    step = my_strtod(val);
-                else if (key == "COUNT")
-                    count = my_strtol(val);
-                else if (key == "GROUP_COUNT")
-                    grp_cnt = my_strtol(val);
-
-                if (blk)
-                    blk->meta[key] = val;
+                str_split(line.substr(1), '=', &key_view, &val_view);
+                string key = key_view.str();
+                string val = val_view.str();
+                if (key == "START") {
+                    start_ = my_strtod(val);
+                    has_start_ = true;
+                } else if (key == "STEP") {
+                    step_ = my_strtod(val);
+                    has_step_ = true;
+                } else if (key == "COUNT") {
+                    count_ = my_strtol(val);
+                    has_count_ = true;
+                } else if (key == "GROUP_COUNT") {
+                    grp_cnt_ = my_strtol(val);
+                    has_grp_cnt_ = true;
+                }
+
+                if (blk_)
+                    blk_->meta[key] = val;
                 else
-                    meta[key] = val;
+                    (*ds_meta)[key] = val;
             }
         }
         else { // should be a line of values
-            format_assert(this, ycol != NULL, "values without *BEGIN");
-            format_assert(this, is_numeric(line[0]));
-            ycol->add_values_from_str(line, ',');
+            format_assert(ds_, ycol_ != NULL, "values without *BEGIN");
+            format_assert(ds_, is_numeric(line[0]));
+            ycol_->add_values_from_str(line, ',');
         }
     }
-    format_assert(this, ycol == NULL && blk == NULL, "*BEGIN without *END");
-    format_assert(this, grp_cnt != 0, "no GROUP_COUNT attribute given");
-    format_assert(this, grp_cnt == get_block_count(),
+    return true;
+}
+
+void RigakuParser::append(RigakuParser& section)
+{
+    blocks_.insert(blocks_.end(), section.blocks_.begin(),
+                   section.blocks_.end());
+    section.blocks_.clear();
+    // regular section sets all of these
+    start_ = section.start_;
+    step_ = section.step_;
+    count_ = section.count_;
+    if (section.has_grp_cnt_)
+        grp_cnt_ = section.grp_cnt_;
+}
+
+} // anonymous namespace
+
+void RigakuDataSet::load_data(std::istream &f, const char*)
+{
+    LineReader reader(f);
+    // find blocks (*BEGIN ... *END) before *EOF
+    // (small files are parsed sequentially, as if no blocks were found)
+    vector<pair<const char*, const char*> > sections;
+    LineReader scan(reader.pos(), reader.end());
+    StrView line;
+    const char* begin = NULL;
+    bool split = size_t(reader.end() - reader.pos()) >= min_parallel_parse_size;
+    while (split) {
+        const char* pos = scan.pos();
+        if (!scan.next_valid(&line, '#') || str_startwith(line, "*EOF"))
+            break;
+        if (str_startwith(line, "*BEGIN")) {
+            if (begin != NULL) // the rest of file is parsed sequentially
+                break;
+            begin = pos;
+        } else if (str_startwith(line, "*END") && begin != NULL) {
+            sections.push_back(make_pair(begin, scan.pos()));
+            begin = NULL;
+        }
+    }
+
+    // Blocks are parsed in parallel, then lines between them (that can set
+    // file-scope parameters) are parsed in order of the file.
+    size_t n = sections.size();
+    vector<RigakuParser*> parsers(n, (RigakuParser*) NULL);
+    RigakuParser parser(this, false);
+    bool parsed = false;
+    if (n != 0) {
+        try {
+            parallel_for_ordered(n, [&](size_t i) {
+                parsers[i] = new RigakuParser(this, true);
+                LineReader section(sections[i].first, sections[i].second);
+                parsers[i]->parse(section, NULL);
+            });
+            parsed = true;
+        } catch (...) {
+            // IrregularSection or an error. The file is parsed sequentially,
+            // so the first error in the file (if any) is reported, also if
+            // it's in lines between blocks.
+        }
+    }
+    try {
+        const char* pos = reader.pos();
+        bool finished = false;
+        for (size_t i = 0; parsed && i != n && !finished; ++i) {
+            LineReader gap(pos, sections[i].first);
+            if (parser.parse(gap, &meta)) {
+                parser.append(*parsers[i]);
+                pos = sections[i].second;
+            } else {
+                finished = true;
+            }
+        }
+        if (!finished) {
+            LineReader rest(pos, reader.end());
+            parser.parse(rest, &meta);
+        }
+    } catch (...) {
+        purge_all_elements(parsers);
+        throw;
+    }
+    purge_all_elements(parsers);
+
+    format_assert(this, !parser.in_block(), "*BEGIN without *END");
+    format_assert(this, parser.group_count() != 0,
+                  "no GROUP_COUNT attribute given");
+    format_assert(this, parser.group_count() == (int) parser.blocks().size(),
                   "block count different from expected");
+    for (size_t i = 0; i != parser.blocks().size(); ++i)
+        add_block(parser.blocks()[i]);
+    parser.blocks().clear();
 }
 
 } // namespace xylib
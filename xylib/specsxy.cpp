@@ -10,6 +10,7 @@
 #include <vector>
 
 #include "util.h"
+#include "fileio.h"
 
 using namespace std;
 using namespace xylib::util;
@@ -36,27 +37,27 @@ bool SpecsxyDataSet::check(istream &f, string*)
 }
 
 static
-Block* read_block(istream &f)
+Block* read_block(LineReader& reader)
 {
     Block* blk = new Block;
-    string line;
+    StrView line;
     // ColumnLabels are appropriate column lables, but the label "energy"
     // may stand for either KE or BE, we try to be more specific.
     string what_energy;
     // metadata
-    while (getline(f, line)) {
+    while (reader.next(&line)) {
         if (line.empty())
             continue;
         if (line[0] == '#') {
-            string::size_type colon = line.find(':');
-            if (colon == string::npos) {
+            size_t colon = line.find(':');
+            if (colon == StrView::npos) {
                 if (str_startwith(line, "# values in binding energy"))
                     what_energy = "binding ";
                 else if (str_startwith(line, "# values in kinetic energy"))
                     what_energy = "kinetic ";
             } else if (line[1] == ' ' && isupper(line[2])) { // ^# [A-Z].*:.*$
-                string key = str_trim(line.substr(1, colon-1));
-                string value = str_trim(line.substr(colon+1));
+                string key = str_trim(line.substr(1, colon-1)).str();
+                string value = str_trim(line.substr(colon+1)).str();
                 if (key == "RemoteInfo" || key == "Parameter" ||
                     key == "XY-Serializer Export Settings" || value.empty()) {
                     // ignore, these fields are non-unique or not interesting
@@ -101,7 +102,7 @@ Block* read_block(istream &f)
         }
     }
     // data - next lines  (data block ends with blank line or eof)
-    while (getline(f, line) && !line.empty() && line[0] != '#') {
+    while (reader.next(&line) && !line.empty() && line[0] != '#') {
         read_numbers(line, row);
         if (row.size() == 0)
             break;
@@ -116,11 +117,82 @@ Block* read_block(istream &f)
     return blk;
 }
 
+// Finds where blocks end. A block has comments (metadata) followed by data
+// lines, and the data ends with a blank line or comment.
+static
+vector<const char*> find_block_ends(LineReader& reader)
+{
+    vector<const char*> ends;
+    bool in_data = false;
+    StrView line;
+    while (reader.next(&line)) {
+        if (in_data) {
+            if (line.empty() || line[0] == '#') {
+                ends.push_back(reader.pos());
+                in_data = false;
+            }
+        } else if (!line.empty() && line[0] != '#' &&
+                   line.find_first_of("0123456789") < line.find('#')) {
+            in_data = true;
+        }
+    }
+    if (ends.empty() || ends.back() != reader.pos())
+        ends.push_back(reader.pos());
+    return ends;
+}
+
 void SpecsxyDataSet::load_data(std::istream &f, const char*)
 {
-    Block* blk = NULL;
-    while ((blk = read_block(f)) != NULL)
-        add_block(blk);
+    LineReader reader(f);
+    const char* begin = reader.pos();
+    vector<const char*> ends;
+    if (size_t(reader.end() - begin) >= min_parallel_parse_size) {
+        LineReader scan(begin, reader.end());
+        ends = find_block_ends(scan);
+    }
+
+    // Parse blocks in parallel. Each section should contain exactly one
+    // block (only the last one can have no data or trailing comments).
+    // If it's not the case, the boundaries were wrong and the file is
+    // parsed sequentially. Small files (no sections) are also parsed
+    // sequentially.
+    size_t n = ends.size();
+    vector<Block*> blocks(n, (Block*) NULL);
+    bool parsed = false;
+    if (n != 0) {
+        try {
+            parallel_for_ordered(n, [&](size_t i) {
+                LineReader section(i == 0 ? begin : ends[i-1], ends[i]);
+                blocks[i] = read_block(section);
+                if (i + 1 != n) {
+                    if (blocks[i] == NULL || section.pos() != section.end())
+                        throw IrregularSection();
+                } else if (blocks[i] != NULL) {
+                    Block* extra = read_block(section);
+                    if (extra != NULL) {
+                        delete extra;
+                        throw IrregularSection();
+                    }
+                }
+            });
+            parsed = true;
+        } catch (IrregularSection&) {
+            // parse the file sequentially
+        } catch (...) {
+            purge_all_elements(blocks);
+            throw;
+        }
+    }
+    if (!parsed) {
+        purge_all_elements(blocks);
+        Block* blk = NULL;
+        while ((blk = read_block(reader)) != NULL)
+            add_block(blk);
+        return;
+    }
+    for (size_t i = 0; i != n; ++i)
+        if (blocks[i] != NULL)
+            add_block(blocks[i]);
 }
 
 } // namespace xylib
@@ -7,7 +7,10 @@
 #include "spectra.h"
 
 #include <cstdlib>
+#include <utility>
+#include <vector>
 #include "util.h"
+#include "fileio.h"
 
 using namespace std;
 using namespace xylib::util;
@@ -51,24 +54,76 @@ bool SpectraDataSet::check(istream &f, string*)
 }
 
 
+// Returns the number of points from the header line of a block,
+// or 0 if the line can't be parsed.
+static
+long get_point_count(StrView header)
+{
+    string line = header.str(); // strtod() must not go past the line
+    const char *p = line.c_str();
+    char *endptr = NULL;
+    for (int i = 0; i != 6; ++i) {
+        double val = strtod(p, &endptr);
+        if (endptr == p)
+            return 0;
+        if (i == 5)
+            return val > 0 && val < 1e8 ? (long) val : 0;
+        p = endptr;
+    }
+    return 0;
+}
+
 void SpectraDataSet::load_data(std::istream &f, const char*)
 {
-    f.ignore(1024, '\n'); // first line --> Experimentname
-    for (;;) {
-        Block *blk = read_block(f);
-        if (blk == NULL)
+    LineReader reader(f);
+    StrView line;
+    reader.next(&line); // first line --> Experimentname
+    if (size_t(reader.end() - reader.pos()) < min_parallel_parse_size) {
+        Block* blk = NULL;
+        while ((blk = read_block(reader)) != NULL)
+            add_block(blk);
+        return;
+    }
+    // Blocks have known length, so the file can be split into blocks
+    // quickly and blocks can be parsed in parallel.
+    // If a header can't be parsed, the rest of file is one section
+    // and read_block() reports the error.
+    vector<pair<const char*, const char*> > sections;
+    while (reader.pos() != reader.end()) {
+        const char* begin = reader.pos();
+        reader.next(&line);
+        long points = get_point_count(line);
+        if (points == 0) {
+            sections.push_back(make_pair(begin, reader.end()));
             break;
-        add_block(blk);
+        }
+        for (long i = 0; i <= points && reader.next(&line); ++i)
+            ;
+        sections.push_back(make_pair(begin, reader.pos()));
     }
+
+    vector<Block*> blocks(sections.size(), (Block*) NULL);
+    try {
+        parallel_for_ordered(sections.size(), [&](size_t i) {
+            LineReader section(sections[i].first, sections[i].second);
+            blocks[i] = read_block(section);
+        });
+    } catch (...) {
+        purge_all_elements(blocks);
+        throw;
+    }
+    for (size_t i = 0; i != blocks.size(); ++i)
+        if (blocks[i] != NULL)
+            add_block(blocks[i]);
 }
 
-Block* SpectraDataSet::read_block(istream& f)
+Block* SpectraDataSet::read_block(LineReader& reader)
 {
-    char line[256];
-    f.getline(line, 255); // second line --> header
-    if (f.eof())
+    StrView view;
+    if (!reader.next(&view)) // second line --> header
         return NULL;
-    const char *pStart = line;
+    string line = view.str();
+    const char *pStart = line.c_str();
     char *pEnd;
     double start = strtod(pStart,&pEnd);
     format_assert(this, pEnd != pStart);
@@ -92,12 +147,13 @@ Block* SpectraDataSet::read_block(istream& f)
     double exenergy = strtod(pStart,&pEnd);
     format_assert(this, pEnd != pStart);
 
-    f.getline(line, 255); // third line --> spectraname
-    format_assert(this, !f.eof(), "unexpected EOF");
+    // third line --> spectraname
+    format_assert(this, reader.next(&view), "unexpected EOF");
+    line = view.str();
     // It's a file from a DOS program. According to the manual it's
     // ASCII file, but some files have non-ASCII characters.
     // Let's "convert" them to ascii.
-    for (char *p = line; *p != '\0'; ++p)
+    for (string::iterator p = line.begin(); p != line.end(); ++p)
         if (*p == (char) 0xB0) // some files have degree symbol in Latin1
             *p = '^';
         else if ((signed char) *p < 0)
@@ -106,14 +162,14 @@ Block* SpectraDataSet::read_block(istream& f)
 
     Block *blk = new Block;
     blk->set_name(spectra_name);
-    blk->meta["start"]          = dbl_to_str(start);
-    blk->meta["end"]            = dbl_to_str(end);
-    blk->meta["step"]           = dbl_to_str(step);
-    blk->meta["scans"]          = dbl_to_str(scans);
-    blk->meta["dwell"]          = dbl_to_str(dwell);
-    blk->meta["points"]         = S(points);
-    blk->meta["EPass"]          = dbl_to_str(epass);
-    blk->meta["source energy"]  = dbl_to_str(exenergy);
+    blk->meta.set_double("start", start);
+    blk->meta.set_double("end", end);
+    blk->meta.set_double("step", step);
+    blk->meta.set_double("scans", scans);
+    blk->meta.set_double("dwell", dwell);
+    blk->meta.set_int("points", points);
+    blk->meta.set_double("EPass", epass);
+    blk->meta.set_double("source energy", exenergy);
 
     // positive binding energy
     //StepColumn *xcol = new StepColumn(exenergy-start, -step);
@@ -122,13 +178,18 @@ Block* SpectraDataSet::read_block(istream& f)
     xcol->set_name("binding energy [eV]");
     blk->add_column(xcol);
 
-    VecColumn *ycol = new VecColumn;
-    ycol->set_name(spectra_name + " [cps]");
-    for (long i = 0; i != points; ++i) {
-        f.getline(line, 32);
-        format_assert(this, !f.fail(), "reading cps data failed");
-        ycol->add_val(my_strtod(line)/scans/dwell);
+    // keep raw counts, cps are calculated when accessed
+    VecColumn *counts = new VecColumn;
+    try {
+        reader.read_values(counts, (int) points);
+    } catch (FormatError const& e) {
+        delete counts;
+        delete blk;
+        format_assert(this, false, string("reading cps data failed: ")
+                                   + e.what());
     }
+    AffineColumn *ycol = new AffineColumn(counts, 1. / (scans * dwell), 0.);
+    ycol->set_name(spectra_name + " [cps]");
     blk->add_column(ycol);
     return blk;
 }
@@ -29,12 +29,13 @@
 #include "xylib.h"
 
 namespace xylib {
+    namespace util { class LineReader; }
 
     class SpectraDataSet : public DataSet
     {
         OBLIGATORY_DATASET_MEMBERS(SpectraDataSet)
     private:
-        Block* read_block(std::istream& f);
+        Block* read_block(util::LineReader& reader);
     };
 
 }
@@ -58,6 +58,15 @@ void replace_commas_with_dots(string &s)
             *p = '.';
 }
 
+// false if the line starts with a number that is not in [lo, hi]
+bool first_number_in_range(string const& s, double lo, double hi)
+{
+    const char* p = s.c_str();
+    char* endptr;
+    double x = strtod(p, &endptr);
+    return endptr == p || (lo <= x && x <= hi);
+}
+
 } // anonymous namespace
 
 void TextDataSet::load_data(std::istream &f, const char*)
@@ -87,6 +96,10 @@ void TextDataSet::load_data_with_delim(std::istream &f, char line_delim,
     // header is in last comment line - the line before the first data line
     bool last_line_header = has_option("last-line-header");
     bool decimal_comma = has_option("decimal-comma");
+    // with option x-range, only the first number is converted in lines
+    // outside of the range (the first data line is handled after loading)
+    double x_lo, x_hi;
+    bool has_x_range = get_x_range(&x_lo, &x_hi);
 
     if (first_line_header) {
         title_line = str_trim(buf);
@@ -138,6 +151,8 @@ void TextDataSet::load_data_with_delim(std::istream &f, char line_delim,
     while (getline(f, buf, line_delim)) {
         if (decimal_comma)
             replace_commas_with_dots(buf);
+        if (has_x_range && !first_number_in_range(buf, x_lo, x_hi))
+            continue;
         read_numbers(buf, row);
 
         // We silently skip lines with no data.
@@ -205,7 +220,8 @@ void TextDataSet::load_data_with_delim(std::istream &f, char line_delim,
             cols[i]->add_val(row[i]);
     }
 
-    format_assert(this, cols.size() >= 1 && cols[0]->get_point_count() >= 2,
+    format_assert(this, cols.size() >= 1 &&
+                        cols[0]->get_point_count() >= (has_x_range ? 1 : 2),
                   "data not found in file.");
 
     Block* blk = new Block;
@@ -3,6 +3,7 @@
 
 #define BUILDING_XYLIB
 #include "util.h"
+#include "fileio.h"
 #include "xylib.h"
 
 #include <cassert>
@@ -14,18 +15,18 @@
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib> // strtol, strtod
+#include <cstring>
+#include <exception>
 #include <limits>
-#include <boost/version.hpp>
-#if BOOST_VERSION >= 106500
-#include <boost/predef/other/endian.h>
-#if !BOOST_ENDIAN_LITTLE_BYTE && !BOOST_ENDIAN_BIG_BYTE
-# error "Unknown endianness"
-#endif
+#include <mutex>
+#include <system_error>
+#include <thread>
+#if defined(__SSE2__) || defined(_M_X64) || \
+        (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# include <emmintrin.h>
+# define XYLIB_HAVE_SSE2 1
 #else
-#include <boost/detail/endian.hpp>
-#if !defined(BOOST_LITTLE_ENDIAN) && !defined(BOOST_BIG_ENDIAN)
-# error "Unknown endianness"
-#endif
+# define XYLIB_HAVE_SSE2 0
 #endif
 
 using namespace std;
@@ -34,38 +35,129 @@ namespace xylib { namespace util {
 
 // -------   standard library functions with added error checking    --------
 
-long my_strtol(const std::string &str)
+const char* parse_long(const std::string &str, long *val)
 {
     string ss = str_trim(str);
     const char *startptr = ss.c_str();
     char *endptr = NULL;
-    long val = strtol(startptr, &endptr, 10);
+    *val = strtol(startptr, &endptr, 10);
+
+    if (LONG_MAX == *val || LONG_MIN == *val)
+        return "overflow when reading long";
+    else if (startptr == endptr)
+        return "not an integer as expected";
+    return NULL;
+}
+
+namespace {
+
+const char* parse_double_cstr(const char* startptr, double *val)
+{
+    char *endptr = NULL;
+    *val = strtod(startptr, &endptr);
 
-    if (LONG_MAX == val || LONG_MIN == val) {
-        throw FormatError("overflow when reading long");
-    } else if (startptr == endptr) {
-        throw FormatError("not an integer as expected");
+    if (HUGE_VAL == *val || -HUGE_VAL == *val)
+        return "overflow when reading double";
+    else if (startptr == endptr)
+        return "not a double as expected";
+    return NULL;
+}
+
+} // anonymous namespace
+
+const char* parse_double(const std::string &str, double *val)
+{
+    return parse_double_cstr(str.c_str(), val);
+}
+
+const char* parse_double(const char* p, size_t len, double *val)
+{
+    // strtod() needs NUL-terminated string, numbers are usually short
+    char buf[64];
+    if (len < sizeof(buf)) {
+        memcpy(buf, p, len);
+        buf[len] = '\0';
+        return parse_double_cstr(buf, val);
     }
+    return parse_double_cstr(string(p, len).c_str(), val);
+}
 
+long my_strtol(const std::string &str)
+{
+    long val;
+    const char* error = parse_long(str, &val);
+    if (error)
+        throw FormatError(error);
     return val;
 }
 
 double my_strtod(const std::string &str)
 {
-    const char *startptr = str.c_str();
-    char *endptr = NULL;
-    double val = strtod(startptr, &endptr);
-
-    if (HUGE_VAL == val || -HUGE_VAL == val) {
-        throw FormatError("overflow when reading double");
-    } else if (startptr == endptr) {
-        throw FormatError("not a double as expected");
-    }
+    double val;
+    const char* error = parse_double(str, &val);
+    if (error)
+        throw FormatError(error);
+    return val;
+}
 
+double my_strtod(const char* p, size_t len)
+{
+    double val;
+    const char* error = parse_double(p, len, &val);
+    if (error)
+        throw FormatError(error);
     return val;
 }
 
 
+// strtod() with a fast path for plain decimal numbers: if the digits fit
+// in 53 bits and the decimal exponent is small, the result of one
+// multiplication or division is correctly rounded (Clinger's fast path).
+double fast_strtod(const char* p, char** endptr)
+{
+    static const double pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6,
+        1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+        1e18, 1e19, 1e20, 1e21, 1e22 };
+    const char* s = p;
+    bool neg = (*s == '-');
+    if (*s == '-' || *s == '+')
+        ++s;
+    if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) // hex, not handled here
+        return strtod(p, endptr);
+    uint64_t m = 0;
+    int n_digits = 0;
+    int exp10 = 0;
+    for (; isdigit((unsigned char) *s); ++s, ++n_digits)
+        m = m * 10 + (*s - '0');
+    if (*s == '.')
+        for (++s; isdigit((unsigned char) *s); ++s, ++n_digits, --exp10)
+            m = m * 10 + (*s - '0');
+    if (n_digits == 0 || n_digits > 19) // inf, nan, or too many digits
+        return strtod(p, endptr);
+    if (*s == 'e' || *s == 'E') {
+        const char* e = s + 1;
+        bool eneg = (*e == '-');
+        if (*e == '-' || *e == '+')
+            ++e;
+        if (isdigit((unsigned char) *e)) {
+            int x = 0;
+            for (; isdigit((unsigned char) *e) && x < 1000; ++e)
+                x = x * 10 + (*e - '0');
+            if (isdigit((unsigned char) *e))
+                return strtod(p, endptr);
+            exp10 += eneg ? -x : x;
+            s = e;
+        }
+    }
+    if (m > (UINT64_C(1) << 53) || exp10 < -22 || exp10 > 22)
+        return strtod(p, endptr);
+    double v = (double) m;
+    v = exp10 < 0 ? v / pow10[-exp10] : v * pow10[exp10];
+    *endptr = const_cast<char*>(s);
+    return neg ? -v : v;
+}
+
+
 // ----------   istream::read()- & endiannes-related utilities   ----------
 
 namespace {
@@ -80,8 +172,7 @@ void my_read(istream &f, char *buf, int len)
 
 // change the byte-order from "little endian" to host endian
 // ptr: pointer to the data, size - size in bytes
-#if defined(BOOST_BIG_ENDIAN) || \
-    (defined(BOOST_ENDIAN_BIG_BYTE) && BOOST_ENDIAN_BIG_BYTE)
+#if XYLIB_BIG_ENDIAN
 void le_to_host(void *ptr, int size)
 {
     char *p = (char*) ptr;
@@ -128,6 +219,44 @@ double read_dbl_le(istream &f) { return read_le<double>(f); }
 
 int read_int32_be(istream &f) { return read_be<int32_t>(f); }
 
+namespace {
+template<typename T, typename U>
+bool read_le_nothrow(istream &f, U *val)
+{
+    T v;
+    f.read(reinterpret_cast<char*>(&v), sizeof(v));
+    if (f.gcount() < (streamsize) sizeof(v))
+        return false;
+    le_to_host(&v, sizeof(v));
+    *val = v;
+    return true;
+}
+} // anonymous namespace
+
+bool read_uint32_le(istream &f, unsigned int *val)
+    { return read_le_nothrow<uint32_t>(f, val); }
+bool read_int32_le(istream &f, int *val)
+    { return read_le_nothrow<int32_t>(f, val); }
+bool read_uint16_le(istream &f, unsigned int *val)
+    { return read_le_nothrow<uint16_t>(f, val); }
+bool read_int16_le(istream &f, int *val)
+    { return read_le_nothrow<int16_t>(f, val); }
+bool read_flt_le(istream &f, float *val)
+    { return read_le_nothrow<float>(f, val); }
+bool read_dbl_le(istream &f, double *val)
+    { return read_le_nothrow<double>(f, val); }
+
+bool read_int32_be(istream &f, int *val)
+{
+    int32_t v;
+    f.read(reinterpret_cast<char*>(&v), sizeof(v));
+    if (f.gcount() < (streamsize) sizeof(v))
+        return false;
+    be_to_host(&v, sizeof(v));
+    *val = v;
+    return true;
+}
+
 char read_char(istream &f)
 {
     char val;
@@ -138,13 +267,22 @@ char read_char(istream &f)
 // read a string from f
 string read_string(istream &f, unsigned len)
 {
-    static char buf[256];
+    char buf[256]; // not static, files can be read in parallel
     assert(len < sizeof(buf));
     my_read(f, buf, len);
     buf[len] = '\0';
     return string(buf);
 }
 
+string read_string_nothrow(istream &f, unsigned len)
+{
+    char buf[256];
+    assert(len < sizeof(buf));
+    f.read(buf, len);
+    buf[f.gcount()] = '\0';
+    return string(buf);
+}
+
 // function that converts single precision 32-bit floating point in DEC PDP-11
 // format to double
 // good description of the format is at:
@@ -154,6 +292,140 @@ string read_string(istream &f, unsigned len)
 //         PDP-11 F floating point numbers can be converted very easily (and
 //         efficently) into standard IEEE 754 format: Swap the higher an lower
 //         16-bit words, cast to float and divide by 4.
+namespace {
+
+template<typename T>
+void decode_scalar(const char* p, size_t n, bool big_endian, double* out)
+{
+    typedef typename UIntOfSize<sizeof(T)>::type uint_type;
+    bool swap = (big_endian != (bool) XYLIB_BIG_ENDIAN);
+    for (size_t i = 0; i < n; ++i) {
+        uint_type u;
+        memcpy(&u, p + i * sizeof(T), sizeof(T));
+        if (swap)
+            u = byte_swap(u);
+        T val;
+        memcpy(&val, &u, sizeof(T));
+        out[i] = val;
+    }
+}
+
+#if XYLIB_HAVE_SSE2
+// SSE2 exists only on little-endian x86, so swapping is needed only
+// for big-endian data.
+inline __m128i swap16(__m128i v)
+{
+    return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+inline __m128i swap32(__m128i v)
+{
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    return swap16(v);
+}
+
+inline void store_epi32(__m128i v, double* out)
+{
+    _mm_storeu_pd(out, _mm_cvtepi32_pd(v));
+    _mm_storeu_pd(out + 2, _mm_cvtepi32_pd(_mm_shuffle_epi32(v, 0xEE)));
+}
+
+// Converts n values and returns the number of converted values,
+// the rest (n % 8 or less) is left for decode_scalar().
+size_t decode_sse2(const char* p, size_t n, DataType dt, bool swap,
+                   double* out)
+{
+    size_t i = 0;
+    switch (dt) {
+        case DT_FLOAT64:
+            for (; i + 2 <= n; i += 2) {
+                __m128i v = _mm_loadu_si128((const __m128i*) (p + 8 * i));
+                if (swap)
+                    v = _mm_shuffle_epi32(swap32(v), _MM_SHUFFLE(2, 3, 0, 1));
+                _mm_storeu_pd(out + i, _mm_castsi128_pd(v));
+            }
+            break;
+        case DT_FLOAT32:
+            for (; i + 4 <= n; i += 4) {
+                __m128i v = _mm_loadu_si128((const __m128i*) (p + 4 * i));
+                if (swap)
+                    v = swap32(v);
+                __m128 f = _mm_castsi128_ps(v);
+                _mm_storeu_pd(out + i, _mm_cvtps_pd(f));
+                _mm_storeu_pd(out + i + 2, _mm_cvtps_pd(_mm_movehl_ps(f, f)));
+            }
+            break;
+        case DT_INT32:
+            for (; i + 4 <= n; i += 4) {
+                __m128i v = _mm_loadu_si128((const __m128i*) (p + 4 * i));
+                if (swap)
+                    v = swap32(v);
+                store_epi32(v, out + i);
+            }
+            break;
+        case DT_UINT32: {
+            // flip the sign bit, convert as int32 and add 2^31
+            const __m128i sign = _mm_set1_epi32((int) 0x80000000u);
+            const __m128d offset = _mm_set1_pd(2147483648.);
+            for (; i + 4 <= n; i += 4) {
+                __m128i v = _mm_loadu_si128((const __m128i*) (p + 4 * i));
+                if (swap)
+                    v = swap32(v);
+                v = _mm_xor_si128(v, sign);
+                __m128d lo = _mm_cvtepi32_pd(v);
+                __m128d hi = _mm_cvtepi32_pd(_mm_shuffle_epi32(v, 0xEE));
+                _mm_storeu_pd(out + i, _mm_add_pd(lo, offset));
+                _mm_storeu_pd(out + i + 2, _mm_add_pd(hi, offset));
+            }
+            break;
+        }
+        case DT_INT16:
+        case DT_UINT16:
+            for (; i + 8 <= n; i += 8) {
+                __m128i v = _mm_loadu_si128((const __m128i*) (p + 2 * i));
+                if (swap)
+                    v = swap16(v);
+                __m128i lo, hi;
+                if (dt == DT_INT16) {
+                    lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+                    hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+                } else {
+                    __m128i zero = _mm_setzero_si128();
+                    lo = _mm_unpacklo_epi16(v, zero);
+                    hi = _mm_unpackhi_epi16(v, zero);
+                }
+                store_epi32(lo, out + i);
+                store_epi32(hi, out + i + 4);
+            }
+            break;
+    }
+    return i;
+}
+#endif // XYLIB_HAVE_SSE2
+
+} // anonymous namespace
+
+void decode_to_double(const char* p, size_t n, DataType dt, bool big_endian,
+                      double* out)
+{
+    size_t done = 0;
+#if XYLIB_HAVE_SSE2
+    done = decode_sse2(p, n, dt, big_endian, out);
+#endif
+    p += done * get_dtype_size(dt);
+    n -= done;
+    out += done;
+    switch (dt) {
+        case DT_FLOAT64: decode_scalar<double>(p, n, big_endian, out); break;
+        case DT_FLOAT32: decode_scalar<float>(p, n, big_endian, out); break;
+        case DT_INT32: decode_scalar<int32_t>(p, n, big_endian, out); break;
+        case DT_UINT32: decode_scalar<uint32_t>(p, n, big_endian, out); break;
+        case DT_INT16: decode_scalar<int16_t>(p, n, big_endian, out); break;
+        case DT_UINT16: decode_scalar<uint16_t>(p, n, big_endian, out); break;
+    }
+}
+
 double from_pdp11(const unsigned char* p)
 {
     int sign = (p[1] & 0x80) == 0 ? 1 : -1;
@@ -205,6 +477,31 @@ void str_split(string const& line, char sep, string &key, string &val)
     }
 }
 
+StrView str_trim(StrView str)
+{
+    const char* b = str.begin();
+    const char* e = str.end();
+    while (b != e && (*b == ' ' || *b == '\r' || *b == '\n' || *b == '\t'))
+        ++b;
+    while (e != b && (e[-1] == ' ' || e[-1] == '\r' || e[-1] == '\n'
+                      || e[-1] == '\t'))
+        --e;
+    return StrView(b, e);
+}
+
+void str_split(StrView line, char sep, StrView* key, StrView* val)
+{
+    size_t p = line.find(sep);
+    if (p == StrView::npos) {
+        *key = line;
+        *val = StrView();
+    }
+    else {
+        *key = str_trim(line.substr(0, p));
+        *val = str_trim(line.substr(p + 1));
+    }
+}
+
 // change all letters in a string to lower case
 std::string str_tolower(const std::string &str)
 {
@@ -305,25 +602,32 @@ void skip_whitespace(istream &f)
 // example:
 //   15.000   0.020 110.000
 // returns NULL on error
-Column* read_start_step_end_line(istream& f)
+namespace {
+
+// reads number from line [p, end), that is followed by EOL or NUL
+bool read_number_from(const char*& p, const char* end, double* val)
 {
-    char line[256];
-    f.getline(line, 255);
-    // the first line should contain start, step and stop
+    // strtod() would skip also EOL
+    while (p != end && isspace((unsigned char) *p))
+        ++p;
+    if (p == end)
+        return false;
     char *endptr;
-    const char *startptr = line;
-    double start = strtod(startptr, &endptr);
-    if (startptr == endptr)
-        return NULL;
-
-    startptr = endptr;
-    double step = strtod(startptr, &endptr);
-    if (startptr == endptr || step == 0.)
-        return NULL;
+    *val = fast_strtod(p, &endptr);
+    if (endptr == p)
+        return false;
+    p = endptr;
+    return true;
+}
 
-    startptr = endptr;
-    double stop = strtod(endptr, &endptr);
-    if (startptr == endptr)
+// the line should contain start, step and stop
+Column* parse_start_step_end_line(StrView line)
+{
+    const char* p = line.begin();
+    double start, step, stop;
+    if (!read_number_from(p, line.end(), &start) ||
+            !read_number_from(p, line.end(), &step) || step == 0. ||
+            !read_number_from(p, line.end(), &stop))
         return NULL;
 
     double dcount = (stop - start) / step + 1;
@@ -334,13 +638,27 @@ Column* read_start_step_end_line(istream& f)
     return new StepColumn(start, step, count);
 }
 
+} // anonymous namespace
+
+Column* read_start_step_end_line(istream& f)
+{
+    char line[256];
+    f.getline(line, 255);
+    return parse_start_step_end_line(StrView(line));
+}
+
 Block* read_ssel_and_data(istream &f, int max_headers)
 {
+    LineReader reader(f);
+    StrView line;
     // we are looking for the first line with start-step-end numeric triple,
     // it should be one of the first (max_headers+1) lines
-    Column *xcol = read_start_step_end_line(f);
-    for (int i = 0; i < max_headers && xcol == NULL; ++i)
-        xcol = read_start_step_end_line(f);
+    Column *xcol = NULL;
+    for (int i = 0; i <= max_headers && xcol == NULL; ++i) {
+        if (!reader.next(&line))
+            return NULL;
+        xcol = parse_start_step_end_line(line);
+    }
 
     if (!xcol)
         return NULL;
@@ -349,11 +667,11 @@ Block* read_ssel_and_data(istream &f, int max_headers)
     blk->add_column(xcol);
 
     VecColumn *ycol = new VecColumn;
-    string s;
     // in PSI_DMC there is a text following the data, so we read only as many
     // data lines as necessary
-    while (getline(f, s) && ycol->get_point_count() < xcol->get_point_count())
-        ycol->add_values_from_str(s);
+    while (ycol->get_point_count() < xcol->get_point_count() &&
+           reader.next(&line))
+        ycol->add_values_from_str(line);
     blk->add_column(ycol);
 
     // both xcol and ycol should have known and same number of points
@@ -367,19 +685,29 @@ Block* read_ssel_and_data(istream &f, int max_headers)
 // returns the first not processed character
 const char* read_numbers(string const& s, vector<double>& row)
 {
-    row.clear();
     const char *p = s.c_str();
-    while (*p != 0) {
+    return read_numbers(StrView(p, strlen(p)), row);
+}
+
+const char* read_numbers(StrView s, vector<double>& row)
+{
+    row.clear();
+    const char *p = s.begin();
+    // strtod() would skip also EOL
+    while (p != s.end() && isspace((unsigned char) *p))
+        ++p;
+    while (p != s.end()) {
         char *endptr = NULL;
         errno = 0; // to distinguish success/failure after call
-        double val = strtod(p, &endptr);
+        double val = fast_strtod(p, &endptr);
         if (p == endptr) // no more numbers
             break;
         if (errno == ERANGE && (val == HUGE_VAL || val == -HUGE_VAL))
-            throw FormatError("Numeric overflow in line:\n" + s);
+            throw FormatError("Numeric overflow in line:\n" + s.str());
         row.push_back(val);
         p = endptr;
-        while (isspace(*p) || *p == ',' || *p == ';' || *p == ':')
+        while (p != s.end() && (isspace((unsigned char) *p) || *p == ','
+                                || *p == ';' || *p == ':'))
             ++p;
     }
     return p;
@@ -412,7 +740,7 @@ vector<Block*> split_on_column_length(Block *block)
                                                            : " " + S(r_idx)));
             result.push_back(new_block);
         }
-        Column *col = block->del_column(0);
+        shared_ptr<const Column> col = block->del_column(0);
         result[r_idx]->add_column(col);
     }
     return result;
@@ -443,60 +771,693 @@ void warn(const char *fmt, ...) {
 #endif
 }
 
-// get all numbers in the first legal line
-// sep is _optional_ separator that can be used in addition to white space
-void VecColumn::add_values_from_str(string const& str, char sep)
+namespace {
+
+bool is_blank_line(const char* p, const char* eol)
 {
-    const char* p = str.c_str();
-    while (isspace(*p) || *p == sep)
-        ++p;
-    while (*p != 0) {
+    for (; p != eol; ++p)
+        if (!isspace((unsigned char) *p))
+            return false;
+    return true;
+}
+
+// Parses numbers from line [p, eol); *eol must not be a part of number
+// (e.g. it's EOL or NUL), so fast_strtod() can be called directly on the line.
+// If sep is 0, only the first number is read and the rest of the line
+// is ignored (like in my_strtod()).
+void parse_numbers_in_line(const char* p, const char* eol, char sep,
+                           VecColumn* col)
+{
+    const char* start = p;
+    for (;;) {
+        while (p != eol && (*p == ' ' || *p == '\t' || (sep && *p == sep)))
+            ++p;
+        if (sep && (p == eol || (*p == '\r' && p + 1 == eol)))
+            break;
+        // strtod() would skip other white space, including '\n'
+        if (p == eol || isspace((unsigned char) *p))
+            throw FormatError("Number not found in line:\n"
+                              + string(start, eol));
         char *endptr = NULL;
-        errno = 0; // To distinguish success/failure after call
-        double val = strtod(p, &endptr);
-        if (p == endptr)
-            throw FormatError("Number not found in line:\n" + str);
+        errno = 0; // to distinguish success/failure after call
+        double val = fast_strtod(p, &endptr);
+        if (endptr == p)
+            throw FormatError("Number not found in line:\n"
+                              + string(start, eol));
         if (errno == ERANGE && (val == HUGE_VAL || val == -HUGE_VAL))
-            throw FormatError("Numeric overflow in line:\n" + str);
-        add_val(val);
+            throw FormatError("Numeric overflow in line:\n"
+                              + string(start, eol));
+        col->add_val(val);
+        if (!sep)
+            break;
         p = endptr;
-        while (isspace(*p) || *p == sep)
-            ++p;
     }
 }
 
-double VecColumn::get_min() const
+} // anonymous namespace
+
+const char* VecColumn::add_values_from_lines(const char* p, const char* end,
+                                             int line_count, int stride,
+                                             char sep)
+{
+    if (line_count > 0 && !sep)
+        reserve(data.size() + (line_count + stride - 1) / stride);
+    for (int i = 0; line_count == -1 || i < line_count; ++i) {
+        if (p == end) {
+            if (line_count == -1)
+                break;
+            throw FormatError("unexpected end of file");
+        }
+        const char* eol = (const char*) memchr(p, '\n', end - p);
+        if (i % stride != 0) {
+            // this line is not parsed
+        } else if (line_count == -1 && is_blank_line(p, eol ? eol : end)
+                   && is_blank_line(p, end)) {
+            // blank lines at the end are ignored
+            return end;
+        } else if (eol) {
+            parse_numbers_in_line(p, eol, sep, this);
+        } else { // the last line has no '\n', make a NUL-terminated copy
+            string last(p, end);
+            parse_numbers_in_line(last.c_str(), last.c_str() + last.size(),
+                                  sep, this);
+        }
+        p = eol ? eol + 1 : end;
+    }
+    return p;
+}
+
+// get all numbers in the first legal line
+// sep is _optional_ separator that can be used in addition to white space
+void VecColumn::add_values_from_str(string const& str, char sep)
+{
+    const char* p = str.c_str();
+    add_values_from_str(StrView(p, strlen(p)), sep);
+}
+
+void VecColumn::add_values_from_str(StrView line, char sep)
 {
-    calculate_min_max();
-    return min_val;
+    // with sep 0 only one number would be read, ' ' changes nothing here
+    parse_numbers_in_line(line.begin(), line.end(), sep ? sep : ' ', this);
 }
 
-double VecColumn::get_max(int /*point_count*/) const
+ValueScanner::ValueScanner()
+    : n_(0), nan_count_(0), asc_(true), desc_(true),
+      min_(HUGE_VAL), max_(-HUGE_VAL), last_(0.),
+      has_shift_(false), shift_(0.), sum_(0.), sumsq_(0.)
 {
-    calculate_min_max();
-    return max_val;
 }
 
-void VecColumn::calculate_min_max() const
+inline void ValueScanner::add_scalar(double v)
 {
-    // public api of VecColumn don't allow changing data, only appending
-    if ((int) data.size() == last_minmax_length)
+    // written this way to handle NaN
+    if (n_ != 0) {
+        if (!(v >= last_))
+            asc_ = false;
+        if (!(v <= last_))
+            desc_ = false;
+    }
+    last_ = v;
+    ++n_;
+    if (v != v) {
+        ++nan_count_;
         return;
+    }
+    if (!has_shift_) {
+        shift_ = v;
+        has_shift_ = true;
+    }
+    if (v < min_)
+        min_ = v;
+    if (v > max_)
+        max_ = v;
+    double d = v - shift_;
+    sum_ += d;
+    sumsq_ += d * d;
+}
+
+void ValueScanner::add(const double* p, size_t count)
+{
+    size_t i = 0;
+    // values before the first non-NaN and the first value (that is compared
+    // with the last value from the previous call) are handled one by one
+    while (i < count && (i == 0 || !has_shift_))
+        add_scalar(p[i++]);
+#if XYLIB_HAVE_SSE2
+    if (i + 2 <= count) {
+        const __m128d shift = _mm_set1_pd(shift_);
+        __m128d vmin = _mm_set1_pd(min_);
+        __m128d vmax = _mm_set1_pd(max_);
+        __m128d vsum = _mm_setzero_pd();
+        __m128d vsumsq = _mm_setzero_pd();
+        __m128d asc = _mm_castsi128_pd(_mm_set1_epi32(-1));
+        __m128d desc = asc;
+        size_t nans = 0;
+        size_t start = i;
+        for (; i + 2 <= count; i += 2) {
+            __m128d v = _mm_loadu_pd(p + i);
+            __m128d prev = _mm_loadu_pd(p + i - 1);
+            // comparisons with NaN are false
+            asc = _mm_and_pd(asc, _mm_cmpge_pd(v, prev));
+            desc = _mm_and_pd(desc, _mm_cmple_pd(v, prev));
+            __m128d nan = _mm_cmpunord_pd(v, v);
+            int mask = _mm_movemask_pd(nan);
+            nans += (mask & 1) + (mask >> 1);
+            // if one operand is NaN, min and max return the second one
+            vmin = _mm_min_pd(v, vmin);
+            vmax = _mm_max_pd(v, vmax);
+            __m128d d = _mm_andnot_pd(nan, _mm_sub_pd(v, shift));
+            vsum = _mm_add_pd(vsum, d);
+            vsumsq = _mm_add_pd(vsumsq, _mm_mul_pd(d, d));
+        }
+        double t[2];
+        _mm_storeu_pd(t, vmin);
+        min_ = std::min(t[0], t[1]);
+        _mm_storeu_pd(t, vmax);
+        max_ = std::max(t[0], t[1]);
+        _mm_storeu_pd(t, vsum);
+        sum_ += t[0] + t[1];
+        _mm_storeu_pd(t, vsumsq);
+        sumsq_ += t[0] + t[1];
+        if (_mm_movemask_pd(asc) != 3)
+            asc_ = false;
+        if (_mm_movemask_pd(desc) != 3)
+            desc_ = false;
+        nan_count_ += nans;
+        last_ = p[i-1];
+        n_ += i - start;
+    }
+#endif
+    for (; i < count; ++i)
+        add_scalar(p[i]);
+}
+
+ColumnStats ValueScanner::get_stats() const
+{
+    ColumnStats s;
+    s.count = (int) n_;
+    s.nan_count = (int) nan_count_;
+    s.order = asc_ ? 1 : (desc_ ? -1 : 0);
+    size_t m = n_ - nan_count_;
+    if (m == 0) {
+        s.min = s.max = s.mean = s.variance = (n_ == 0 ? 0. : NAN);
+        s.sum = 0.;
+        return s;
+    }
+    s.min = min_;
+    s.max = max_;
+    double mean_d = sum_ / m;
+    s.mean = shift_ + mean_d;
+    s.sum = shift_ * m + sum_;
+    s.variance = std::max(0., sumsq_ / m - mean_d * mean_d);
+    return s;
+}
+
+void ValueScanner::add_column(Column const& col, int first, int count)
+{
+    double buf[1024];
+    for (int i = 0; i < count; i += 1024) {
+        int n = std::min(1024, count - i);
+        col.get_values(first + i, n, buf);
+        add(buf, n);
+    }
+}
+
+namespace {
+
+// Returns the first index for which pred(value) is true; pred must be false
+// for all points before this index and true for all points after it.
+// Starts searching from guess, which should be close.
+template<typename Pred>
+int step_partition_point(StepColumn const& col, double guess, Pred pred)
+{
+    const int n = col.count == -1 ? INT_MAX : col.count;
+    int i = (int) std::max(0., std::min(guess, (double) n)); // NaN -> 0
+    while (i > 0 && pred(col.start + col.get_step() * (i - 1)))
+        --i;
+    while (i < n && !pred(col.start + col.get_step() * i))
+        ++i;
+    return i;
+}
+
+} // anonymous namespace
+
+ColumnStats StepColumn::get_stats(int point_count) const
+{
+    assert (point_count != 0 || count != -1);
+    int n = (count == -1 ? point_count : count);
+    double step = get_step();
+    ColumnStats s;
+    s.count = n;
+    s.nan_count = 0;
+    s.order = get_sort_order();
+    if (n <= 0) {
+        s.min = s.max = s.sum = s.mean = s.variance = 0.;
+        return s;
+    }
+    double last = start + step * (n - 1);
+    s.min = std::min(start, last);
+    s.max = std::max(start, last);
+    s.mean = start + step * (n - 1) / 2.;
+    s.sum = s.mean * n;
+    // variance of 0, 1, ..., n-1 is (n^2-1)/12
+    s.variance = step * step * ((double) n * n - 1) / 12.;
+    return s;
+}
+
+int StepColumn::lower_bound(double x) const
+{
+    double step = get_step();
+    if (step <= 0 || x != x)
+        return (count != 0 && start >= x) ? 0 : count;
+    return step_partition_point(*this, ceil((x - start) / step),
+                                [x](double v) { return v >= x; });
+}
+
+pair<int, int> StepColumn::find_range(double lo, double hi) const
+{
+    double step = get_step();
+    if (!(lo <= hi) || count == 0)
+        return make_pair(0, 0);
+    if (step == 0)
+        return lo <= start && start <= hi ? make_pair(0, count)
+                                          : make_pair(0, 0);
+    int first, last;
+    if (step > 0) {
+        first = step_partition_point(*this, ceil((lo - start) / step),
+                                     [lo](double v) { return v >= lo; });
+        last = step_partition_point(*this, floor((hi - start) / step) + 1,
+                                    [hi](double v) { return v > hi; });
+    } else {
+        first = step_partition_point(*this, ceil((hi - start) / step),
+                                     [hi](double v) { return v <= hi; });
+        last = step_partition_point(*this, floor((lo - start) / step) + 1,
+                                    [lo](double v) { return v < lo; });
+    }
+    if (first >= last)
+        return make_pair(0, 0);
+    return make_pair(first, last);
+}
+
+void PolyColumn::get_values(int first, int count, double* out) const
+{
+    if (first < 0 || count < 0 || first + count > count_)
+        throw RunTimeError("point index out of range");
+    // Horner's scheme, with the loop over points innermost (vectorizable)
+    double t0 = first_ + first;
+    for (int i = 0; i < count; ++i)
+        out[i] = coef_.back();
+    for (int j = (int) coef_.size() - 2; j >= 0; --j) {
+        double c = coef_[j];
+        for (int i = 0; i < count; ++i)
+            out[i] = out[i] * (t0 + i) + c;
+    }
+}
+
+ColumnStats const& PolyColumn::calculate_stats() const
+{
+    return stats_.get([this]() {
+        ValueScanner vs;
+        vs.add_column(*this, 0, count_);
+        return vs.get_stats();
+    });
+}
+
+ColumnStats AffineColumn::get_stats(int point_count) const
+{
+    ColumnStats s = base_->get_stats(point_count);
+    double a = scale_ * s.min + offset_;
+    double b = scale_ * s.max + offset_;
+    s.min = std::min(a, b);
+    s.max = std::max(a, b);
+    s.sum = scale_ * s.sum + offset_ * (s.count - s.nan_count);
+    s.mean = scale_ * s.mean + offset_;
+    s.variance *= scale_ * scale_;
+    s.order = get_sort_order();
+    return s;
+}
+
+void AffineColumn::get_values(int first, int count, double* out) const
+{
+    base_->get_values(first, count, out);
+    for (int i = 0; i < count; ++i)
+        out[i] = scale_ * out[i] + offset_;
+}
+
+namespace {
+
+// Number of decimal places needed to print v, or -1 if it's more than 12.
+int decimal_places(double v, int start)
+{
+    static const double pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6,
+                                    1e7, 1e8, 1e9, 1e10, 1e11, 1e12 };
+    for (int d = start; d <= 12; ++d) {
+        double s = v * pow10[d];
+        if (fabs(s - floor(s + 0.5)) <= 1e-11 * (1 + fabs(s)))
+            return d;
+    }
+    return -1;
+}
+
+} // anonymous namespace
+
+StepColumn* compact_column(Column const& col)
+{
+    if (dynamic_cast<VecColumn const*>(&col) == NULL)
+        return NULL;
+    int n = col.get_point_count();
+    if (n < 2)
+        return NULL;
+    const double* x = static_cast<const double*>(col.get_raw_data());
+    if (!std::isfinite(x[0]) || !std::isfinite(x[n-1]))
+        return NULL;
+    double step = (x[n-1] - x[0]) / (n - 1);
+    double max_dev = 0.;
+    for (int i = 1; i < n - 1; ++i) {
+        double dev = fabs(x[i] - (x[0] + step * i));
+        if (!(dev <= 0.25 * fabs(step))) // handles NaN
+            return NULL;
+        max_dev = max(max_dev, dev);
+    }
+    // Values read from text files are not exactly evenly spaced,
+    // but they should be equal to start+i*step rounded to printed precision.
+    // Binary data (more than 12 decimal places) must be accurate.
+    int places = 0;
+    for (int i = 0; i < n && places != -1; ++i)
+        places = decimal_places(x[i], places);
+    double tol = places == -1 ? 1e-12 * max(fabs(x[0]), fabs(x[n-1]))
+                              : 0.5 * pow(10., -places);
+    if (max_dev > tol || (step != 0. && tol >= 0.5 * fabs(step)))
+        return NULL;
+    StepColumn *sc = new StepColumn(x[0], step, n);
+    sc->set_name(col.get_name());
+    return sc;
+}
+
+SliceColumn::SliceColumn(shared_ptr<const Column> const& base,
+                         int first, int count)
+    : ColumnWithName(base->get_step()), base_(base), first_(first),
+      count_(count)
+{
+    int base_count = base->get_point_count();
+    if (first < 0 || count < -1 ||
+            (base_count != -1 && (first > base_count ||
+                                  count > base_count - first)))
+        throw RunTimeError("slice out of range of the column");
+    if (count == -1 && base_count != -1)
+        count_ = base_count - first;
+    set_name(base->get_name());
+}
+
+void SliceColumn::get_values(int first, int count, double* out) const
+{
+    if (first < 0 || count < 0 || (count_ != -1 && first + count > count_))
+        throw RunTimeError("point index out of range");
+    base_->get_values(first_ + first, count, out);
+}
+
+const void* SliceColumn::get_raw_data() const
+{
+    const char* p = static_cast<const char*>(base_->get_raw_data());
+    if (p == NULL || count_ == 0)
+        return NULL;
+    return p + (size_t) first_ * get_dtype_size(base_->get_dtype());
+}
+
+ColumnStats const& SliceColumn::calculate_stats() const
+{
+    return stats_.get([this]() {
+        ValueScanner vs;
+        vs.add_column(*this, 0, count_);
+        return vs.get_stats();
+    });
+}
+
+int SliceColumn::get_sort_order() const
+{
+    if (count_ == -1)
+        return base_->get_sort_order();
+    return calculate_stats().order;
+}
 
-    if (data.empty()) {
-        min_val = max_val = 0.;
+ColumnStats SliceColumn::get_stats(int point_count) const
+{
+    if (count_ == -1)
+        return Column::get_stats(point_count);
+    return calculate_stats();
+}
+
+double SliceColumn::get_min() const
+{
+    if (count_ == -1) // slice of generator, only non-negative step supported
+        return get_value(0);
+    return calculate_stats().min;
+}
+
+double SliceColumn::get_max(int point_count) const
+{
+    if (count_ == -1) {
+        assert(point_count != 0);
+        return get_value(point_count - 1);
+    }
+    return calculate_stats().max;
+}
+
+ConcatColumn::ConcatColumn(vector<shared_ptr<const Column> > const& parts)
+    : ColumnWithName(0.), parts_(parts)
+{
+    if (parts.empty())
+        throw RunTimeError("no columns to concatenate");
+    offsets_.push_back(0);
+    for (size_t i = 0; i != parts.size(); ++i) {
+        int n = parts[i]->get_point_count();
+        if (n == -1)
+            throw RunTimeError("can't concatenate column of unlimited length");
+        offsets_.push_back(offsets_.back() + n);
+    }
+    set_name(parts[0]->get_name());
+}
+
+double ConcatColumn::get_value(int n) const
+{
+    if (n < 0 || n >= offsets_.back())
+        throw RunTimeError("point index out of range");
+    // find the last part that starts at or before n
+    size_t k = upper_bound(offsets_.begin(), offsets_.end(), n)
+               - offsets_.begin() - 1;
+    return parts_[k]->get_value(n - offsets_[k]);
+}
+
+void ConcatColumn::get_values(int first, int count, double* out) const
+{
+    if (first < 0 || count < 0 || first + count > offsets_.back())
+        throw RunTimeError("point index out of range");
+    size_t k = upper_bound(offsets_.begin(), offsets_.end(), first)
+               - offsets_.begin() - 1;
+    while (count > 0) {
+        int pos = first - offsets_[k];
+        int n = std::min(count, offsets_[k+1] - first);
+        if (n > 0) {
+            parts_[k]->get_values(pos, n, out);
+            out += n;
+            first += n;
+            count -= n;
+        }
+        ++k;
+    }
+}
+
+double ConcatColumn::get_min() const
+{
+    double r = 0.;
+    bool first = true;
+    for (size_t i = 0; i != parts_.size(); ++i)
+        if (offsets_[i+1] != offsets_[i]) {
+            double v = parts_[i]->get_min();
+            if (first || v < r)
+                r = v;
+            first = false;
+        }
+    return r;
+}
+
+double ConcatColumn::get_max(int /*point_count*/) const
+{
+    double r = 0.;
+    bool first = true;
+    for (size_t i = 0; i != parts_.size(); ++i)
+        if (offsets_[i+1] != offsets_[i]) {
+            double v = parts_[i]->get_max();
+            if (first || v > r)
+                r = v;
+            first = false;
+        }
+    return r;
+}
+
+vector<shared_ptr<const Column> > matrix_rows(
+                shared_ptr<const Column> const& data, int row_len,
+                int row_count, int first, int count,
+                string const& name, int number)
+{
+    shared_ptr<vector<SliceColumn> > views =
+                                    make_shared<vector<SliceColumn> >();
+    views->reserve(row_count);
+    for (int i = 0; i < row_count; ++i) {
+        views->push_back(SliceColumn(data, i * row_len + first, count));
+        views->back().set_name(name + " " + S(number + i));
+    }
+    // aliasing constructor: the views share ownership of the array
+    vector<shared_ptr<const Column> > rows(row_count);
+    for (int i = 0; i < row_count; ++i)
+        rows[i] = shared_ptr<const Column>(views, &(*views)[i]);
+    return rows;
+}
+
+namespace {
+
+// FNV-1a
+size_t hash_bytes(const void* data, size_t len, size_t h)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i != len; ++i)
+        h = (h ^ p[i]) * 1099511628211ULL;
+    return h;
+}
+
+size_t hash_column(Column const& c)
+{
+    size_t h = 14695981039346656037ULL;
+    h = hash_bytes(c.get_name().data(), c.get_name().size(), h);
+    int n = c.get_point_count();
+    h = hash_bytes(&n, sizeof(n), h);
+    if (n == -1) { // generator, it's defined by the first value and step
+        double v[2] = { c.get_value(0), c.get_step() };
+        return hash_bytes(v, sizeof(v), h);
+    }
+    double buf[1024];
+    for (int i = 0; i < n; i += 1024) {
+        int k = std::min(1024, n - i);
+        c.get_values(i, k, buf);
+        h = hash_bytes(buf, k * sizeof(double), h);
+    }
+    return h;
+}
+
+bool columns_equal(Column const& a, Column const& b)
+{
+    if (a.get_name() != b.get_name())
+        return false;
+    int n = a.get_point_count();
+    if (b.get_point_count() != n)
+        return false;
+    if (n == -1)
+        return a.get_value(0) == b.get_value(0) && a.get_step() == b.get_step();
+    double buf_a[512], buf_b[512];
+    for (int i = 0; i < n; i += 512) {
+        int k = std::min(512, n - i);
+        a.get_values(i, k, buf_a);
+        b.get_values(i, k, buf_b);
+        if (memcmp(buf_a, buf_b, k * sizeof(double)) != 0)
+            return false;
+    }
+    return true;
+}
+
+} // anonymous namespace
+
+shared_ptr<Column> ColumnPool::share(Column* col)
+{
+    size_t h = hash_column(*col);
+    typedef multimap<size_t, shared_ptr<Column> >::const_iterator iter;
+    pair<iter, iter> range = cols_.equal_range(h);
+    for (iter i = range.first; i != range.second; ++i)
+        if (columns_equal(*i->second, *col)) {
+            delete col;
+            return i->second;
+        }
+    shared_ptr<Column> ptr(col);
+    cols_.insert(make_pair(h, ptr));
+    return ptr;
+}
+
+namespace {
+thread_local bool is_parallel_worker = false;
+}
+
+ParallelWorker::ParallelWorker() : prev_(is_parallel_worker)
+{
+    is_parallel_worker = true;
+}
+
+ParallelWorker::~ParallelWorker()
+{
+    is_parallel_worker = prev_;
+}
+
+bool ParallelWorker::in_worker()
+{
+    return is_parallel_worker;
+}
+
+void parallel_for(size_t n, function<void (size_t)> const& f)
+{
+    size_t n_threads = std::thread::hardware_concurrency();
+    if (n_threads > n)
+        n_threads = n;
+    if (n_threads <= 1 || is_parallel_worker) {
+        for (size_t i = 0; i < n; ++i)
+            f(i);
         return;
     }
-    min_val = max_val = data[0];
-    for (vector<double>::const_iterator i = data.begin() + 1; i != data.end();
-                                                                         ++i) {
-        if (*i < min_val)
-            min_val = *i;
-        if (*i > max_val)
-            max_val = *i;
+    std::atomic<size_t> next(0);
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    auto work = [&] {
+        ParallelWorker worker;
+        try {
+            for (size_t i = next++; i < n; i = next++)
+                f(i);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error)
+                error = std::current_exception();
+            next = n; // skip the rest
+        }
+    };
+    vector<std::thread> threads;
+    for (size_t t = 1; t < n_threads; ++t) {
+        try {
+            threads.push_back(std::thread(work));
+        } catch (std::system_error&) {
+            break; // continue with fewer threads
+        }
     }
-    last_minmax_length = (int) data.size();
+    work(); // the calling thread works too
+    for (size_t t = 0; t < threads.size(); ++t)
+        threads[t].join();
+    if (error)
+        std::rethrow_exception(error);
 }
 
-} } // namespace xylib::util
+void parallel_for_ordered(size_t n, function<void (size_t)> const& f)
+{
+    vector<std::exception_ptr> errors(n);
+    std::atomic<size_t> first_error(n);
+    parallel_for(n, [&](size_t i) {
+        if (i > first_error) // it wouldn't be reached in sequential loop
+            return;
+        try {
+            f(i);
+        } catch (...) {
+            errors[i] = std::current_exception();
+            size_t prev = first_error;
+            while (i < prev && !first_error.compare_exchange_weak(prev, i))
+                ;
+        }
+    });
+    if (first_error < n)
+        std::rethrow_exception(errors[first_error]);
+}
 
+} } // namespace xylib::util
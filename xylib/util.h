@@ -4,13 +4,32 @@
 #ifndef XYLIB_UTIL_H_
 #define XYLIB_UTIL_H_
 
+#include <algorithm>  // min
+#include <atomic>
 #include <cassert>
 #include <cmath>    // floor
+#include <cstdint>
 #include <cstdio>   // snprintf
 #include <cstring>  // memcpy
 #include <fstream>
+#include <functional>
+#include <map>
+#include <memory>  // for shared_ptr
 #include <string>
+#include <type_traits>
 #include <vector>
+#include <boost/version.hpp>
+#if BOOST_VERSION >= 106500
+#include <boost/predef/other/endian.h>
+#if !BOOST_ENDIAN_LITTLE_BYTE && !BOOST_ENDIAN_BIG_BYTE
+# error "Unknown endianness"
+#endif
+#else
+#include <boost/detail/endian.hpp>
+#if !defined(BOOST_LITTLE_ENDIAN) && !defined(BOOST_BIG_ENDIAN)
+# error "Unknown endianness"
+#endif
+#endif
 
 #include "xylib.h"
 
@@ -18,6 +37,13 @@
 #pragma warning (disable : 4996) // _snprintf may be unsafe
 #endif
 
+#if defined(BOOST_BIG_ENDIAN) || \
+    (defined(BOOST_ENDIAN_BIG_BYTE) && BOOST_ENDIAN_BIG_BYTE)
+# define XYLIB_BIG_ENDIAN 1
+#else
+# define XYLIB_BIG_ENDIAN 0
+#endif
+
 namespace xylib { namespace util {
 
 void le_to_host(void *ptr, int size);
@@ -30,8 +56,21 @@ float read_flt_le(std::istream &f);
 double read_dbl_le(std::istream &f);
 int read_int32_be(std::istream &f);
 
+// The same as above, but without exceptions: return false at EOF.
+// Used in format checks, where a short file is not an error.
+bool read_uint32_le(std::istream &f, unsigned int *val);
+bool read_int32_le(std::istream &f, int *val);
+bool read_uint16_le(std::istream &f, unsigned int *val);
+bool read_int16_le(std::istream &f, int *val);
+bool read_flt_le(std::istream &f, float *val);
+bool read_dbl_le(std::istream &f, double *val);
+bool read_int32_be(std::istream &f, int *val);
+
 char read_char(std::istream &f);
 std::string read_string(std::istream &f, unsigned len);
+// returns shorter string at EOF instead of throwing exception
+// (useful in format checks)
+std::string read_string_nothrow(std::istream &f, unsigned len);
 
 template<typename T>
 T from_le(const char* p)
@@ -42,6 +81,91 @@ T from_le(const char* p)
     return val;
 }
 
+// Bulk decoding of binary arrays. Conversion to double (the most common
+// case) has SSE2 kernels, other loops are kept simple enough for compilers
+// to vectorize them.
+template<int N> struct UIntOfSize {};
+template<> struct UIntOfSize<2> { typedef uint16_t type; };
+template<> struct UIntOfSize<4> { typedef uint32_t type; };
+template<> struct UIntOfSize<8> { typedef uint64_t type; };
+
+inline uint16_t byte_swap(uint16_t x) { return (uint16_t) (x >> 8 | x << 8); }
+inline uint32_t byte_swap(uint32_t x)
+{
+    return x >> 24 | (x >> 8 & 0xff00) | (x << 8 & 0xff0000) | x << 24;
+}
+inline uint64_t byte_swap(uint64_t x)
+{
+    return (uint64_t) byte_swap((uint32_t) x) << 32
+           | byte_swap((uint32_t) (x >> 32));
+}
+
+template<typename T> struct DTypeOf {};
+template<> struct DTypeOf<double> { static const DataType value = DT_FLOAT64; };
+template<> struct DTypeOf<float> { static const DataType value = DT_FLOAT32; };
+template<> struct DTypeOf<int32_t> { static const DataType value = DT_INT32; };
+template<> struct DTypeOf<uint32_t> { static const DataType value = DT_UINT32; };
+template<> struct DTypeOf<int16_t> { static const DataType value = DT_INT16; };
+template<> struct DTypeOf<uint16_t> { static const DataType value = DT_UINT16; };
+
+/// Converts n numbers of type dt, stored at p as little-endian (or
+/// big-endian if big_endian is set), to doubles. Uses SSE2 if available.
+void decode_to_double(const char* p, size_t n, DataType dt, bool big_endian,
+                      double* out);
+
+/// Converts n numbers of type T, stored at p as little-endian (or
+/// big-endian if big_endian is set), to type U. p may be equal to out
+/// if T and U have the same size.
+template<typename T, typename U>
+void decode_array(const char* p, size_t n, U* out, bool big_endian=false)
+{
+    typedef typename UIntOfSize<sizeof(T)>::type uint_type;
+    if (big_endian == (bool) XYLIB_BIG_ENDIAN) {
+        if (std::is_same<T, U>::value) {
+            if (p != reinterpret_cast<char*>(out))
+                std::memcpy(out, p, n * sizeof(T));
+            return;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            T val;
+            std::memcpy(&val, p + i * sizeof(T), sizeof(T));
+            out[i] = static_cast<U>(val);
+        }
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            uint_type u;
+            std::memcpy(&u, p + i * sizeof(T), sizeof(T));
+            u = byte_swap(u);
+            T val;
+            std::memcpy(&val, &u, sizeof(T));
+            out[i] = static_cast<U>(val);
+        }
+    }
+}
+
+template<typename T>
+void decode_array(const char* p, size_t n, double* out, bool big_endian=false)
+{
+    decode_to_double(p, n, DTypeOf<T>::value, big_endian, out);
+}
+
+/// Reads n numbers of type T with one read() call and converts them
+/// to type U (see decode_array()).
+template<typename T, typename U>
+void read_array(std::istream &f, size_t n, U* out, bool big_endian=false)
+{
+    std::vector<char> tmp;
+    char *p = reinterpret_cast<char*>(out);
+    if (!std::is_same<T, U>::value) {
+        tmp.resize(n * sizeof(T));
+        p = tmp.empty() ? NULL : &tmp[0];
+    }
+    f.read(p, n * sizeof(T));
+    if (f.gcount() < (std::streamsize) (n * sizeof(T)))
+        throw FormatError("unexpected eof");
+    decode_array<T>(p, n, out, big_endian);
+}
+
 double from_pdp11(const unsigned char* p);
 
 std::string str_trim(std::string const& str);
@@ -51,6 +175,65 @@ inline bool str_startwith(const std::string &str, const std::string &prefix) {
     return str.compare(0, prefix.size(), prefix) == 0;
 }
 
+/// Non-owning reference to a part of string (like std::string_view,
+/// which is not used because xylib can be compiled as C++11).
+class StrView
+{
+public:
+    static const size_t npos = size_t(-1);
+
+    StrView() : p_(NULL), n_(0) {}
+    StrView(const char* p, size_t n) : p_(p), n_(n) {}
+    StrView(const char* begin, const char* end) : p_(begin), n_(end - begin) {}
+    StrView(const char* s) : p_(s), n_(strlen(s)) {}
+    StrView(std::string const& s) : p_(s.data()), n_(s.size()) {}
+
+    const char* data() const { return p_; }
+    size_t size() const { return n_; }
+    bool empty() const { return n_ == 0; }
+    const char* begin() const { return p_; }
+    const char* end() const { return p_ + n_; }
+    char operator[](size_t i) const { return p_[i]; }
+    std::string str() const { return std::string(p_, n_); }
+    StrView substr(size_t pos, size_t n=npos) const
+        { return StrView(p_ + pos, std::min(n, n_ - pos)); }
+    size_t find(char c, size_t pos=0) const
+    {
+        const void* r = pos < n_ ? memchr(p_ + pos, c, n_ - pos) : NULL;
+        return r ? (const char*) r - p_ : npos;
+    }
+    size_t rfind(char c) const
+    {
+        for (size_t i = n_; i != 0; --i)
+            if (p_[i-1] == c)
+                return i - 1;
+        return npos;
+    }
+    size_t find_first_of(const char* chars, size_t pos=0) const
+    {
+        for (size_t i = pos; i < n_; ++i)
+            if (strchr(chars, p_[i]) != NULL && p_[i] != '\0')
+                return i;
+        return npos;
+    }
+
+private:
+    const char* p_;
+    size_t n_;
+};
+
+inline bool operator==(StrView a, StrView b)
+    { return a.size() == b.size() && memcmp(a.data(), b.data(), a.size()) == 0; }
+inline bool operator!=(StrView a, StrView b) { return !(a == b); }
+
+// versions of the functions above that don't copy strings
+StrView str_trim(StrView str);
+void str_split(StrView line, char sep, StrView* key, StrView* val);
+inline bool str_startwith(StrView str, StrView prefix) {
+    return str.size() >= prefix.size() &&
+           memcmp(str.data(), prefix.data(), prefix.size()) == 0;
+}
+
 std::string str_tolower(const std::string &str);
 bool has_word(const std::string &sentence, const std::string &word);
 
@@ -64,6 +247,15 @@ Block* read_ssel_and_data(std::istream &f, int max_headers=0);
 
 long my_strtol(const std::string &str);
 double my_strtod(const std::string &str);
+/// my_strtod() for the number in [p, p+len), not NUL-terminated
+double my_strtod(const char* p, size_t len);
+/// The same as my_strtol() and my_strtod(), but without exceptions:
+/// return NULL on success or error message.
+const char* parse_long(const std::string &str, long *val);
+const char* parse_double(const std::string &str, double *val);
+const char* parse_double(const char* p, size_t len, double *val);
+/// the same as strtod(), but faster for typical numbers
+double fast_strtod(const char* p, char** endptr);
 
 inline bool is_numeric(int c) {
     return (c >= '0' && c <= '9') || c=='+' ||  c=='-' || c=='.';
@@ -114,6 +306,7 @@ void purge_all_elements(std::vector<T*> &vec)
 /// returns the first not processed character (from s.c_str())
 const char* read_numbers(std::string const& s,
                          std::vector<double>& row);
+const char* read_numbers(StrView s, std::vector<double>& row);
 // split block if it has columns with different sizes
 std::vector<Block*> split_on_column_length(Block* block);
 
@@ -136,6 +329,101 @@ __attribute__((format(printf, 1, 2)))
 #endif
 void warn(const char *fmt, ...);
 
+/// Value computed when it's needed for the first time, in const function.
+/// Datasets are read by many threads at once (e.g. from Cache), so the value
+/// is published with compare-and-swap: if two threads compute it at
+/// the same time, one result is discarded and both return the other one.
+/// No locks are used and readers never see a partially written value.
+template<typename T>
+class LazyValue
+{
+public:
+    LazyValue() : ptr_(NULL) {}
+    LazyValue(const LazyValue& other) : ptr_(other.copy()) {}
+    LazyValue(LazyValue&& other) noexcept : ptr_(other.release()) {}
+    ~LazyValue() { delete ptr_.load(std::memory_order_relaxed); }
+    // not thread-safe (like all non-const functions)
+    void operator=(const LazyValue& other) { reset(); ptr_ = other.copy(); }
+    void operator=(LazyValue&& other) noexcept
+    {
+        reset();
+        ptr_.store(other.release(), std::memory_order_relaxed);
+    }
+    void reset()
+    {
+        if (T* p = ptr_.load(std::memory_order_relaxed)) {
+            ptr_.store(NULL, std::memory_order_relaxed);
+            delete p;
+        }
+    }
+
+    // compute is called if the value was not set yet; it returns T
+    template<typename F>
+    T const& get(F compute) const
+    {
+        T* p = ptr_.load(std::memory_order_acquire);
+        if (p == NULL) {
+            T* fresh = new T(compute());
+            if (ptr_.compare_exchange_strong(p, fresh,
+                                             std::memory_order_acq_rel,
+                                             std::memory_order_acquire))
+                p = fresh;
+            else // other thread was faster, p was set to its value
+                delete fresh;
+        }
+        return *p;
+    }
+
+private:
+    mutable std::atomic<T*> ptr_;
+
+    T* copy() const
+    {
+        T* p = ptr_.load(std::memory_order_acquire);
+        return p ? new T(*p) : NULL;
+    }
+
+    T* release() noexcept
+    {
+        return ptr_.exchange(NULL, std::memory_order_relaxed);
+    }
+};
+
+// calculates ColumnStats of a sequence of values, in one pass
+class ValueScanner
+{
+public:
+    ValueScanner();
+
+    void add(const double* p, size_t count);
+    template<typename T>
+    void add(const T* p, size_t count)
+    {
+        double buf[512];
+        for (size_t i = 0; i < count; i += 512) {
+            size_t n = std::min<size_t>(512, count - i);
+            for (size_t j = 0; j != n; ++j)
+                buf[j] = p[i+j];
+            add(buf, n);
+        }
+    }
+
+    // reads values of the column in chunks
+    void add_column(Column const& col, int first, int count);
+
+    ColumnStats get_stats() const;
+
+private:
+    size_t n_, nan_count_;
+    bool asc_, desc_;
+    double min_, max_, last_;
+    // sums of v-shift and (v-shift)^2, shift is the first value (not NaN)
+    bool has_shift_;
+    double shift_, sum_, sumsq_;
+
+    void add_scalar(double v);
+};
+
 class ColumnWithName : public Column
 {
 public:
@@ -150,11 +438,13 @@ private:
     std::string name_;
 };
 
-// column uses vector<double> to represent the data
-class VecColumn : public ColumnWithName
+// column uses vector<T> to represent the data, values are kept in the type
+// in which they are stored in the file
+template<typename T>
+class TypedVecColumn : public ColumnWithName
 {
 public:
-    VecColumn() : ColumnWithName(0.), last_minmax_length(-1) {}
+    TypedVecColumn() : ColumnWithName(0.), scanned_(0) {}
 
     // implementation of the base interface
     int get_point_count() const { return (int) data.size(); }
@@ -164,19 +454,97 @@ public:
             throw RunTimeError("index out of range in VecColumn");
         return data[n];
     }
+    DataType get_dtype() const { return DTypeOf<T>::value; }
+    const void* get_raw_data() const
+        { return data.empty() ? NULL : &data[0]; }
+    void get_values(int first, int count, double* out) const
+    {
+        if (first < 0 || count < 0 || first + count > get_point_count())
+            throw RunTimeError("index out of range in VecColumn");
+        const T* p = count > 0 ? &data[first] : NULL;
+        for (int i = 0; i < count; ++i)
+            out[i] = p[i];
+    }
+    double get_min() const { return get_stats().min; }
+    double get_max(int /*point_count*/=0) const { return get_stats().max; }
+    int get_sort_order() const { return get_stats().order; }
+    ColumnStats get_stats(int /*point_count*/=0) const
+    {
+        return stats_.get([this]() {
+            // values scanned when the column was loaded are not scanned again
+            ValueScanner vs = scanner_;
+            if (scanned_ < data.size())
+                vs.add(&data[scanned_], data.size() - scanned_);
+            return vs.get_stats();
+        });
+    }
 
-    void add_val(double val) { data.push_back(val); }
-    void add_values_from_str(std::string const& str, char sep=' ');
-    double get_min() const;
-    double get_max(int point_count=0) const;
+    void add_val(T val) { data.push_back(val); stats_.reset(); }
     void reserve(size_t n) { data.reserve(n); }
+    void shrink_to_fit() { data.shrink_to_fit(); }
+    /// removes values after the first n
+    void truncate(size_t n)
+    {
+        if (n >= data.size())
+            return;
+        data.resize(n);
+        stats_.reset();
+        if (scanned_ > n) {
+            scanner_ = ValueScanner();
+            scanned_ = 0;
+        }
+    }
+
+    /// appends n zeros and returns pointer to the first of them, so that
+    /// the caller can fill them
+    T* extend(size_t n)
+    {
+        size_t old_size = data.size();
+        data.resize(old_size + n);
+        stats_.reset();
+        return n != 0 ? &data[old_size] : NULL;
+    }
+
+    /// reads count little-endian values from f and appends them;
+    /// it's done in chunks, so a count from a corrupted file doesn't cause
+    /// a huge allocation before the end of file is reached
+    void add_values_from_le(std::istream &f, size_t count)
+    {
+        const size_t chunk = 65536;
+        for (size_t i = 0; i < count; i += chunk) {
+            size_t n = std::min(chunk, count - i);
+            read_array<T>(f, n, extend(n));
+            // it's cheap now, when the data is in cache
+            scanner_.add(&data[scanned_], data.size() - scanned_);
+            scanned_ = data.size();
+        }
+    }
 
 protected:
-    std::vector<double> data;
-    mutable double min_val, max_val;
-    mutable int last_minmax_length;
+    std::vector<T> data;
+    // statistics of the first scanned_ values, calculated when loading
+    ValueScanner scanner_;
+    size_t scanned_;
+    LazyValue<ColumnStats> stats_;
+};
 
-    void calculate_min_max() const;
+// column of doubles
+class VecColumn : public TypedVecColumn<double>
+{
+public:
+    void add_values_from_str(std::string const& str, char sep=' ');
+    /// the same, for line that is followed by EOL or NUL
+    void add_values_from_str(StrView line, char sep=' ');
+
+    /// Parses numbers written in lines of text [p, end), one number per line
+    /// (the rest of the line is ignored, as in my_strtod()) or, if sep is
+    /// given, any count of numbers separated by blanks or sep.
+    /// Reads line_count lines, or all lines if line_count is -1 (then blank
+    /// lines at the end are ignored). Only every stride-th line, starting
+    /// from the first one, is parsed. Returns pointer after the last line.
+    const char* add_values_from_lines(const char* p, const char* end,
+                                      int line_count=-1, int stride=1,
+                                      char sep=0);
 };
 
 
@@ -187,7 +555,8 @@ public:
     double start;
     int count; // -1 means unlimited...
 
-    // get_min() and get_max() work properly only if step_ >= 0
+    // if count_ is -1, get_min() and get_max() work properly only
+    // if step_ >= 0
     StepColumn(double start_, double step_, int count_ = -1)
         : ColumnWithName(step_), start(start_), count(count_)
     {}
@@ -199,13 +568,215 @@ public:
             throw RunTimeError("point index out of range");
         return start + get_step() * n;
     }
-    double get_min() const { return start; }
+    double get_min() const
+    {
+        if (get_step() < 0 && count > 0)
+            return get_value(count-1);
+        return start;
+    }
     double get_max(int point_count=0) const
     {
+        if (get_step() < 0 && count > 0)
+            return start;
         assert (point_count != 0 || count != -1);
         int n = (count == -1 ? point_count : count);
         return get_value(n-1);
     }
+    int get_sort_order() const { return get_step() < 0 ? -1 : 1; }
+    ColumnStats get_stats(int point_count=0) const;
+    int lower_bound(double x) const;
+    std::pair<int, int> find_range(double lo, double hi) const;
+};
+
+/// If values of VecColumn col are evenly spaced (up to the precision with
+/// which they were printed), returns equivalent StepColumn with the same
+/// name. Otherwise, returns NULL.
+StepColumn* compact_column(Column const& col);
+
+// column with values of polynomial c0 + c1*t + c2*t^2 + ...,
+// where t = first_index + point index (used for calibrations)
+class PolyColumn : public ColumnWithName
+{
+public:
+    PolyColumn(std::vector<double> const& coef, double first_index, int count)
+        : ColumnWithName(0.), coef_(coef), first_(first_index), count_(count)
+    { assert(!coef.empty()); }
+
+    int get_point_count() const { return count_; }
+    double get_value(int n) const
+    {
+        if (n < 0 || n >= count_)
+            throw RunTimeError("point index out of range");
+        double t = first_ + n;
+        double val = coef_.back();
+        for (int j = (int) coef_.size() - 2; j >= 0; --j)
+            val = val * t + coef_[j];
+        return val;
+    }
+    void get_values(int first, int count, double* out) const;
+    double get_min() const { return calculate_stats().min; }
+    double get_max(int /*point_count*/=0) const
+        { return calculate_stats().max; }
+    int get_sort_order() const { return calculate_stats().order; }
+    ColumnStats get_stats(int /*point_count*/=0) const
+        { return calculate_stats(); }
+
+private:
+    std::vector<double> coef_;
+    double first_;
+    int count_;
+    LazyValue<ColumnStats> stats_;
+
+    ColumnStats const& calculate_stats() const;
+};
+
+// column with values scale * v + offset, where v are values of other column;
+// the other column is owned by this column
+class AffineColumn : public ColumnWithName
+{
+public:
+    AffineColumn(Column* base, double scale, double offset)
+        : ColumnWithName(base->get_step() * scale), base_(base),
+          scale_(scale), offset_(offset) {}
+    ~AffineColumn() { delete base_; }
+
+    int get_point_count() const { return base_->get_point_count(); }
+    double get_value(int n) const
+        { return scale_ * base_->get_value(n) + offset_; }
+    void get_values(int first, int count, double* out) const;
+    double get_min() const
+    {
+        return scale_ >= 0 ? scale_ * base_->get_min() + offset_
+                           : scale_ * base_->get_max() + offset_;
+    }
+    double get_max(int point_count=0) const
+    {
+        return scale_ >= 0 ? scale_ * base_->get_max(point_count) + offset_
+                           : scale_ * base_->get_min() + offset_;
+    }
+    int get_sort_order() const
+    {
+        int order = base_->get_sort_order();
+        return scale_ > 0 ? order : (scale_ < 0 ? -order : 1);
+    }
+    ColumnStats get_stats(int point_count=0) const;
+
+private:
+    Column* base_;
+    double scale_;
+    double offset_;
+
+    AffineColumn(const AffineColumn&); // disallow
+    void operator=(const AffineColumn&); // disallow
+};
+
+// view of count values of other column, starting from first
+// (count -1 means all values to the end of the base column)
+class SliceColumn : public ColumnWithName
+{
+public:
+    SliceColumn(std::shared_ptr<const Column> const& base, int first, int count);
+
+    int get_point_count() const { return count_; }
+    double get_value(int n) const
+    {
+        if (n < 0 || (count_ != -1 && n >= count_))
+            throw RunTimeError("point index out of range");
+        return base_->get_value(first_ + n);
+    }
+    void get_values(int first, int count, double* out) const;
+    double get_min() const;
+    double get_max(int point_count=0) const;
+    int get_sort_order() const;
+    ColumnStats get_stats(int point_count=0) const;
+    DataType get_dtype() const { return base_->get_dtype(); }
+    const void* get_raw_data() const;
+
+    std::shared_ptr<const Column> const& base() const { return base_; }
+    int first() const { return first_; }
+
+private:
+    std::shared_ptr<const Column> base_;
+    int first_;
+    int count_;
+    LazyValue<ColumnStats> stats_;
+
+    ColumnStats const& calculate_stats() const;
+};
+
+// view of values of a few columns, one after another
+class ConcatColumn : public ColumnWithName
+{
+public:
+    explicit ConcatColumn(
+                std::vector<std::shared_ptr<const Column> > const& parts);
+
+    int get_point_count() const { return offsets_.back(); }
+    double get_value(int n) const;
+    void get_values(int first, int count, double* out) const;
+    double get_min() const;
+    double get_max(int point_count=0) const;
+
+private:
+    std::vector<std::shared_ptr<const Column> > parts_;
+    std::vector<int> offsets_; // offsets_[i] is index of first value of part i
+};
+
+/// Returns views of row_count rows of a matrix stored row by row in data,
+/// row_len values per row. Each view has count values, starting from
+/// the first-th value of the row, and is named name + " " + (number + i).
+/// All views are kept in one array that shares ownership of data,
+/// so a matrix with many short rows doesn't need an allocation per row.
+std::vector<std::shared_ptr<const Column> > matrix_rows(
+                std::shared_ptr<const Column> const& data, int row_len,
+                int row_count, int first, int count,
+                std::string const& name, int number);
+
+/// Used by loaders to share equal columns (e.g. the same calibration
+/// in every frame) between blocks.
+class ColumnPool
+{
+public:
+    /// Returns column from the pool that has the same name and values as col
+    /// (col is deleted then), or col itself (col is added to the pool).
+    std::shared_ptr<Column> share(Column* col);
+
+private:
+    std::multimap<size_t, std::shared_ptr<Column> > cols_;
+};
+
+/// Calls f(0), ..., f(n-1) from a few threads (at most one per core).
+/// The calls can be made in any order. If f throws, the remaining calls
+/// may be skipped and the exception is rethrown in the calling thread.
+/// Calls from a worker thread (see ParallelWorker) run sequentially,
+/// so nested loops don't multiply the number of threads.
+void parallel_for(size_t n, std::function<void (size_t)> const& f);
+
+/// The same as parallel_for(), but if calls throw, the exception from
+/// the call with the smallest i is rethrown, as in a sequential loop.
+/// Used to parse independent sections of a file in parallel.
+void parallel_for_ordered(size_t n, std::function<void (size_t)> const& f);
+
+/// Thrown by a parser of a file section (called from parallel_for_ordered())
+/// if the section can't be parsed without the state left by the previous
+/// sections. The caller then parses the whole file sequentially.
+/// It's not a std::exception, so it's not taken for an error in the file.
+struct IrregularSection {};
+
+/// Text files smaller than this are parsed sequentially; for them finding
+/// sections and starting threads costs more than it saves.
+const size_t min_parallel_parse_size = 256 * 1024;
+
+/// Marks the current thread as a worker of a parallel loop (or of
+/// load_files()) as long as the object exists.
+class ParallelWorker
+{
+public:
+    ParallelWorker();
+    ~ParallelWorker();
+    static bool in_worker();
+private:
+    bool prev_;
 };
 
 } } // namespace xylib::util
@@ -6,8 +6,10 @@
 
 #include <cerrno>
 #include <cstdlib>
+#include <vector>
 
 #include "util.h"
+#include "fileio.h"
 
 using namespace std;
 using namespace xylib::util;
@@ -69,104 +71,229 @@ Later versions of this format are more complicated.
 In particular, two column data, e.g. angle and counts, are supported.
 */
 
-// get all numbers in the first legal line
+// get all numbers in the line
 // sep is _optional_ separator that can be used in addition to white space
 static
-void add_values_from_str(string const& str, char sep,
-                         VecColumn** cols, int ncols)
+void add_values_from_str(StrView line, char sep, VecColumn** cols, int ncols)
 {
-    const char* p = str.c_str();
-    while (isspace(*p) || *p == sep)
+    const char* p = line.begin();
+    const char* end = line.end();
+    while (p != end && (isspace((unsigned char) *p) || *p == sep))
         ++p;
     int n = 0;
-    while (*p != 0) {
+    while (p != end) {
         char *endptr = NULL;
         errno = 0; // To distinguish success/failure after call
-        double val = strtod(p, &endptr);
+        double val = fast_strtod(p, &endptr);
         if (p == endptr)
-            throw(xylib::FormatError("Number not found in line:\n" + str));
+            throw(xylib::FormatError("Number not found in line:\n"
+                                     + line.str()));
         if (errno != 0)
             throw(xylib::FormatError("Numeric overflow or underflow in line:\n"
-                                     + str));
+                                     + line.str()));
         cols[n]->add_val(val);
         ++n;
         if (n == ncols)
             n = 0;
         p = endptr;
-        while (isspace(*p) || *p == sep)
+        while (p != end && (isspace((unsigned char) *p) || *p == sep))
             ++p;
     }
 }
 
-void UxdDataSet::load_data(std::istream &f, const char*)
+namespace {
+
+// Parses lines of UXD file. Sections that start with _DRIVE can be parsed
+// by separate parsers (in_section=true) if each of them has all the
+// parameters it needs and one _COUNT or _2THETACOUNTS keyword before data.
+class UxdParser
 {
-    Block *blk = NULL;
-    VecColumn* cols[2] = { NULL, NULL };
-    int ncols = 0;
-    string line;
-    double start=0., step=0.;
-    bool peak_list = false;
+public:
+    UxdParser(const DataSet* ds, bool in_section)
+        : ds_(ds), in_section_(in_section), blk_(NULL), blk_added_(false),
+          ncols_(0), start_(0.), step_(0.), has_start_(false),
+          has_step_(false), peak_list_(false)
+    {
+        cols_[0] = cols_[1] = NULL;
+    }
+
+    ~UxdParser()
+    {
+        purge_all_elements(blocks_);
+        if (!blk_added_)
+            delete blk_;
+    }
+
+    // file-scope parameters (before the first _DRIVE) are put into ds_meta
+    void parse(LineReader& reader, MetaData* ds_meta);
 
-    while (get_valid_line(f, line, ';')) {
+    bool has_drive() const { return blk_ != NULL; }
+
+    // moves parsed blocks to out
+    void take_blocks(vector<Block*>& out)
+    {
+        out.insert(out.end(), blocks_.begin(), blocks_.end());
+        blocks_.clear();
+    }
+
+private:
+    const DataSet* ds_;
+    bool in_section_;
+    vector<Block*> blocks_;
+    Block *blk_;
+    bool blk_added_; // if blk_ is in blocks_
+    VecColumn* cols_[2];
+    int ncols_;
+    double start_, step_;
+    bool has_start_, has_step_;
+    bool peak_list_;
+
+    void add_current_block()
+    {
+        if (!blk_added_)
+            blocks_.push_back(blk_);
+        blk_added_ = true;
+        peak_list_ = false;
+    }
+};
+
+void UxdParser::parse(LineReader& reader, MetaData* ds_meta)
+{
+    StrView line;
+    while (reader.next_valid(&line, ';')) {
         if (str_startwith(line, "_DRIVE")) { // block starts
-            blk = new Block;
+            if (!blk_added_)
+                delete blk_;
+            blk_ = new Block;
+            blk_added_ = false;
         }
         else if (str_startwith(line, "_COUNT") ||
                  str_startwith(line, "_CPS")) {
-            format_assert(this, blk != NULL, "missing _DRIVE");
-            StepColumn* xcol = new StepColumn(start, step);
-            blk->add_column(xcol);
+            format_assert(ds_, blk_ != NULL, "missing _DRIVE");
+            if (in_section_ && (blk_added_ || !has_start_ || !has_step_))
+                throw IrregularSection();
+            StepColumn* xcol = new StepColumn(start_, step_);
+            blk_->add_column(xcol);
             VecColumn* ycol = new VecColumn;
-            blk->add_column(ycol);
-            cols[0] = ycol;
-            ncols = 1;
-            add_block(blk);
-            peak_list = false;
+            blk_->add_column(ycol);
+            cols_[0] = ycol;
+            ncols_ = 1;
+            add_current_block();
         }
         else if (str_startwith(line, "_2THETACOUNTS") ||
                  str_startwith(line, "_2THETACPS") ||
                  str_startwith(line, "_2THETACOUNTSTIME")) { // data starts
-            format_assert(this, blk != NULL, "missing _DRIVE");
+            format_assert(ds_, blk_ != NULL, "missing _DRIVE");
+            if (in_section_ && blk_added_)
+                throw IrregularSection();
             VecColumn* xcol = new VecColumn;
-            blk->add_column(xcol);
+            blk_->add_column(xcol);
             VecColumn* ycol = new VecColumn;
-            blk->add_column(ycol);
-            cols[0] = xcol;
-            cols[1] = ycol;
-            ncols = 2;
-            add_block(blk);
-            peak_list = false;
+            blk_->add_column(ycol);
+            cols_[0] = xcol;
+            cols_[1] = ycol;
+            ncols_ = 2;
+            add_current_block();
         }
         // these keywords specify peak list, which we are not interested in
         else if (str_startwith(line, "_D-I") ||
                  str_startwith(line, "_2THETA-I")) {
-            peak_list = true;
+            peak_list_ = true;
         }
         else if (str_startwith(line, "_")) { // meta-data
             // other meta key-value pair.
             // NOTE the order, it must follow other "_XXX" branches
-            string key, val;
-            str_split(line.substr(1), '=', key, val);
-
-            if (key == "START")
-                start = my_strtod(val);
-            else if (key == "STEPSIZE")
-                step = my_strtod(val);
-            else {
-                if (blk)
-                    blk->meta[key] = val;
+            StrView key, val;
+            str_split(line.substr(1), '=', &key, &val);
+
+            if (key == "START") {
+                start_ = my_strtod(val.str());
+                has_start_ = true;
+            } else if (key == "STEPSIZE") {
+                step_ = my_strtod(val.str());
+                has_step_ = true;
+            } else {
+                if (blk_)
+                    blk_->meta[key.str()] = val.str();
                 else
-                    meta[key] = val;
+                    (*ds_meta)[key.str()] = val.str();
             }
         }
-        else if (!peak_list) { //data
-            format_assert(this, is_numeric(line[0]), "line: "+line);
-            format_assert(this, cols[0] != NULL,
-                          "Data started without raw data keyword:\n" + line);
-            add_values_from_str(line, ',', cols, ncols);
+        else if (!peak_list_) { //data
+            // data before the first data keyword in section would be added
+            // to the previous block (or skipped if it was a peak list)
+            if (in_section_ && !blk_added_)
+                throw IrregularSection();
+            format_assert(ds_, is_numeric(line[0]), "line: " + line.str());
+            format_assert(ds_, cols_[0] != NULL,
+                          "Data started without raw data keyword:\n"
+                          + line.str());
+            add_values_from_str(line, ',', cols_, ncols_);
+        }
+    }
+}
+
+} // anonymous namespace
+
+void UxdDataSet::load_data(std::istream &f, const char*)
+{
+    LineReader reader(f);
+    // find sections that start with _DRIVE
+    vector<const char*> starts;
+    LineReader scan(reader.pos(), reader.end());
+    StrView line;
+    for (;;) {
+        const char* pos = scan.pos();
+        if (!scan.next_valid(&line, ';'))
+            break;
+        if (str_startwith(line, "_DRIVE"))
+            starts.push_back(pos);
+    }
+    size_t n = starts.size();
+    starts.push_back(reader.end());
+
+    // the header is parsed first
+    UxdParser parser(this, false);
+    LineReader header(reader.pos(), starts[0]);
+    parser.parse(header, &meta);
+
+    vector<Block*> blocks;
+    bool parsed = false;
+    size_t size = reader.end() - reader.pos();
+    if (n > 1 && size >= min_parallel_parse_size) {
+        // sections are parsed in parallel
+        vector<vector<Block*> > section_blocks(n);
+        try {
+            parallel_for_ordered(n, [&](size_t i) {
+                LineReader section(starts[i], starts[i+1]);
+                UxdParser section_parser(this, true);
+                section_parser.parse(section, NULL);
+                section_parser.take_blocks(section_blocks[i]);
+            });
+            parsed = true;
+        } catch (IrregularSection&) {
+            // parse the file sequentially
+        } catch (...) {
+            for (size_t i = 0; i != n; ++i)
+                purge_all_elements(section_blocks[i]);
+            throw;
+        }
+        for (size_t i = 0; i != n; ++i) {
+            if (parsed)
+                blocks.insert(blocks.end(), section_blocks[i].begin(),
+                              section_blocks[i].end());
+            else
+                purge_all_elements(section_blocks[i]);
         }
     }
-    format_assert(this, blk != NULL);
+    if (!parsed) {
+        LineReader rest(starts[0], reader.end());
+        parser.parse(rest, &meta);
+        format_assert(this, parser.has_drive());
+        parser.take_blocks(blocks);
+    }
+    for (size_t i = 0; i != blocks.size(); ++i)
+        add_block(blocks[i]);
 }
 
 } // namespace xylib
@@ -4,9 +4,12 @@
 #define BUILDING_XYLIB
 #include "vamas.h"
 
+#include <cctype>
+#include <cstdlib>
 #include <cstring>
 
 #include "util.h"
+#include "fileio.h"
 
 using namespace std;
 using namespace xylib::util;
@@ -76,6 +79,125 @@ void skip_lines(istream &f, int count)
     }
 }
 
+// returns pointer after count lines that start at p, or throws exception;
+// the last line doesn't need to end with EOL
+const char* skip_text_lines(const char* p, const char* end, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        if (p == end)
+            throw xylib::FormatError("unexpected end of file");
+        const char* eol = (const char*) memchr(p, '\n', end - p);
+        p = eol ? eol + 1 : end;
+    }
+    return p;
+}
+
+// Parses ordinate values from text [begin, end) with line_count lines.
+// The values are one per line, columns are interleaved: values of column
+// index are in lines index, index+stride, index+2*stride, ...
+void parse_ordinates(const char* begin, const char* end, int line_count,
+                     int index, int stride, VecColumn* col)
+{
+    if (line_count <= index)
+        return;
+    const char* p = skip_text_lines(begin, end, index);
+    col->add_values_from_lines(p, end, line_count - index, stride);
+}
+
+// Returns true if line [p, eol) surely starts with a number that
+// parse_ordinates() reads without error (no overflow etc.); false means
+// that the line must be parsed to find out.
+bool is_plain_number_line(const char* p, const char* eol)
+{
+    while (p != eol && (*p == ' ' || *p == '\t'))
+        ++p;
+    if (p != eol && (*p == '-' || *p == '+'))
+        ++p;
+    int int_digits = 0;
+    for (; p != eol && isdigit((unsigned char) *p); ++p)
+        ++int_digits;
+    int digits = int_digits;
+    if (p != eol && *p == '.')
+        for (++p; p != eol && isdigit((unsigned char) *p); ++p)
+            ++digits;
+    if (digits == 0 || (p != eol && (*p == 'x' || *p == 'X')))
+        return false;
+    int exp = 0;
+    if (p != eol && (*p == 'e' || *p == 'E')) {
+        ++p;
+        bool neg = (p != eol && *p == '-');
+        if (p != eol && (*p == '-' || *p == '+'))
+            ++p;
+        for (; p != eol && isdigit((unsigned char) *p) && exp < 1000; ++p)
+            exp = exp * 10 + (*p - '0');
+        if (neg) // underflow is not an error
+            exp = 0;
+    }
+    return int_digits + exp < 300;
+}
+
+// Returns pointer after count lines of ordinate values that start at p.
+// The values are not stored, but each line is checked, so malformed values
+// are reported (as FormatError) while the file is loaded.
+const char* check_ordinate_lines(const char* p, const char* end, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        if (p == end)
+            throw xylib::FormatError("unexpected end of file");
+        const char* eol = (const char*) memchr(p, '\n', end - p);
+        const char* next = eol ? eol + 1 : end;
+        if (!is_plain_number_line(p, eol ? eol : end)) {
+            VecColumn col; // throws the same error as parse_ordinates()
+            col.add_values_from_lines(p, next, 1);
+        }
+        p = next;
+    }
+    return p;
+}
+
+// Ordinate values that are parsed when they are accessed for the first time.
+// The lines were checked by check_ordinate_lines(), so parsing doesn't fail.
+// The lines are a copy, not a part of the file buffer: the buffer can be
+// a mapping of the file, which may change after the file is loaded.
+class OrdinateColumn : public ColumnWithName
+{
+public:
+    OrdinateColumn(shared_ptr<const string> const& lines, int line_count,
+                   int index, int stride)
+        : ColumnWithName(0.), lines_(lines),
+          line_count_(line_count), index_(index), stride_(stride),
+          count_(max(0, (line_count - index + stride - 1) / stride)) {}
+
+    int get_point_count() const { return count_; }
+    double get_value(int n) const { return values().get_value(n); }
+    void get_values(int first, int count, double* out) const
+        { values().get_values(first, count, out); }
+    const void* get_raw_data() const { return values().get_raw_data(); }
+    double get_min() const { return values().get_min(); }
+    double get_max(int /*point_count*/=0) const { return values().get_max(); }
+    int get_sort_order() const { return values().get_sort_order(); }
+    xylib::ColumnStats get_stats(int /*point_count*/=0) const
+        { return values().get_stats(); }
+
+private:
+    shared_ptr<const string> lines_; // shared by columns of one block
+    int line_count_;
+    int index_;
+    int stride_;
+    int count_;
+    LazyValue<VecColumn> values_;
+
+    VecColumn const& values() const
+    {
+        return values_.get([this]() {
+            VecColumn col;
+            const char* begin = lines_->data();
+            parse_ordinates(begin, begin + lines_->size(), line_count_,
+                            index_, stride_, &col);
+            return col;
+        });
+    }
+};
 
 } // anonymous namespace
 
@@ -169,8 +291,10 @@ void VamasDataSet::load_data(std::istream &f, const char*)
     // handle the blocks
     unsigned blk_cnt = read_line_int(f);
     const Block* first_block = NULL;
+    ColumnPool x_cols; // blocks with the same abscissa share x column
     for (unsigned i = 0; i < blk_cnt; ++i) {
-        Block *blk = read_block(f, i == 0 ? all : inclusion_list, first_block);
+        Block *blk = read_block(f, i == 0 ? all : inclusion_list, first_block,
+                                x_cols);
         if (i == 0)
             first_block = blk;
         add_block(blk);
@@ -186,13 +310,15 @@ static string two_digit(const string& s)
 
 // read one block from file
 Block* VamasDataSet::read_block(istream &f, bool includes[],
-                                const Block* first_block)
+                                const Block* first_block, ColumnPool& x_cols)
 {
     Block *block = new Block;
+    // keys are added directly to the key table of the dataset
+    block->meta.share_keys(meta);
     double x_start=0., x_step=0.;
     string x_name;
 
-    vector<VecColumn*> ycols;
+    vector<string> ycol_names;
 
     block->set_name(read_line_trim(f));
     block->meta["sample identifier"] = read_line_trim(f);
@@ -360,20 +486,15 @@ Block* VamasDataSet::read_block(istream &f, bool includes[],
         cor_var = read_line_int(f);
         if (cor_var < 1)
             throw FormatError("wrong number of corresponding variables");
-        // columns initialization
         for (int i = 0; i != cor_var; ++i) {
-            string corresponding_variable_label = read_line_trim(f);
+            ycol_names.push_back(read_line_trim(f));
             skip_lines(f, 1);    // ignoring corresponding variable unit
-            ycols.push_back(new VecColumn);
-            ycols[i]->set_name(corresponding_variable_label);
         }
     } else {
         assert(first_block != NULL);
         cor_var = first_block->get_column_count() - 1; // don't count xcol
-        for (int i = 0; i != cor_var; ++i) {
-            ycols.push_back(new VecColumn);
-            ycols[i]->set_name(first_block->get_column(i).get_name());
-        }
+        for (int i = 0; i != cor_var; ++i)
+            ycol_names.push_back(first_block->get_column(i).get_name());
     }
 
     if (includes[32])
@@ -419,17 +540,39 @@ Block* VamasDataSet::read_block(istream &f, bool includes[],
 
     StepColumn *xcol = new StepColumn(x_start, x_step);
     xcol->set_name(x_name);
-    block->add_column(xcol);
+    block->add_column(x_cols.share(xcol));
+
+    assert(ycol_names.size() == (size_t) cor_var);
+    file_buffer_ptr buf;
+    if (const char* begin = buffer_at_stream_pos(f, &buf)) {
+        // values are only checked now, they are parsed when needed
+        const char* end = check_ordinate_lines(begin,
+                                               buf->data() + buf->size(),
+                                               cur_blk_steps);
+        f.seekg(end - buf->data());
+        shared_ptr<const string> lines = make_shared<string>(begin, end);
+        for (int i = 0; i < cor_var; ++i) {
+            OrdinateColumn *ycol = new OrdinateColumn(lines, cur_blk_steps,
+                                                      i, cor_var);
+            ycol->set_name(ycol_names[i]);
+            block->add_column(ycol);
+        }
+        return block;
+    }
 
-    int col = 0;
-    assert(ycols.size() == (size_t) cor_var);
+    // the file is not in memory, read the values now
+    string text;
     for (int i = 0; i < cur_blk_steps; ++i) {
-        double y = my_strtod(read_line_trim(f));
-        ycols[col]->add_val(y);
-        col = (col + 1) % cor_var;
+        text += read_line(f);
+        text += '\n';
+    }
+    for (int i = 0; i < cor_var; ++i) {
+        VecColumn *ycol = new VecColumn;
+        ycol->set_name(ycol_names[i]);
+        block->add_column(ycol);
+        parse_ordinates(text.data(), text.data() + text.size(),
+                        cur_blk_steps, i, cor_var, ycol);
     }
-    for (int i = 0; i < cor_var; ++i)
-        block->add_column(ycols[i]);
     return block;
 }
 
@@ -8,6 +8,10 @@
 //    Surface and Interface Analysis, 13 (1988) 63-122
 //    or National Physics Laboratory Report DMA(A)164 July 1988
 //
+// Files with many blocks (e.g. XPS maps) are read quickly: when the file
+// is in memory, the ordinate values are only checked at load time; the
+// lines with values of each block are copied and parsed on first access.
+// Malformed values are reported (as FormatError) at load time, as usual.
 
 #ifndef XYLIB_VAMAS_H_
 #define XYLIB_VAMAS_H_
@@ -15,6 +19,8 @@
 
 namespace xylib {
 
+    namespace util { class ColumnPool; }
+
     class VamasDataSet : public DataSet
     {
         OBLIGATORY_DATASET_MEMBERS(VamasDataSet)
@@ -26,7 +32,7 @@ namespace xylib {
         int exp_var_cnt_;       // count of experimental variables
 
         Block *read_block(std::istream &f, bool includes[],
-                          const Block* first_block);
+                          const Block* first_block, util::ColumnPool& x_cols);
     };
 
 } // namespace xylib
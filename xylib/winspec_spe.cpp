@@ -5,8 +5,13 @@
 #include "winspec_spe.h"
 
 #include <cmath>
+#include <climits>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "util.h"
+#include "fileio.h"
 
 using namespace std;
 using namespace xylib::util;
@@ -20,7 +25,8 @@ const FormatInfo WinspecSpeDataSet::fmt_info(
     true,                       // whether binary
     true,                       // whether has multi-blocks
     &WinspecSpeDataSet::ctor,
-    &WinspecSpeDataSet::check
+    &WinspecSpeDataSet::check,
+    "rows binning"
 );
 
 enum {
@@ -62,6 +68,57 @@ struct spe_calib {
 };
 
 
+// NULL if data_type is not valid
+static
+Column* read_spe_column(istream &f, spe_dt data_type, int count,
+                        pair<int, int> const& range)
+{
+    switch (data_type) {
+        case SPE_DATA_FLOAT:
+            return read_le_column<float>(f, count, range);
+        case SPE_DATA_LONG:
+            return read_le_column<int32_t>(f, count, range);
+        case SPE_DATA_INT:
+            return read_le_column<int16_t>(f, count, range);
+        case SPE_DATA_UINT:
+            return read_le_column<uint16_t>(f, count, range);
+    }
+    return NULL;
+}
+
+static
+DataType get_spe_dtype(const DataSet* ds, spe_dt data_type)
+{
+    switch (data_type) {
+        case SPE_DATA_FLOAT: return DT_FLOAT32;
+        case SPE_DATA_LONG: return DT_INT32;
+        case SPE_DATA_INT: return DT_INT16;
+        case SPE_DATA_UINT: return DT_UINT16;
+    }
+    format_assert(ds, false, "unknown data type");
+    return DT_FLOAT64;
+}
+
+// Sums row_count rows (starting at p, row_bytes apart) of numbers of type
+// dt. Only count numbers, starting from first, are summed in each row.
+// Rows are decoded with decode_to_double() (SSE2) and added in a loop
+// that compilers vectorize.
+static
+void sum_rows(const char* p, int row_count, size_t row_bytes, DataType dt,
+              int first, int count, double* out)
+{
+    for (int j = 0; j < count; ++j)
+        out[j] = 0.;
+    vector<double> row(count);
+    double *r = row.empty() ? NULL : &row[0];
+    p += (size_t) first * get_dtype_size(dt);
+    for (int i = 0; i < row_count; ++i, p += row_bytes) {
+        decode_to_double(p, count, dt, false, r);
+        for (int j = 0; j < count; ++j)
+            out[j] += r[j];
+    }
+}
+
 bool WinspecSpeDataSet::check(istream &f, string*) {
     // make sure file size > 4100 (data begins after a 4100-byte header)
     f.seekg(-1, ios_base::end);
@@ -72,8 +129,10 @@ bool WinspecSpeDataSet::check(istream &f, string*) {
 
     // datatype field in header ONLY can be 0~3
     f.seekg(108);
-    spe_dt data_type = static_cast<spe_dt>(read_uint16_le(f));
-    if (data_type < SPE_DATA_FLOAT || data_type > SPE_DATA_UINT)
+    unsigned int data_type;
+    if (!read_uint16_le(f, &data_type))
+        return false;
+    if (data_type > SPE_DATA_UINT)
         return false;
 
     return true;
@@ -107,36 +166,25 @@ void WinspecSpeDataSet::load_data(std::istream &f, const char*)
         dim = ydim;
         calib = &y_calib;
     } else {
-        throw FormatError("xylib does not support 2-D images");
+        f.ignore(122);      // move ptr to frames-start
+        read_frames(f, xdim, ydim, num_frames, data_type, &x_calib);
+        return;
     }
 
     f.ignore(122);      // move ptr to frames-start
+    // all frames have the same calibration, they share one x column
+    shared_ptr<Column> calib_col(get_calib_column(calib, dim));
+    // only this range of points is read (options x-range, index-range)
+    pair<int, int> range = get_point_range(*calib_col, dim);
+    shared_ptr<const Column> xcol = slice_column(calib_col, range.first,
+                                                 range.second - range.first);
     for (unsigned frm = 0; frm < num_frames; ++frm) {
         Block *blk = new Block;
-        Column *xcol = get_calib_column(calib, dim);
         blk->add_column(xcol);
 
-        VecColumn *ycol = new VecColumn;
-        for (int i = 0; i < dim; ++i) {
-            double y = 0;
-            switch (data_type) {
-                case SPE_DATA_FLOAT:
-                    y = read_flt_le(f);
-                    break;
-                case SPE_DATA_LONG:
-                    y = read_int32_le(f);
-                    break;
-                case SPE_DATA_INT:
-                    y = read_int16_le(f);
-                    break;
-                case SPE_DATA_UINT:
-                    y = read_uint16_le(f);
-                    break;
-                default:
-                    break;
-            }
-            ycol->add_val(y);
-        }
+        Column *ycol = read_spe_column(f, data_type, dim, range);
+        if (ycol == NULL)
+            ycol = new StepColumn(0, 0, range.second - range.first);
         blk->add_column(ycol);
 
         add_block(blk);
@@ -144,25 +192,127 @@ void WinspecSpeDataSet::load_data(std::istream &f, const char*)
 }
 
 
+// 2-D frames (images), see winspec_spe.h
+void WinspecSpeDataSet::read_frames(istream &f, int xdim, int ydim,
+                                    size_t frame_count, int data_type,
+                                    const spe_calib *calib)
+{
+    format_assert(this, xdim > 0 && ydim > 0, "bad frame dimensions");
+    spe_dt dtype = static_cast<spe_dt>(data_type);
+    size_t frame_size = (size_t) xdim * ydim;
+    format_assert(this, frame_size <= INT_MAX, "frame is too large");
+    shared_ptr<Column> calib_col(get_calib_column(calib, xdim));
+    // region of interest: columns from x-range or index-range, and rows
+    pair<int, int> range = get_point_range(*calib_col, xdim);
+    int count = range.second - range.first;
+    shared_ptr<const Column> xcol = slice_column(calib_col, range.first,
+                                                 count);
+    pair<int, int> rows = get_row_range(ydim);
+    int row_count = rows.second - rows.first;
+
+    if (!has_option("binning")) {
+        // only rows from the range are read
+        pair<int, int> frame_range(rows.first * xdim, rows.second * xdim);
+        for (size_t frm = 0; frm < frame_count; ++frm) {
+            shared_ptr<const Column> frame(read_spe_column(f, dtype,
+                                                 (int) frame_size,
+                                                 frame_range));
+            format_assert(this, frame.get() != NULL, "unknown data type");
+            // views of all rows of the frame are kept in one array
+            vector<shared_ptr<const Column> > row_cols = matrix_rows(frame,
+                        xdim, row_count, range.first, count, "row",
+                        rows.first + 1);
+            Block *blk = new Block;
+            blk->add_column(xcol);
+            for (int i = 0; i < row_count; ++i)
+                blk->add_column(row_cols[i]);
+            add_block(blk);
+        }
+        return;
+    }
+
+    DataType dt = get_spe_dtype(this, dtype);
+    size_t row_bytes = (size_t) xdim * get_dtype_size(dt);
+    size_t frame_bytes = frame_size * get_dtype_size(dt);
+
+    string name = "sum of rows " + S(rows.first + 1) + "-" + S(rows.second);
+    // adds block for the next frame, returns storage for the sums
+    auto add_frame_block = [&]() {
+        Block *blk = new Block;
+        blk->add_column(xcol);
+        VecColumn *col = new VecColumn;
+        col->set_name(name);
+        blk->add_column(col);
+        add_block(blk);
+        return col->extend(count);
+    };
+
+    file_buffer_ptr buf;
+    const char* start = buffer_at_stream_pos(f, &buf);
+    size_t avail = start ? buf->data() + buf->size() - start : 0;
+    if (start != NULL && frame_count <= avail / frame_bytes) {
+        // the whole file is in memory, frames are summed in parallel
+        vector<double*> sums(frame_count);
+        for (size_t frm = 0; frm < frame_count; ++frm)
+            sums[frm] = add_frame_block();
+        const char* data = start + rows.first * row_bytes;
+        parallel_for(frame_count, [&](size_t i) {
+            sum_rows(data + i * frame_bytes, row_count, row_bytes, dt,
+                     range.first, count, sums[i]);
+        });
+        return;
+    }
+    // otherwise only rows from the range are read, frame after frame
+    vector<char> tmp(row_count * row_bytes);
+    for (size_t frm = 0; frm < frame_count; ++frm) {
+        f.ignore(rows.first * row_bytes);
+        f.read(tmp.empty() ? NULL : &tmp[0], tmp.size());
+        if (f.gcount() < (streamsize) tmp.size())
+            throw FormatError("unexpected eof");
+        f.ignore((ydim - rows.second) * row_bytes);
+        sum_rows(tmp.empty() ? NULL : &tmp[0], row_count, row_bytes, dt,
+                 range.first, count, add_frame_block());
+    }
+}
+
+
+// rows requested with option rows=FIRST:END
+pair<int, int> WinspecSpeDataSet::get_row_range(int ydim)
+{
+    string value;
+    if (!get_option_value("rows", &value))
+        return make_pair(0, ydim);
+    size_t colon = value.find(':');
+    if (colon == string::npos)
+        throw RunTimeError("wrong option: rows=" + value);
+    string a = str_trim(value.substr(0, colon));
+    string b = str_trim(value.substr(colon + 1));
+    long first = 0, end = ydim;
+    if ((!a.empty() && parse_long(a, &first) != NULL) ||
+            (!b.empty() && parse_long(b, &end) != NULL) ||
+            first < 0 || end < 0)
+        throw RunTimeError("wrong option: rows=" + value);
+    end = min(end, (long) ydim);
+    first = min(first, end);
+    return make_pair((int) first, (int) end);
+}
+
+
 Column* WinspecSpeDataSet::get_calib_column(const spe_calib *calib, int dim)
 {
-    format_assert(this, calib->polynom_order < 6, "bad polynom header");
+    format_assert(this, calib->polynom_order >= 0 && calib->polynom_order < 6,
+                  "bad polynom header");
 
     if (!calib->calib_valid)    //use idx as X instead
-        return new StepColumn(0, 1);
+        return new StepColumn(0, 1, dim);
     else if (calib->polynom_order == 1) { // linear
         return new StepColumn(calib->polynom_coeff[0],
-                              calib->polynom_coeff[1]);
+                              calib->polynom_coeff[1], dim);
     }
     else {
-        VecColumn *xcol = new VecColumn;
-        for (int i = 0; i < dim; ++i) {
-            double x = 0;
-            for (int j = 0; j <= calib->polynom_order; ++j)
-                x += calib->polynom_coeff[j] * pow(i + 1., double(j));
-            xcol->add_val(x);
-        }
-        return xcol;
+        const double *c = calib->polynom_coeff;
+        return new PolyColumn(vector<double>(c, c + calib->polynom_order + 1),
+                              1, dim);
     }
 }
 
@@ -9,6 +9,17 @@
 // Implementation is based on the file format specification sent us by
 // David Hovis (the documents came with his equipment)
 // and source code of a program written by Pablo Bianucci.
+//
+// Each frame is read as a separate block. Frames of 1-D spectra have x and
+// y columns. 2-D frames (CCD images) have x column and one column per row
+// of the image; the rows of a frame are stored in one array, so
+// get_raw_data() of the first row points to the whole rows x columns
+// matrix (if all points are loaded). Options for 2-D frames:
+//  - rows=FIRST:END -- only rows FIRST, ..., END-1 are loaded (END can be
+//    omitted); together with x-range or index-range it gives a region
+//    of interest,
+//  - binning -- the rows are summed (vertical binning) while the data is
+//    read, and each frame has only x and "sum of rows" columns.
 
 #ifndef XYLIB_WINSPEC_SPE_H_
 #define XYLIB_WINSPEC_SPE_H_
@@ -25,6 +36,10 @@ namespace xylib {
     protected:
         Column* get_calib_column(const spe_calib *calib, int dim);
         void read_calib(std::istream &f, spe_calib &calib);
+        void read_frames(std::istream &f, int xdim, int ydim,
+                         size_t frame_count, int data_type,
+                         const spe_calib *calib);
+        std::pair<int, int> get_row_range(int ydim);
     };
 
 } // namespace
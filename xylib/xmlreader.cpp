@@ -0,0 +1,389 @@
+// private streaming XML reader (namespace xylib::util)
+// Licence: Lesser GNU Public License 2.1 (LGPL)
+
+#define BUILDING_XYLIB
+#include "xmlreader.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+namespace xylib { namespace util {
+
+namespace {
+
+const size_t chunk_size = 65536;
+
+bool is_space(int c)
+{
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+bool is_name_char(int c)
+{
+    return c != -1 && !is_space(c) && c != '>' && c != '/' && c != '='
+           && c != '<' && c != '"' && c != '\'';
+}
+
+void append_utf8(string& s, unsigned long cp)
+{
+    if (cp < 0x80) {
+        s += (char) cp;
+    } else if (cp < 0x800) {
+        s += (char) (0xC0 | (cp >> 6));
+        s += (char) (0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        s += (char) (0xE0 | (cp >> 12));
+        s += (char) (0x80 | ((cp >> 6) & 0x3F));
+        s += (char) (0x80 | (cp & 0x3F));
+    } else {
+        s += (char) (0xF0 | (cp >> 18));
+        s += (char) (0x80 | ((cp >> 12) & 0x3F));
+        s += (char) (0x80 | ((cp >> 6) & 0x3F));
+        s += (char) (0x80 | (cp & 0x3F));
+    }
+}
+
+} // anonymous namespace
+
+XmlReader::XmlReader(istream& f)
+    : f_(f), begin_(NULL), p_(NULL), end_(NULL), offset_(0), eof_(false),
+      pending_end_(false), in_cdata_(false), entity_pos_(0)
+{
+    const char* start = buffer_at_stream_pos(f, &file_buf_);
+    if (start != NULL) {
+        begin_ = p_ = start;
+        end_ = file_buf_->data() + file_buf_->size();
+        offset_ = start - file_buf_->data();
+    } else {
+        chunk_.resize(chunk_size);
+    }
+    if (looking_at("\xEF\xBB\xBF")) // UTF-8 BOM
+        p_ += 3;
+}
+
+// makes sure that at least n bytes are available, if possible
+bool XmlReader::fill(size_t n)
+{
+    size_t avail = end_ - p_;
+    if (avail >= n)
+        return true;
+    if (file_buf_ || eof_)
+        return false;
+    // move not processed bytes to the beginning of the chunk
+    offset_ += p_ - begin_;
+    if (avail != 0)
+        memmove(&chunk_[0], p_, avail);
+    f_.read(&chunk_[avail], chunk_.size() - avail);
+    size_t count = (size_t) f_.gcount();
+    if (count == 0)
+        eof_ = true;
+    begin_ = p_ = &chunk_[0];
+    end_ = p_ + avail + count;
+    return avail + count >= n;
+}
+
+bool XmlReader::looking_at(const char* s)
+{
+    size_t len = strlen(s);
+    return fill(len) && memcmp(p_, s, len) == 0;
+}
+
+void XmlReader::error(string const& msg) const
+{
+    throw FormatError("XML: " + msg + " (at byte "
+                      + S((long long) (offset_ + (p_ - begin_))) + ")");
+}
+
+void XmlReader::expect(char c)
+{
+    if (get() != c)
+        error(string("expected '") + c + "'");
+}
+
+void XmlReader::skip_past(const char* s)
+{
+    size_t len = strlen(s);
+    while (!looking_at(s)) {
+        if (get() == -1)
+            error(string("unexpected end of file, missing ") + s);
+    }
+    p_ += len;
+}
+
+void XmlReader::skip_space()
+{
+    while (is_space(peek()))
+        ++p_;
+}
+
+void XmlReader::read_name(string& s)
+{
+    s.clear();
+    while (is_name_char(peek()))
+        s += *p_++;
+    if (s.empty())
+        error("name expected");
+}
+
+// called after '&'
+void XmlReader::decode_entity(string& s)
+{
+    string ent;
+    int c;
+    while ((c = get()) != ';') {
+        if (c == -1 || c == '<' || ent.size() > 10)
+            error("malformed entity &" + ent);
+        ent += (char) c;
+    }
+    if (ent == "lt")
+        s += '<';
+    else if (ent == "gt")
+        s += '>';
+    else if (ent == "amp")
+        s += '&';
+    else if (ent == "quot")
+        s += '"';
+    else if (ent == "apos")
+        s += '\'';
+    else if (ent.size() > 1 && ent[0] == '#') {
+        const char* start = ent.c_str() + 1;
+        int base = 10;
+        if (*start == 'x') {
+            ++start;
+            base = 16;
+        }
+        char* endptr;
+        unsigned long cp = strtoul(start, &endptr, base);
+        if (endptr == start || *endptr != '\0' || cp > 0x10FFFF)
+            error("malformed character reference &" + ent + ";");
+        append_utf8(s, cp);
+    } else // unknown entity (it could be declared in DTD), keep it as is
+        s += "&" + ent + ";";
+}
+
+void XmlReader::read_attr_value(string& s)
+{
+    s.clear();
+    int quote = get();
+    if (quote != '"' && quote != '\'')
+        error("attribute value must be quoted");
+    int c;
+    while ((c = get()) != quote) {
+        if (c == -1 || c == '<')
+            error("unterminated attribute value");
+        if (c == '&')
+            decode_entity(s);
+        else
+            s += (char) c;
+    }
+}
+
+// returns the next byte of character data, or -1 if a tag or eof is reached
+int XmlReader::text_char()
+{
+    if (entity_pos_ < entity_.size())
+        return (unsigned char) entity_[entity_pos_++];
+    if (pending_end_)
+        return -1;
+    for (;;) {
+        int c = peek();
+        if (in_cdata_) {
+            if (c == ']' && looking_at("]]>")) {
+                p_ += 3;
+                in_cdata_ = false;
+                continue;
+            }
+            if (c == -1)
+                error("unexpected end of file in CDATA section");
+            ++p_;
+            return c;
+        }
+        if (c == '<') {
+            // comments and PIs are skipped, the text around them is joined
+            if (looking_at("<!--")) {
+                p_ += 4;
+                skip_past("-->");
+                continue;
+            }
+            if (looking_at("<?")) {
+                p_ += 2;
+                skip_past("?>");
+                continue;
+            }
+            if (!looking_at("<![CDATA["))
+                return -1;
+            p_ += 9;
+            in_cdata_ = true;
+            continue;
+        }
+        if (c == '&') {
+            ++p_;
+            entity_.clear();
+            decode_entity(entity_);
+            entity_pos_ = 1;
+            return (unsigned char) entity_[0];
+        }
+        if (c != -1)
+            ++p_;
+        return c;
+    }
+}
+
+// appends character data up to the next tag to s, or skips it if s is NULL
+void XmlReader::append_text(string* s)
+{
+    for (;;) {
+        // fast path: copy characters that don't need decoding at once
+        if (entity_pos_ == entity_.size() && !in_cdata_ && !pending_end_) {
+            const char* q = p_;
+            while (q != end_ && *q != '<' && *q != '&')
+                ++q;
+            if (s != NULL)
+                s->append(p_, q);
+            p_ = q;
+        }
+        int c = text_char();
+        if (c == -1)
+            return;
+        if (s != NULL)
+            *s += (char) c;
+    }
+}
+
+XmlReader::Node XmlReader::next()
+{
+    if (pending_end_) {
+        pending_end_ = false;
+        name_ = open_.back();
+        open_.pop_back();
+        return XML_END;
+    }
+    for (;;) {
+        append_text(NULL);
+        if (peek() == -1) {
+            if (!open_.empty())
+                error("unexpected end of file, <" + open_.back()
+                      + "> not closed");
+            return XML_EOF;
+        }
+        ++p_; // '<'
+        int c = peek();
+        if (c == '/') {
+            ++p_;
+            read_name(name_);
+            skip_space();
+            expect('>');
+            if (open_.empty() || open_.back() != name_)
+                error("unexpected end tag </" + name_ + ">");
+            open_.pop_back();
+            return XML_END;
+        } else if (c == '?') {
+            skip_past("?>");
+        } else if (c == '!') {
+            if (looking_at("!--")) {
+                skip_past("-->");
+            } else { // DOCTYPE or other declaration, possibly with [...]
+                int level = 0;
+                while ((c = get()) != '>' || level > 0) {
+                    if (c == -1)
+                        error("unexpected end of file in <!");
+                    else if (c == '[')
+                        ++level;
+                    else if (c == ']')
+                        --level;
+                }
+            }
+        } else {
+            read_name(name_);
+            attrs_.clear();
+            for (;;) {
+                skip_space();
+                c = peek();
+                if (c == '>') {
+                    ++p_;
+                    break;
+                } else if (c == '/') {
+                    ++p_;
+                    expect('>');
+                    pending_end_ = true;
+                    break;
+                }
+                attrs_.resize(attrs_.size() + 1);
+                read_name(attrs_.back().first);
+                skip_space();
+                expect('=');
+                skip_space();
+                read_attr_value(attrs_.back().second);
+            }
+            open_.push_back(name_);
+            return XML_START;
+        }
+    }
+}
+
+string const* XmlReader::find_attr(const char* name) const
+{
+    for (size_t i = 0; i != attrs_.size(); ++i)
+        if (attrs_[i].first == name)
+            return &attrs_[i].second;
+    return NULL;
+}
+
+string XmlReader::attr(const char* name, string const& default_value) const
+{
+    string const* value = find_attr(name);
+    return value ? *value : default_value;
+}
+
+void XmlReader::skip_element()
+{
+    int d = depth();
+    while (next() != XML_END || depth() >= d)
+        ;
+}
+
+string XmlReader::read_text()
+{
+    string s;
+    int d = depth();
+    for (;;) {
+        append_text(&s);
+        Node node = next();
+        if (node == XML_END && depth() < d)
+            return s;
+        if (node == XML_START)
+            skip_element();
+    }
+}
+
+bool XmlReader::read_token(string& token, const char* delims)
+{
+    token.clear();
+    int c;
+    while ((c = text_char()) != -1) {
+        if (strchr(delims, c) == NULL)
+            token += (char) c;
+        else if (!token.empty())
+            return true;
+    }
+    return !token.empty();
+}
+
+bool XmlReader::read_number(double* val, const char* delims)
+{
+    if (!read_token(token_, delims))
+        return false;
+    const char* start = token_.c_str();
+    char *endptr;
+    *val = strtod(start, &endptr);
+    if (endptr == start || *endptr != '\0')
+        error("number expected, found: " + token_);
+    if (*val == HUGE_VAL || *val == -HUGE_VAL)
+        error("numeric overflow: " + token_);
+    return true;
+}
+
+} } // namespace xylib::util
@@ -0,0 +1,99 @@
+// private streaming XML reader (namespace xylib::util)
+// Licence: Lesser GNU Public License 2.1 (LGPL)
+
+#ifndef XYLIB_XMLREADER_H_
+#define XYLIB_XMLREADER_H_
+
+#include <istream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "fileio.h"
+
+namespace xylib { namespace util {
+
+/// Non-validating XML pull reader. Elements are reported as they are read
+/// and no tree is built: only the current tag (with attributes) and names
+/// of the open elements are kept in memory.
+/// Comments, processing instructions and DOCTYPE are skipped, entities
+/// and CDATA sections in character data are decoded.
+/// Malformed documents (e.g. mismatched tags) cause FormatError.
+class XmlReader
+{
+public:
+    enum Node { XML_START, XML_END, XML_EOF };
+
+    explicit XmlReader(std::istream& f);
+
+    /// Moves to the next start or end tag, skipping character data.
+    /// Empty element (<a/>) gives XML_START followed by XML_END.
+    Node next();
+
+    /// Name of the current element (after XML_START or XML_END).
+    std::string const& name() const { return name_; }
+
+    /// Number of open elements (after XML_START it includes the current
+    /// element, after XML_END it doesn't).
+    int depth() const { return (int) open_.size(); }
+
+    /// Returns value of attribute of the current start tag or NULL.
+    std::string const* find_attr(const char* name) const;
+
+    /// Returns value of attribute of the current start tag or default_value.
+    std::string attr(const char* name,
+                     std::string const& default_value="") const;
+
+    /// Skips the rest of the current element, including its end tag.
+    /// Call it after XML_START (possibly after read_token()).
+    void skip_element();
+
+    /// Returns character data of the current element and moves after its
+    /// end tag, like skip_element(). Data in nested elements is ignored.
+    std::string read_text();
+
+    /// Reads the next token from character data: characters up to one of
+    /// delims. Empty tokens are skipped. Returns false if a tag was reached.
+    /// Used to parse long data without storing the whole text.
+    bool read_token(std::string& token, const char* delims);
+
+    /// Like read_token(), but the token must be a number.
+    bool read_number(double* val, const char* delims);
+
+private:
+    std::istream& f_;
+    file_buffer_ptr file_buf_; // set if the whole file is in memory
+    std::vector<char> chunk_; // otherwise the file is read in chunks
+    const char* begin_; // start of the current chunk
+    const char* p_; // current position
+    const char* end_;
+    size_t offset_; // file offset of begin_, used in error messages
+    bool eof_;
+
+    std::string name_;
+    std::vector<std::pair<std::string, std::string> > attrs_;
+    std::vector<std::string> open_; // names of open elements
+    bool pending_end_; // set if the current element is empty (<a/>)
+    bool in_cdata_;
+    std::string entity_; // decoded entity, returned by text_char()
+    size_t entity_pos_;
+    std::string token_; // used in read_number()
+
+    bool fill(size_t n);
+    int peek() { return p_ != end_ || fill(1) ? (unsigned char) *p_ : -1; }
+    int get() { int c = peek(); if (c != -1) ++p_; return c; }
+    bool looking_at(const char* s);
+    void expect(char c);
+    void skip_past(const char* s);
+    void skip_space();
+    void read_name(std::string& s);
+    void read_attr_value(std::string& s);
+    void decode_entity(std::string& s);
+    int text_char();
+    void append_text(std::string* s);
+    void error(std::string const& msg) const;
+};
+
+} } // namespace xylib::util
+
+#endif // XYLIB_XMLREADER_H_
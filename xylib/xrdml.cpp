@@ -4,16 +4,17 @@
 #define BUILDING_XYLIB
 #include "xrdml.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cctype>
+#include <cstdlib>
 #include <cstring>
 #include <memory>  // for unique_ptr
-#include <boost/property_tree/ptree.hpp>
-#include <boost/property_tree/xml_parser.hpp>
 #include "util.h"
+#include "xmlreader.h"
 
 using namespace std;
 using namespace xylib::util;
-using boost::property_tree::ptree;
-typedef ptree::const_assoc_iterator ptiter;
 
 namespace xylib {
 
@@ -24,7 +25,8 @@ const FormatInfo XrdmlDataSet::fmt_info(
     false,                     // whether binary
     true,                      // whether has multi-blocks
     &XrdmlDataSet::ctor,
-    &XrdmlDataSet::check
+    &XrdmlDataSet::check,
+    "matrix"
 );
 
 // Check for "www.xrdml.com" which is part of xmlns and in xsi:schemaLocation.
@@ -37,64 +39,305 @@ bool XrdmlDataSet::check(istream &f, string*)
     return strstr(buf, "www.xrdml.com") != NULL;
 }
 
-static Block* make_block_from_points(const ptree& data_points)
+namespace {
+
+const char* xml_spaces = " \t\r\n";
+
+// content of <positions> element
+struct Positions
+{
+    string axis;
+    string start, end; // text of <startPosition> and <endPosition>
+    string common; // text of <commonPosition>
+    vector<double> list; // <listPositions>
+
+    bool has_points() const { return !start.empty() || !list.empty(); }
+    bool same_points(Positions const& p) const
+    {
+        return axis == p.axis && start == p.start && end == p.end &&
+               list == p.list;
+    }
+};
+
+void read_positions(XmlReader& r, Positions* pos)
 {
-    std::unique_ptr<Block> blk(new Block);
-    StepColumn *xs_col = NULL;
-    std::pair<ptiter, ptiter> prange = data_points.equal_range("positions");
-    for (ptiter i = prange.first; i != prange.second; ++i) {
-        const ptree& pos = i->second;
-        string x_axis = pos.get<string>("<xmlattr>.axis");
-        if (pos.count("startPosition") != 0) {
-            double x_start = my_strtod(pos.get<string>("startPosition"));
-            double x_end = my_strtod(pos.get<string>("endPosition"));
-            // the step will be later divided by number-of-points - 1
-            xs_col = new StepColumn(x_start, x_end - x_start);
-            blk->add_column(xs_col);
-            xs_col->set_name(x_axis);
-            break;
-        } else if (pos.count("listPositions") != 0) { // untested - no examples
-            string str = pos.get<string>("listPositions");
-            VecColumn *xv_col = new VecColumn;
-            blk->add_column(xv_col);
-            xv_col->add_values_from_str(str);
-            xv_col->set_name(x_axis);
-            break;
+    string const* axis = r.find_attr("axis");
+    if (axis == NULL)
+        throw FormatError("axis of positions not given");
+    pos->axis = *axis;
+    while (r.next() == XmlReader::XML_START) {
+        if (r.name() == "startPosition") {
+            pos->start = r.read_text();
+        } else if (r.name() == "endPosition") {
+            pos->end = r.read_text();
+        } else if (r.name() == "commonPosition") {
+            pos->common = r.read_text();
+        } else if (r.name() == "listPositions") { // untested - no examples
+            double val;
+            while (r.read_number(&val, xml_spaces))
+                pos->list.push_back(val);
+            r.skip_element();
+        } else {
+            r.skip_element();
         }
     }
-    if (blk->get_column_count() == 0)
-        throw FormatError("cannot deduce x values");
+}
+
+// x column for point_count points
+Column* make_x_column(Positions const& pos, int point_count)
+{
+    ColumnWithName *col;
+    if (!pos.list.empty()) {
+        VecColumn *xv_col = new VecColumn;
+        for (size_t i = 0; i != pos.list.size(); ++i)
+            xv_col->add_val(pos.list[i]);
+        col = xv_col;
+    } else {
+        double x_start = my_strtod(pos.start);
+        double x_end = my_strtod(pos.end);
+        col = new StepColumn(x_start, (x_end - x_start) / (point_count - 1),
+                             point_count);
+    }
+    col->set_name(pos.axis);
+    return col;
+}
 
-    string inten_str = data_points.get<string>("intensities");
-    VecColumn *ycol = new VecColumn;
-    blk->add_column(ycol);
-    ycol->add_values_from_str(inten_str);
+// reads <dataPoints> element; intensities are parsed as they are read
+Block* read_data_points(XmlReader& r)
+{
+    Positions x_pos;
+    std::unique_ptr<VecColumn> ycol;
+    while (r.next() == XmlReader::XML_START) {
+        if (r.name() == "positions" && !x_pos.has_points()) {
+            Positions pos;
+            read_positions(r, &pos);
+            if (pos.has_points())
+                x_pos = pos;
+        } else if (r.name() == "intensities" && !ycol) {
+            ycol.reset(new VecColumn);
+            double val;
+            while (r.read_number(&val, xml_spaces))
+                ycol->add_val(val);
+            r.skip_element();
+        } else {
+            r.skip_element();
+        }
+    }
+    if (!x_pos.has_points())
+        throw FormatError("cannot deduce x values");
+    if (!ycol)
+        throw FormatError("intensities not found");
     if (ycol->get_point_count() < 2)
         throw FormatError("intensities do not look correct");
-    if (xs_col != NULL)
-        xs_col->set_step(xs_col->get_step() / (ycol->get_point_count() - 1));
+    Block *blk = new Block;
+    blk->add_column(make_x_column(x_pos, ycol->get_point_count()));
+    blk->add_column(ycol.release());
     //blk->set_name(title);
+    return blk;
+}
+
+// reads <scan> element, only the first <dataPoints> is used
+Block* read_scan(XmlReader& r)
+{
+    std::unique_ptr<Block> blk;
+    while (r.next() == XmlReader::XML_START) {
+        if (r.name() == "dataPoints" && !blk)
+            blk.reset(read_data_points(r));
+        else
+            r.skip_element();
+    }
+    if (!blk)
+        throw FormatError("scan without dataPoints");
     return blk.release();
 }
 
-void XrdmlDataSet::load_data(std::istream &f, const char*)
+// parses exactly n numbers from str
+void decode_intensities(string const& str, double* out, int n)
 {
-    ptree tree;
-    try {
-        boost::property_tree::read_xml(f, tree);
-        ptree top = tree.get_child("xrdMeasurements");
-        std::pair<ptiter, ptiter> mrange = top.equal_range("xrdMeasurement");
-        // todo: xrdMeasurement/usedWavelength -> metadata
-        for (ptiter i = mrange.first; i != mrange.second; ++i) {
-            std::pair<ptiter, ptiter> srange = i->second.equal_range("scan");
-            for (ptiter j = srange.first; j != srange.second; ++j) {
-                ptree data_points = j->second.get_child("dataPoints");
-                add_block(make_block_from_points(data_points));
+    const char* p = str.c_str();
+    for (int i = 0; i < n; ++i) {
+        char *endptr;
+        out[i] = strtod(p, &endptr);
+        if (endptr == p)
+            throw FormatError("scans have different numbers of points");
+        p = endptr;
+    }
+    while (isspace((unsigned char) *p))
+        ++p;
+    if (*p != '\0')
+        throw FormatError("scans have different numbers of points");
+}
+
+// Used with option "matrix": intensities of all scans are stored in one
+// array, scan after scan. The text of intensities is kept until a batch
+// of scans is read, then it's decoded in parallel.
+class ScanMatrix
+{
+public:
+    ScanMatrix() : point_count_(-1), scan_count_(0), data_(new VecColumn) {}
+
+    int scan_count() const { return scan_count_; }
+
+    // reads <scan> element
+    void read_scan(XmlReader& r)
+    {
+        vector<pair<string, double> > values; // positions of other axes
+        Positions x_pos;
+        string intensities;
+        bool has_points = false;
+        while (r.next() == XmlReader::XML_START) {
+            if (r.name() != "dataPoints" || has_points) {
+                r.skip_element();
+                continue;
             }
+            has_points = true;
+            while (r.next() == XmlReader::XML_START) {
+                if (r.name() == "positions") {
+                    Positions pos;
+                    read_positions(r, &pos);
+                    if (!x_pos.has_points() && pos.has_points()) {
+                        x_pos = pos;
+                    } else if (!pos.start.empty()) {
+                        values.push_back(make_pair(pos.axis + " start",
+                                                   my_strtod(pos.start)));
+                        values.push_back(make_pair(pos.axis + " end",
+                                                   my_strtod(pos.end)));
+                    } else if (!pos.common.empty()) {
+                        values.push_back(make_pair(pos.axis,
+                                                   my_strtod(pos.common)));
+                    }
+                } else if (r.name() == "intensities" && intensities.empty()) {
+                    intensities = r.read_text();
+                } else {
+                    r.skip_element();
+                }
+            }
+        }
+        if (!has_points)
+            throw FormatError("scan without dataPoints");
+        if (!x_pos.has_points())
+            throw FormatError("cannot deduce x values");
+        if (scan_count_ == 0)
+            x_pos_ = x_pos;
+        else if (!x_pos.same_points(x_pos_))
+            throw FormatError("option matrix: x values differ between scans");
+        add_positions(values);
+        pending_.push_back(string());
+        pending_.back().swap(intensities);
+        ++scan_count_;
+        if (pending_.size() >= batch_size)
+            decode_pending();
+    }
+
+    // adds blocks to ds; range of points is taken from ds->get_point_range()
+    void add_blocks(DataSet* ds)
+    {
+        decode_pending();
+        shared_ptr<const Column> x(make_x_column(x_pos_, point_count_));
+        pair<int, int> range = ds->get_point_range(*x, point_count_);
+        int count = range.second - range.first;
+        Block *blk = new Block;
+        blk->set_name("intensities");
+        blk->add_column(slice_column(x, range.first, count));
+        vector<shared_ptr<const Column> > scans = matrix_rows(data_,
+                point_count_, scan_count_, range.first, count, "scan", 1);
+        for (size_t i = 0; i != scans.size(); ++i)
+            blk->add_column(scans[i]);
+        ds->add_block(blk);
+
+        if (pos_names_.empty())
+            return;
+        blk = new Block;
+        blk->set_name("scan positions");
+        for (size_t i = 0; i != pos_names_.size(); ++i) {
+            VecColumn *col = new VecColumn;
+            col->set_name(pos_names_[i]);
+            col->reserve(pos_values_[i].size());
+            for (size_t j = 0; j != pos_values_[i].size(); ++j)
+                col->add_val(pos_values_[i][j]);
+            blk->add_column(col);
+        }
+        ds->add_block(blk);
+    }
+
+private:
+    static const size_t batch_size = 256;
+    Positions x_pos_;
+    int point_count_;
+    int scan_count_;
+    shared_ptr<VecColumn> data_;
+    vector<string> pending_; // intensities that are not decoded yet
+    vector<string> pos_names_;
+    vector<vector<double> > pos_values_;
+
+    // adds a row to pos_values_, with NaN for axes missing in this scan
+    void add_positions(vector<pair<string, double> > const& values)
+    {
+        for (size_t i = 0; i != values.size(); ++i) {
+            size_t n = find(pos_names_.begin(), pos_names_.end(),
+                            values[i].first) - pos_names_.begin();
+            if (n == pos_names_.size()) {
+                pos_names_.push_back(values[i].first);
+                pos_values_.push_back(vector<double>(scan_count_, NAN));
+            }
+            if (pos_values_[n].size() == (size_t) scan_count_)
+                pos_values_[n].push_back(values[i].second);
+        }
+        for (size_t n = 0; n != pos_values_.size(); ++n)
+            if (pos_values_[n].size() == (size_t) scan_count_)
+                pos_values_[n].push_back(NAN);
+    }
+
+    void decode_pending()
+    {
+        if (pending_.empty())
+            return;
+        if (point_count_ == -1) {
+            VecColumn first;
+            first.add_values_from_str(pending_[0]);
+            point_count_ = first.get_point_count();
+            if (point_count_ < 2)
+                throw FormatError("intensities do not look correct");
+        }
+        double *out = data_->extend(pending_.size() * point_count_);
+        int n = point_count_;
+        vector<string> const& texts = pending_;
+        parallel_for(texts.size(), [&](size_t i) {
+            decode_intensities(texts[i], out + i * n, n);
+        });
+        pending_.clear();
+    }
+};
+
+} // anonymous namespace
+
+// The file is parsed as it is read, without building a tree; intensities
+// are parsed directly into columns. Files from area detectors can be large.
+// With option "matrix" all scans are in one block, see xrdml.h.
+void XrdmlDataSet::load_data(std::istream &f, const char*)
+{
+    bool matrix = has_option("matrix");
+    ScanMatrix scan_matrix;
+    XmlReader r(f);
+    if (r.next() != XmlReader::XML_START || r.name() != "xrdMeasurements")
+        throw FormatError("xrdMeasurements element not found");
+    // todo: xrdMeasurement/usedWavelength -> metadata
+    while (r.next() == XmlReader::XML_START) {
+        if (r.name() != "xrdMeasurement") {
+            r.skip_element();
+            continue;
+        }
+        while (r.next() == XmlReader::XML_START) {
+            if (r.name() != "scan")
+                r.skip_element();
+            else if (matrix)
+                scan_matrix.read_scan(r);
+            else
+                add_block(read_scan(r));
         }
-    } catch (boost::property_tree::ptree_error& e) {
-        throw FormatError(e.what());
     }
+    if (scan_matrix.scan_count() > 0)
+        scan_matrix.add_blocks(this);
 }
 
 } // namespace xylib
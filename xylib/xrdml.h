@@ -3,6 +3,18 @@
 
 // A very well documented, XML-based format:
 // http://www.panalytical.com/Xray-diffraction-software/Data-Collector/XRDML/Information-documents-XML-schema.htm
+//
+// Each scan is read as a separate block. With option 'matrix' (meant for
+// area detector and mapping measurements with many scans) all scans must
+// have the same x values and one or two blocks are read:
+//  - "intensities": x column and one column per scan; the intensities
+//    are stored in one array, scan after scan, so get_raw_data() of the
+//    first scan points to the whole scans x points matrix (if all points
+//    are loaded),
+//  - "scan positions": one row per scan, with positions of other axes
+//    (e.g. X, Y, Phi); axes that move during the scan give two columns,
+//    "<axis> start" and "<axis> end"; this block is omitted if no other
+//    axes are given.
 
 #ifndef XYLIB_XRDML_H_
 #define XYLIB_XRDML_H_
@@ -1,17 +1,17 @@
 #define BUILDING_XYLIB
 #include "util.h"
 #include "xsyg.h"
+#include "xmlreader.h"
 
-#include <boost/property_tree/ptree.hpp>
-#include <boost/property_tree/xml_parser.hpp>
-#include <boost/algorithm/string.hpp>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <memory>  // for unique_ptr
 #include <string>
 #include <vector>
 #include <sstream>
 
-using boost::property_tree::ptree;
-typedef ptree::const_assoc_iterator ptiter;
-
 using namespace std;
 using namespace xylib::util;
 
@@ -29,116 +29,227 @@ const FormatInfo XsygDataSet::fmt_info(
 
 bool XsygDataSet::check(std::istream &f, string*)
 {
-    ptree tree;
-    read_xml(f, tree);
-    //check if child "Sample" is part of the XML file
-    return tree.count("Sample") != 0;
+    // Check if the root element is "Sample". Parsing the whole file here
+    // would be slow and would throw exceptions for non-XML files.
+    char buf[4096];
+    f.read(buf, sizeof(buf) - 1);
+    buf[f.gcount()] = '\0';
+    const char* p = buf;
+    if (strncmp(p, "\xEF\xBB\xBF", 3) == 0) // UTF-8 BOM
+        p += 3;
+    for (;;) {
+        while (isspace((unsigned char) *p))
+            ++p;
+        const char* end = NULL;
+        if (strncmp(p, "<?", 2) == 0)
+            end = strstr(p, "?>");
+        else if (strncmp(p, "<!--", 4) == 0)
+            end = strstr(p, "-->");
+        else if (strncmp(p, "<!", 2) == 0)
+            end = strchr(p, '>');
+        else
+            break;
+        if (end == NULL)
+            return false;
+        p = strchr(end, '>') + 1;
+    }
+    return strncmp(p, "<Sample", 7) == 0 &&
+           (isspace((unsigned char) p[7]) || p[7] == '>' || p[7] == '/');
+}
+
+namespace {
+
+// appends numbers "y1|y2|...|yn" from [p, end) to col
+void add_bar_separated(const char* p, const char* end, VecColumn* col)
+{
+    const char* start = p;
+    while (p < end && (isspace((unsigned char) *p) || *p == '|'))
+        ++p;
+    while (p < end) {
+        char *endptr;
+        double val = strtod(p, &endptr);
+        if (endptr == p || endptr > end)
+            throw FormatError("Number not found in line:\n"
+                              + string(start, end));
+        col->add_val(val);
+        p = endptr;
+        while (p < end && (isspace((unsigned char) *p) || *p == '|'))
+            ++p;
+    }
+}
+
+// <Curve> element, the data is decoded in decode_curve()
+struct Curve
+{
+    std::unique_ptr<Block> blk;
+    bool spectrometer; // detector="Spectrometer"
+    std::string x_desc, y_desc;
+    std::string wavelengths; // attribute wavelengthTable of spectrometer
+    std::string text; // data between <Curve> ... </Curve>
+
+    // results of decode_curve()
+    std::unique_ptr<VecColumn> x_col;
+    std::vector<std::shared_ptr<const Column> > y_cols;
+};
+
+// Decodes the text in place: tokens are not copied to temporary strings.
+// Different curves can be decoded in different threads.
+void decode_curve(Curve& c)
+{
+    c.x_col.reset(new VecColumn);
+    c.x_col->set_name(c.x_desc);
+    const char* p = c.text.c_str();
+    const char* end = p + c.text.size();
+    if (!c.spectrometer) {
+        // data "x1,y1;x2,y2;...", tokens without ',' are ignored
+        VecColumn *y_col = new VecColumn;
+        c.y_cols.push_back(shared_ptr<const Column>(y_col));
+        y_col->set_name(c.y_desc);
+        for (; p < end; ++p) {
+            const char* semi = (const char*) memchr(p, ';', end - p);
+            if (semi == NULL)
+                semi = end;
+            const char* comma = (const char*) memchr(p, ',', semi - p);
+            if (comma != NULL) {
+                c.x_col->add_val(my_strtod(p, comma - p));
+                y_col->add_val(my_strtod(comma + 1, semi - comma - 1));
+            }
+            p = semi;
+        }
+    } else {
+        // wavelengths "w1;w2;..." and data "t1,[y1|y2|...yn];t2,[...];..."
+        c.x_col->add_values_from_str(c.wavelengths, ';');
+        // all spectra are stored in one column, y_cols are slices of it
+        shared_ptr<VecColumn> spectra(new VecColumn);
+        for (; p < end; ++p) {
+            const char* semi = (const char*) memchr(p, ';', end - p);
+            if (semi == NULL)
+                semi = end;
+            const char* comma = (const char*) memchr(p, ',', semi - p);
+            const char* open_br = comma ? (const char*)
+                         memchr(comma, '[', semi - comma) : NULL;
+            const char* close_br = open_br ? (const char*)
+                         memchr(open_br, ']', semi - open_br) : NULL;
+            if (close_br != NULL) {
+                int first = spectra->get_point_count();
+                add_bar_separated(open_br + 1, close_br, spectra.get());
+                SliceColumn *y_col = new SliceColumn(spectra, first,
+                                       spectra->get_point_count() - first);
+                c.y_cols.push_back(shared_ptr<const Column>(y_col));
+                y_col->set_name(str_trim(string(p, comma)));
+            }
+            p = semi;
+        }
+    }
+    string().swap(c.text);
 }
 
+// reads <Curve> element (the data is decoded later)
+void read_curve(XmlReader& r, Curve& c)
+{
+    c.blk.reset(new Block);
+    Block *blk = c.blk.get();
+    string curveDesc = r.attr("curveDescripter");
+    str_split(curveDesc, ';', c.x_desc, c.y_desc);
+    blk->meta["curveDescriptor"] = curveDesc;
+    blk->meta["state"] = r.attr("state");
+    string detector = r.attr("detector");
+    blk->meta["detector"] = detector;
+    blk->meta["startDate"] = r.attr("startDate");
+    blk->meta["offset"] = r.attr("offset");
+    c.spectrometer = (detector == "Spectrometer");
+    if (!c.spectrometer) {
+        blk->meta["stimulator"] = r.attr("stimulator");
+    } else {
+        c.wavelengths = r.attr("wavelengthTable");
+        blk->meta["duration"] = r.attr("duration");
+        blk->meta["calibration"] = r.attr("calibration");
+        blk->meta["cameraType"] = r.attr("cameraType");
+        blk->meta["integrationTime"] = r.attr("integrationTime");
+        blk->meta["channelTime"] = r.attr("channelTime");
+        blk->meta["CCD_temperature"] = r.attr("CCD_temperature");
+    }
+    c.text = r.read_text();
+}
+
+// Decodes curves in parallel and adds them as blocks, in the original order.
+// Curves with the same abscissa share x column.
+void add_curves(DataSet* ds, vector<Curve>& curves, ColumnPool& x_cols)
+{
+    parallel_for(curves.size(), [&curves](size_t i) {
+        decode_curve(curves[i]);
+    });
+    for (size_t i = 0; i != curves.size(); ++i) {
+        Curve& c = curves[i];
+        c.blk->add_column(x_cols.share(c.x_col.release()));
+        for (size_t j = 0; j != c.y_cols.size(); ++j)
+            c.blk->add_column(c.y_cols[j]);
+        ds->add_block(c.blk.release());
+    }
+    curves.clear();
+}
+
+} // anonymous namespace
+
+// The file is parsed as it is read, without building a tree.
+// The data of curves is decoded in batches, in parallel.
 void XsygDataSet::load_data(std::istream &f, const char*) {
-    ptree tree;
-    read_xml(f, tree);
-    ptree sample = tree.get_child("Sample");
+    const size_t batch_size = 256; // max. number of curves waiting for decoding
+    XmlReader r(f);
+    if (r.next() != XmlReader::XML_START || r.name() != "Sample")
+        throw FormatError("Sample element not found");
 
     //store metaData
-    meta["state"] = sample.get("<xmlattr>.state", "");
-    meta["name"] = sample.get("<xmlattr>.name", "");
-    meta["user"] = sample.get("<xmlattr>.user", "");
-    meta["startDate"] = sample.get("<xmlattr>.startDate", "");
-    meta["sampleCarrier"] = sample.get("<xmlattr>.sampleCarrier", "");
-    meta["lexsygID"] = sample.get("<xmlattr>.lexsygID", "");
-    meta["lexStudioVersion"] = sample.get("<xmlattr>.lexStudioVersion", "");
-    meta["firmwareVersion"] = sample.get("<xmlattr>.firmwareVersion", "");
-    meta["os"] = sample.get("<xmlattr>.os", "");
-    meta["comment"] = sample.get("<xmlattr>.comment", "");
+    meta["state"] = r.attr("state");
+    meta["name"] = r.attr("name");
+    meta["user"] = r.attr("user");
+    meta["startDate"] = r.attr("startDate");
+    meta["sampleCarrier"] = r.attr("sampleCarrier");
+    meta["lexsygID"] = r.attr("lexsygID");
+    meta["lexStudioVersion"] = r.attr("lexStudioVersion");
+    meta["firmwareVersion"] = r.attr("firmwareVersion");
+    meta["os"] = r.attr("os");
+    meta["comment"] = r.attr("comment");
 
     int AQ_nr = 0;
-    std::pair<ptiter, ptiter> sequenceRange = sample.equal_range("Sequence");
-    for (ptiter it_seq = sequenceRange.first; it_seq != sequenceRange.second; ++it_seq) {
+    ColumnPool x_cols; // curves with the same abscissa share x column
+    vector<Curve> curves;
+    while (r.next() == XmlReader::XML_START) {
+        if (r.name() != "Sequence") {
+            r.skip_element();
+            continue;
+        }
         ++AQ_nr;
-        std::pair<ptiter, ptiter> recordRange = it_seq->second.equal_range("Record");
         int measurement_nr = 0;
         //loop Measurements
-        for (ptiter i = recordRange.first; i != recordRange.second; ++i) {
-            std::pair<ptiter, ptiter> curveRange = i->second.equal_range("Curve");
-            string recordType = i->second.get("<xmlattr>.recordType", "");
+        while (r.next() == XmlReader::XML_START) {
+            if (r.name() != "Record") {
+                r.skip_element();
+                continue;
+            }
+            string recordType = r.attr("recordType");
             //loop Curves
-            for (ptiter j = curveRange.first; j != curveRange.second; ++j) {
-                if (j->second.get("<xmlattr>.curveType", "") != "measured")
+            while (r.next() == XmlReader::XML_START) {
+                if (r.name() != "Curve" ||
+                        r.attr("curveType") != "measured" ||
+                        r.attr("detector") == "") {
+                    r.skip_element();
                     continue;
-                if (j->second.get("<xmlattr>.detector", "") == "")
-                    continue;
-                Block *blk = new Block;
-                ++measurement_nr;
-                string curveDesc = j->second.get("<xmlattr>.curveDescripter", "");
-                std::string x_desc, y_desc;
-                str_split(curveDesc, ';', x_desc, y_desc);
-                blk->meta["curveDescriptor"] = curveDesc;
-                blk->meta["state"] = j->second.get("<xmlattr>.state", "");
-                string detector = j->second.get("<xmlattr>.detector", "");
-                blk->meta["detector"] = detector;
-                blk->meta["startDate"] = j->second.get("<xmlattr>.startDate", "");
-                blk->meta["offset"] = j->second.get("<xmlattr>.offset", "");
-                VecColumn *x_col = new VecColumn;
-                x_col->set_name(x_desc);
-                std::istringstream curve_ss(j->second.data());
-                if (j->second.get("<xmlattr>.detector", "") != "Spectrometer") {
-                    VecColumn *y_col = new VecColumn;
-                    y_col->set_name(y_desc);
-
-                    // read data between <Curve> ... </Curve>
-                    std::string token;
-                    while (std::getline(curve_ss, token, ';')) {
-                        size_t pos = token.find(',');
-                        if (pos != std::string::npos) {
-                            x_col->add_val(my_strtod(token.substr(0, pos)));
-                            y_col->add_val(my_strtod(token.substr(pos+1)));
-                        }
-                    }
-
-                    blk->meta["stimulator"] = j->second.get("<xmlattr>.stimulator", "");
-
-                    blk->add_column(x_col);
-                    blk->add_column(y_col);
-                } else { // detector="Spectrometer"
-                    // read wavelength from attribute "wavelengthTable"
-                    std::string wavelengths = j->second.get("<xmlattr>.wavelengthTable", "");
-                    x_col->add_values_from_str(wavelengths, ';');
-                    blk->add_column(x_col);
-
-                    // read data between <Curve> ... </Curve>
-                    std::string token;
-                    while (std::getline(curve_ss, token, ';')) {
-                        size_t pos = token.find(',');
-                        size_t open_br = token.find('[', pos);
-                        size_t close_br = token.find(']', open_br);
-                        if (close_br != std::string::npos) {
-                            VecColumn *y_col = new VecColumn;
-                            y_col->set_name(str_trim(token.substr(0, pos)));
-                            // read [y1|y2|...yn]
-                            std::string ystr(token, open_br+1, close_br-open_br-1);
-                            y_col->add_values_from_str(ystr, '|');
-                            blk->add_column(y_col);
-                        }
-                    }
-
-                    //add meta data
-                    blk->meta["startDate"] = j->second.get("<xmlattr>.startDate", "");
-                    blk->meta["duration"] = j->second.get("<xmlattr>.duration", "");
-                    blk->meta["calibration"] = j->second.get("<xmlattr>.calibration", "");
-                    blk->meta["cameraType"] = j->second.get("<xmlattr>.cameraType", "");
-                    blk->meta["integrationTime"] = j->second.get("<xmlattr>.integrationTime", "");
-                    blk->meta["channelTime"] = j->second.get("<xmlattr>.channelTime", "");
-                    blk->meta["CCD_temperature"] = j->second.get("<xmlattr>.CCD_temperature", "");
                 }
+                ++measurement_nr;
                 ostringstream name;
                 name << "AQ: " << AQ_nr << ", Meas.: " << measurement_nr
-                     << ", Type: "  << recordType << " ("  << detector  << ')';
-                blk->set_name(name.str());
-                add_block(blk);
+                     << ", Type: "  << recordType << " ("
+                     << r.attr("detector")  << ')';
+                curves.resize(curves.size() + 1);
+                read_curve(r, curves.back());
+                curves.back().blk->set_name(name.str());
+                if (curves.size() >= batch_size)
+                    add_curves(this, curves, x_cols);
             } // end loop curves
         } // end loop measurements
     }
+    add_curves(this, curves, x_cols);
 } // end load_data
 
 }// namespace xylib
@@ -7,9 +7,18 @@
 #include <cassert>
 #include <cstring>
 #include <climits>  // for INT_MAX
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
 #include <iomanip>
 #include <algorithm>
 #include <sstream>  // for istringstream
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <unordered_set>
 #include <sys/types.h>
 #include <sys/stat.h>
 
@@ -26,6 +35,7 @@
 #endif
 
 #include "util.h"
+#include "fileio.h"
 #include "bruker_raw.h"
 #include "bruker_spc.h"
 #include "rigaku_dat.h"
@@ -127,13 +137,9 @@ const char* xylib_get_version()
 void* xylib_load_file(const char* path, const char* format_name,
                       const char* options)
 {
-    try {
-        return (void*) load_file(path, format_name != NULL ? format_name : "",
-                                       options != NULL ? options : "");
-    }
-    catch (std::exception&) {
-        return NULL;
-    }
+    LoadResult r = try_load_file(path, format_name != NULL ? format_name : "",
+                                 options != NULL ? options : "");
+    return (void*) r.dataset;
 }
 
 void* xylib_get_block(void* dataset, int block)
@@ -212,8 +218,156 @@ bool check_format(FormatInfo const* fi, std::istream& f, string* details)
     return !fi->checker || (*fi->checker)(f, details);
 }
 
-struct MetaDataImp : public map<string, string>
+namespace {
+
+// the shortest string that is converted back to the same number
+string shortest_repr(double d, bool single)
+{
+    char buf[32];
+    for (int prec = (single ? 6 : 15); ; ++prec) {
+        snprintf(buf, sizeof(buf), "%.*g", prec, d);
+        double back = strtod(buf, NULL);
+        if (prec >= (single ? 9 : 17) ||
+                (single ? (float) back == (float) d : back == d))
+            break;
+    }
+    return buf;
+}
+
+string format_time(long long unix_time)
+{
+    time_t t = (time_t) unix_time;
+    struct tm tm_buf; // gmtime() is not thread-safe
+#ifdef _WIN32
+    gmtime_s(&tm_buf, &t);
+#else
+    gmtime_r(&t, &tm_buf);
+#endif
+    char s[64];
+    if (strftime(s, sizeof(s), "%a, %Y-%m-%d %H:%M:%S", &tm_buf) == 0)
+        return S((long) unix_time);
+    return s;
+}
+
+} // anonymous namespace
+
+struct MetaDataImp
 {
+    enum ValueType { MV_STRING, MV_DOUBLE, MV_FLOAT, MV_INT, MV_TIME };
+    struct Entry
+    {
+        string const* key; // in keys
+        string value; // used for MV_STRING
+        union { double d; long long i; } num;
+        char type; // ValueType
+        util::LazyValue<string> formatted; // number converted to string
+    };
+    // Keys are stored once per dataset: blocks added to DataSet use the key
+    // table of the dataset's meta-data. A table is modified only when a key
+    // is added, so, like other writes, it's not thread-safe.
+    typedef std::unordered_set<string> KeyTable;
+    shared_ptr<KeyTable> keys;
+    // entries in order of insertion (deque doesn't invalidate references
+    // returned by MetaData::operator[] when new entries are appended)
+    std::deque<Entry> entries;
+    // indices of entries sorted by key
+    vector<unsigned> order;
+
+    Entry const& at(size_t index) const { return entries[order[index]]; }
+
+    string const* intern(string const& key)
+    {
+        if (!keys)
+            keys = make_shared<KeyTable>();
+        return &*keys->insert(key).first;
+    }
+
+    // numbers are converted to string when it's needed for the first time;
+    // it doesn't take a lock, so reading is cheap from many threads
+    static string const& str(Entry const& e)
+    {
+        if (e.type == MV_STRING)
+            return e.value;
+        return e.formatted.get([&e]() -> string {
+            switch (e.type) {
+                case MV_DOUBLE: return shortest_repr(e.num.d, false);
+                case MV_FLOAT: return shortest_repr(e.num.d, true);
+                case MV_INT: return S(e.num.i);
+                default: return format_time(e.num.i); // MV_TIME
+            }
+        });
+    }
+
+    // position in order where key is or should be inserted
+    size_t lower_bound(const char* key, size_t len) const
+    {
+        size_t lo = 0, hi = order.size();
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (at(mid).key->compare(0, string::npos, key, len) < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return lo;
+    }
+
+    Entry const* find_entry(const char* key, size_t len) const
+    {
+        size_t pos = lower_bound(key, len);
+        if (pos != order.size()) {
+            Entry const& e = at(pos);
+            if (e.key->compare(0, string::npos, key, len) == 0)
+                return &e;
+        }
+        return NULL;
+    }
+
+    string const* find(const char* key, size_t len) const
+    {
+        Entry const* e = find_entry(key, len);
+        return e ? &str(*e) : NULL;
+    }
+
+    Entry const& get_entry(string const& key) const
+    {
+        Entry const* e = find_entry(key.data(), key.size());
+        if (e == NULL)
+            throw RunTimeError("no such key in meta-info found");
+        return *e;
+    }
+
+    // returns entry with key, inserted is set if it was added;
+    // only the index of the new entry is inserted in the middle of order
+    Entry& get_or_insert(string const& key, bool* inserted)
+    {
+        size_t pos = lower_bound(key.data(), key.size());
+        if (pos != order.size() && *at(pos).key == key) {
+            *inserted = false;
+            return entries[order[pos]];
+        }
+        entries.push_back(Entry());
+        Entry& e = entries.back();
+        e.key = intern(key);
+        e.type = MV_STRING;
+        e.num.i = 0;
+        order.insert(order.begin() + pos, (unsigned) entries.size() - 1);
+        *inserted = true;
+        return e;
+    }
+
+    void set_number(string const& key, ValueType type, double d, long long i)
+    {
+        bool inserted;
+        Entry& e = get_or_insert(key, &inserted);
+        e.type = type;
+        e.value.clear();
+        e.formatted.reset();
+        if (type == MV_DOUBLE || type == MV_FLOAT)
+            e.num.d = d;
+        else
+            e.num.i = i;
+    }
 };
 
 MetaData::MetaData()
@@ -233,44 +387,261 @@ void MetaData::operator=(const MetaData& other)
 
 bool MetaData::has_key(std::string const& key) const
 {
-    return imp_->find(key) != imp_->end();
+    return imp_->find(key.data(), key.size()) != NULL;
 }
 
 string const& MetaData::get(string const& key) const
 {
-    map<string,string>::const_iterator it = imp_->find(key);
-    if (it == imp_->end())
-        throw RunTimeError("no such key in meta-info found");
-    return it->second;
+    return MetaDataImp::str(imp_->get_entry(key));
+}
+
+double MetaData::get_double(string const& key) const
+{
+    MetaDataImp::Entry const& e = imp_->get_entry(key);
+    switch (e.type) {
+        case MetaDataImp::MV_DOUBLE:
+        case MetaDataImp::MV_FLOAT:
+            return e.num.d;
+        case MetaDataImp::MV_INT:
+        case MetaDataImp::MV_TIME:
+            return (double) e.num.i;
+    }
+    const char* start = e.value.c_str();
+    char* endptr;
+    double val = strtod(start, &endptr);
+    while (isspace((unsigned char) *endptr))
+        ++endptr;
+    if (endptr == start || *endptr != '\0')
+        throw RunTimeError("meta-info " + key + " is not a number");
+    return val;
+}
+
+long long MetaData::get_int(string const& key) const
+{
+    MetaDataImp::Entry const& e = imp_->get_entry(key);
+    switch (e.type) {
+        case MetaDataImp::MV_INT:
+        case MetaDataImp::MV_TIME:
+            return e.num.i;
+        case MetaDataImp::MV_DOUBLE:
+        case MetaDataImp::MV_FLOAT:
+            if (e.num.d != floor(e.num.d) || fabs(e.num.d) > 9e18)
+                throw RunTimeError("meta-info " + key + " is not integer");
+            return (long long) e.num.d;
+    }
+    const char* start = e.value.c_str();
+    char* endptr;
+    long long val = strtoll(start, &endptr, 10);
+    while (isspace((unsigned char) *endptr))
+        ++endptr;
+    if (endptr == start || *endptr != '\0')
+        throw RunTimeError("meta-info " + key + " is not integer");
+    return val;
+}
+
+string const* MetaData::find(const char* key, size_t len) const
+{
+    return imp_->find(key, len);
+}
+
+void MetaData::set_double(string const& key, double val)
+{
+    imp_->set_number(key, MetaDataImp::MV_DOUBLE, val, 0);
+}
+
+void MetaData::set_float(string const& key, float val)
+{
+    imp_->set_number(key, MetaDataImp::MV_FLOAT, val, 0);
+}
+
+void MetaData::set_int(string const& key, long long val)
+{
+    imp_->set_number(key, MetaDataImp::MV_INT, 0., val);
+}
+
+void MetaData::set_time(string const& key, long long unix_time)
+{
+    imp_->set_number(key, MetaDataImp::MV_TIME, 0., unix_time);
 }
 
 bool MetaData::set(string const& key, string const& val)
 {
-    //map::insert returns pair<iterator,bool>
-    return imp_->insert(make_pair(key, val)).second;
+    bool inserted;
+    MetaDataImp::Entry& e = imp_->get_or_insert(key, &inserted);
+    if (inserted)
+        e.value = val;
+    return inserted;
 }
 
 size_t MetaData::size() const
 {
-    return imp_->size();
+    return imp_->order.size();
 }
 
 string const& MetaData::get_key(size_t index) const
 {
-    map<string,string>::const_iterator it = imp_->begin();
-    for (size_t i = 0; i < index; ++i)
-        ++it;
-    return it->first;
+    return *imp_->at(index).key;
+}
+
+string const& MetaData::get_value(size_t index) const
+{
+    return MetaDataImp::str(imp_->at(index));
 }
 
 void MetaData::clear()
 {
-    imp_->clear();
+    imp_->entries.clear();
+    imp_->order.clear();
+}
+
+void MetaData::share_keys(MetaData& other)
+{
+    if (!other.imp_->keys)
+        other.imp_->keys = make_shared<MetaDataImp::KeyTable>();
+    if (imp_->keys == other.imp_->keys)
+        return;
+    // the old table is kept until all entries point to the new one
+    shared_ptr<MetaDataImp::KeyTable> old_keys = imp_->keys;
+    imp_->keys = other.imp_->keys;
+    for (size_t i = 0; i != imp_->entries.size(); ++i) {
+        MetaDataImp::Entry& e = imp_->entries[i];
+        e.key = imp_->intern(*e.key);
+    }
 }
 
 string& MetaData::operator[] (string const& x)
 {
-    return (*imp_)[x];
+    bool inserted;
+    MetaDataImp::Entry& e = imp_->get_or_insert(x, &inserted);
+    // the caller can modify the value, so it can't be a number anymore
+    if (e.type != MetaDataImp::MV_STRING) {
+        e.value = MetaDataImp::str(e);
+        e.formatted.reset();
+        e.type = MetaDataImp::MV_STRING;
+    }
+    return e.value;
+}
+
+
+int get_dtype_size(DataType dt)
+{
+    switch (dt) {
+        case DT_FLOAT64: return 8;
+        case DT_FLOAT32:
+        case DT_INT32:
+        case DT_UINT32: return 4;
+        case DT_INT16:
+        case DT_UINT16: return 2;
+    }
+    return 0;
+}
+
+void Column::get_values(int first, int count, double* out) const
+{
+    for (int i = 0; i < count; ++i)
+        out[i] = get_value(first + i);
+}
+
+namespace {
+
+int finite_point_count(Column const& col)
+{
+    int n = col.get_point_count();
+    if (n == -1)
+        throw RunTimeError("this operation needs column of finite length");
+    return n;
+}
+
+// Binary search in [begin, end) for the first index for which pred(value)
+// is true; pred must be false for all points before it and true after it.
+template<typename Pred>
+int partition_point(Column const& col, int begin, int end, Pred pred)
+{
+    while (begin < end) {
+        int mid = begin + (end - begin) / 2;
+        if (pred(col.get_value(mid)))
+            end = mid;
+        else
+            begin = mid + 1;
+    }
+    return begin;
+}
+
+} // anonymous namespace
+
+int Column::get_sort_order() const
+{
+    ValueScanner vs;
+    vs.add_column(*this, 0, finite_point_count(*this));
+    return vs.get_stats().order;
+}
+
+ColumnStats Column::get_stats(int point_count) const
+{
+    int n = get_point_count();
+    if (n == -1) {
+        if (point_count == 0)
+            throw RunTimeError("get_stats() needs point_count for column "
+                               "of unlimited length");
+        n = point_count;
+    }
+    ValueScanner vs;
+    vs.add_column(*this, 0, n);
+    return vs.get_stats();
+}
+
+int Column::lower_bound(double x) const
+{
+    int n = finite_point_count(*this);
+    int order = get_sort_order();
+    if (order == 1)
+        return partition_point(*this, 0, n,
+                               [x](double v) { return v >= x; });
+    if (order == -1)
+        return n > 0 && get_value(0) >= x ? 0 : n;
+    double buf[1024];
+    for (int i = 0; i < n; i += 1024) {
+        int k = min(1024, n - i);
+        get_values(i, k, buf);
+        for (int j = 0; j < k; ++j)
+            if (buf[j] >= x)
+                return i + j;
+    }
+    return n;
+}
+
+pair<int, int> Column::find_range(double lo, double hi) const
+{
+    int n = finite_point_count(*this);
+    int order = get_sort_order();
+    int first, last;
+    if (order == 1) {
+        first = partition_point(*this, 0, n,
+                                [lo](double v) { return v >= lo; });
+        last = partition_point(*this, first, n,
+                               [hi](double v) { return v > hi; });
+    } else if (order == -1) {
+        first = partition_point(*this, 0, n,
+                                [hi](double v) { return v <= hi; });
+        last = partition_point(*this, first, n,
+                               [lo](double v) { return v < lo; });
+    } else {
+        first = n;
+        last = 0;
+        double buf[1024];
+        for (int i = 0; i < n; i += 1024) {
+            int k = min(1024, n - i);
+            get_values(i, k, buf);
+            for (int j = 0; j < k; ++j)
+                if (lo <= buf[j] && buf[j] <= hi) {
+                    first = min(first, i + j);
+                    last = i + j + 1;
+                }
+        }
+    }
+    if (first >= last)
+        return make_pair(0, 0);
+    return make_pair(first, last);
 }
 
 
@@ -279,7 +650,7 @@ Column* const Block::index_column = new StepColumn(0, 1);
 struct BlockImp
 {
     string name;
-    vector<Column*> cols;
+    vector<shared_ptr<const Column> > cols;
 };
 
 Block::Block()
@@ -289,7 +660,6 @@ Block::Block()
 
 Block::~Block()
 {
-    purge_all_elements(imp_->cols);
     delete imp_;
 }
 
@@ -318,14 +688,30 @@ const Column& Block::get_column(int n) const
     return *imp_->cols[c];
 }
 
+shared_ptr<const Column> Block::get_column_ptr(int n) const
+{
+    if (n == 0) // static column, it's never deleted
+        return shared_ptr<const Column>(shared_ptr<const Column>(),
+                                        index_column);
+    int c = (n < 0 ? n + (int) imp_->cols.size() : n - 1);
+    if (c < 0 || c >= (int) imp_->cols.size())
+        throw RunTimeError("column index out of range: " + S(n));
+    return imp_->cols[c];
+}
+
 void Block::add_column(Column* c, bool append)
+{
+    add_column(shared_ptr<Column>(c), append);
+}
+
+void Block::add_column(shared_ptr<const Column> const& c, bool append)
 {
     imp_->cols.insert((append ? imp_->cols.end() : imp_->cols.begin()), c);
 }
 
-Column* Block::del_column(int n)
+shared_ptr<const Column> Block::del_column(int n)
 {
-    Column *c = imp_->cols[n];
+    shared_ptr<const Column> c = imp_->cols[n];
     imp_->cols.erase(imp_->cols.begin() + n);
     return c;
 }
@@ -333,8 +719,8 @@ Column* Block::del_column(int n)
 int Block::get_point_count() const
 {
     int min_n = -1;
-    for (vector<Column*>::const_iterator i = imp_->cols.begin();
-                                                i != imp_->cols.end(); ++i) {
+    typedef vector<shared_ptr<const Column> >::const_iterator iter;
+    for (iter i = imp_->cols.begin(); i != imp_->cols.end(); ++i) {
         int n = (*i)->get_point_count();
         if (min_n == -1 || (n != -1 && n < min_n))
             min_n = n;
@@ -342,10 +728,70 @@ int Block::get_point_count() const
     return min_n;
 }
 
+shared_ptr<const Column> slice_column(shared_ptr<const Column> const& col,
+                                      int first, int count)
+{
+    if (!col)
+        throw RunTimeError("slice_column(): no column");
+    int n = col->get_point_count();
+    if (first < 0 || count < -1 ||
+            (n != -1 && (first > n || count > n - first)))
+        throw RunTimeError("slice out of range of the column");
+    if (count == -1 && n != -1)
+        count = n - first;
+    // the whole column is not wrapped
+    if (first == 0 && count == n)
+        return col;
+    // don't make views of views
+    if (const SliceColumn* sc = dynamic_cast<const SliceColumn*>(col.get()))
+        return make_shared<SliceColumn>(sc->base(), sc->first() + first,
+                                        count);
+    return make_shared<SliceColumn>(col, first, count);
+}
+
+shared_ptr<const Column> concat_columns(
+                                vector<shared_ptr<const Column> > const& cols)
+{
+    if (cols.size() == 1)
+        return cols[0];
+    return make_shared<ConcatColumn>(cols);
+}
+
+Block* block_view(Block const& block, vector<int> const& columns,
+                  int first_row, int row_count)
+{
+    Block* blk = new Block;
+    try {
+        for (size_t i = 0; i != columns.size(); ++i) {
+            blk->add_column(slice_column(block.get_column_ptr(columns[i]),
+                                         first_row, row_count));
+        }
+    } catch (...) {
+        delete blk;
+        throw;
+    }
+    blk->meta = block.meta;
+    blk->set_name(block.get_name());
+    return blk;
+}
+
+// points requested with option x-range or index-range
+struct PointRange
+{
+    bool by_x;
+    double lo, hi;
+    int first, end; // end == -1 means the last point
+};
+
 struct DataSetImp
 {
+    DataSetImp() : has_range(false), range_handled(false) {}
+
     std::vector<Block*> blocks;
     std::string options;
+    bool has_range;
+    bool range_handled; // true if get_point_range() was called by loader
+    PointRange range;
 };
 
 DataSet::DataSet(FormatInfo const* fi_)
@@ -385,48 +831,240 @@ bool DataSet::has_option(string const& t)
     return has_word(imp_->options, t);
 }
 
+bool DataSet::get_option_value(string const& name, string* value)
+{
+    if (!is_valid_option(name))
+        throw RunTimeError("invalid option for format "+S(fi->name)+": "+name);
+    string prefix = name + "=";
+    for (const char *p = imp_->options.c_str(); *p != '\0'; ) {
+        while (isspace(*p))
+            ++p;
+        const char* end = p;
+        while (*end != '\0' && !isspace(*end))
+            ++end;
+        if ((size_t) (end - p) >= prefix.size() &&
+                prefix.compare(0, prefix.size(), p, prefix.size()) == 0) {
+            value->assign(p + prefix.size(), end);
+            return true;
+        }
+        p = end;
+    }
+    return false;
+}
+
 void DataSet::add_block(Block* block)
 {
+    // the same keys in many blocks are stored once
+    block->meta.share_keys(meta);
     imp_->blocks.push_back(block);
 }
 
+namespace {
+
+// parses "LO:HI", where LO and HI are optional
+void parse_range(string const& opt, string const& value, double* lo,
+                 double* hi)
+{
+    size_t colon = value.find(':');
+    if (colon == string::npos)
+        throw RunTimeError("wrong option: " + opt + "=" + value);
+    string a = str_trim(value.substr(0, colon));
+    string b = str_trim(value.substr(colon + 1));
+    if ((!a.empty() && parse_double(a, lo) != NULL) ||
+            (!b.empty() && parse_double(b, hi) != NULL))
+        throw RunTimeError("wrong option: " + opt + "=" + value);
+}
+
+pair<int, int> point_range(PointRange const& r, Column const& x, int n)
+{
+    if (n == -1)
+        n = INT_MAX;
+    pair<int, int> p;
+    if (r.by_x)
+        p = x.find_range(r.lo, r.hi);
+    else
+        p = make_pair(r.first, r.end == -1 ? n : r.end);
+    p.second = min(p.second, n);
+    p.first = min(p.first, p.second);
+    return p;
+}
+
+// cut all blocks to the requested range of points
+void cut_blocks(DataSet* ds, PointRange const& range)
+{
+    for (int i = 0; i < ds->get_block_count(); ++i) {
+        // blocks are owned by the dataset, we can modify them here
+        Block *blk = const_cast<Block*>(ds->get_block(i));
+        int n = blk->get_column_count();
+        if (n == 0)
+            continue;
+        pair<int, int> p = point_range(range, blk->get_column(1),
+                                       blk->get_point_count());
+        for (int j = 0; j < n; ++j) {
+            shared_ptr<const Column> col = blk->del_column(0);
+            blk->add_column(slice_column(col, p.first, p.second - p.first));
+        }
+    }
+}
+
+} // anonymous namespace
+
 void DataSet::set_options(string const& options)
 {
     imp_->options = options;
+    imp_->has_range = false;
+    imp_->range_handled = false;
+    PointRange& r = imp_->range;
+    r.lo = -HUGE_VAL;
+    r.hi = HUGE_VAL;
+    r.first = 0;
+    r.end = -1;
+    for (const char *p = options.c_str(); *p != '\0'; ) {
+        while (isspace(*p))
+            ++p;
+        const char* end = p;
+        while (*end != '\0' && !isspace(*end))
+            ++end;
+        string opt(p, end);
+        p = end;
+        size_t eq = opt.find('=');
+        if (eq == string::npos)
+            continue;
+        string name = opt.substr(0, eq);
+        if (name != "x-range" && name != "index-range")
+            continue;
+        if (imp_->has_range)
+            throw RunTimeError("only one of x-range and index-range "
+                               "can be given");
+        imp_->has_range = true;
+        r.by_x = (name == "x-range");
+        if (r.by_x) {
+            parse_range(name, opt.substr(eq + 1), &r.lo, &r.hi);
+        } else {
+            double first = 0, end = -1;
+            parse_range(name, opt.substr(eq + 1), &first, &end);
+            if (first < 0 || first > INT_MAX || end > INT_MAX ||
+                    (end != -1 && end < 0))
+                throw RunTimeError("wrong option: " + opt);
+            r.first = (int) first;
+            r.end = (int) end;
+        }
+    }
 }
 
-bool DataSet::is_valid_option(std::string const& opt) const
+pair<int, int> DataSet::get_point_range(Column const& x, int n)
+{
+    imp_->range_handled = true;
+    if (!imp_->has_range)
+        return make_pair(0, n);
+    return point_range(imp_->range, x, n);
+}
+
+bool DataSet::get_x_range(double* lo, double* hi) const
+{
+    if (!imp_->has_range || !imp_->range.by_x)
+        return false;
+    *lo = imp_->range.lo;
+    *hi = imp_->range.hi;
+    return true;
+}
+
+namespace {
+
+// options handled in load_stream_of_format(), valid for all formats
+const char* generic_options = "compact x-range index-range";
+
+bool has_option_word(const char* options, string const& opt)
 {
-    if (fi->valid_options == NULL)
+    if (options == NULL)
         return false;
-    const char* p = strstr(fi->valid_options, opt.c_str());
+    const char* p = strstr(options, opt.c_str());
     if (p == NULL)
         return false;
     // no option is a substring of another option
-    return (p == fi->valid_options || p[-1] == ' ') &&
+    return (p == options || p[-1] == ' ') &&
            (p[opt.size()] == '\0' || p[opt.size()] == ' ');
 }
 
+// replace evenly spaced columns with StepColumns (option "compact")
+void compact_columns(DataSet* ds)
+{
+    // columns shared between blocks are replaced with one StepColumn
+    map<Column const*, shared_ptr<const Column> > done;
+    for (int i = 0; i < ds->get_block_count(); ++i) {
+        // blocks are owned by the dataset, we can modify them here
+        Block *blk = const_cast<Block*>(ds->get_block(i));
+        int n = blk->get_column_count();
+        for (int j = 0; j < n; ++j) {
+            shared_ptr<const Column> col = blk->del_column(0);
+            shared_ptr<const Column>& replacement = done[col.get()];
+            if (!replacement) {
+                StepColumn *sc = compact_column(*col);
+                replacement = sc ? shared_ptr<const Column>(sc) : col;
+            }
+            blk->add_column(replacement);
+        }
+    }
+}
+
+} // anonymous namespace
+
+bool DataSet::is_valid_option(std::string const& opt) const
+{
+    return has_option_word(fi->valid_options, opt) ||
+           has_option_word(generic_options, opt.substr(0, opt.find('=')));
+}
+
+void DataSet::apply_generic_options()
+{
+    if (imp_->has_range && !imp_->range_handled)
+        cut_blocks(this, imp_->range);
+    if (has_word(imp_->options, "compact"))
+        compact_columns(this);
+}
+
+// Expected errors (such as format errors) are reported by setting status
+// and message, other exceptions (e.g. bad_alloc) are propagated.
 DataSet* load_stream_of_format(istream &is, FormatInfo const* fi,
-                               string const& options, const char* path=NULL)
+                               string const& options, const char* path,
+                               LoadStatus* status, string* message)
 {
     assert(fi != NULL);
     // check if the file is not empty
     is.peek();
-    if (is.eof())
-        throw FormatError("The file is empty.");
+    if (is.eof()) {
+        *status = LOAD_FORMAT_ERROR;
+        *message = "The file is empty.";
+        return NULL;
+    }
 
     DataSet *ds = (*fi->ctor)();
-    ds->set_options(options);
     try {
+        ds->set_options(options);
         ds->load_data(is, path);
+        ds->apply_generic_options();
     }
     catch (FormatError &e) {
-        throw FormatError(string(e.what()) + " [filetype: " + fi->name + "]");
+        delete ds;
+        *status = LOAD_FORMAT_ERROR;
+        *message = string(e.what()) + " [filetype: " + fi->name + "]";
+        return NULL;
     }
+    catch (...) {
+        delete ds;
+        throw;
+    }
+    *status = LOAD_OK;
     return ds;
 }
 
+void throw_load_error(LoadStatus status, string const& message)
+{
+    if (status == LOAD_FORMAT_ERROR)
+        throw FormatError(message);
+    throw RunTimeError(message);
+}
+
 
 // One pass input streambuf. It reads and decompress whole file in ctor.
 struct decompressing_istreambuf : public std::streambuf
@@ -515,24 +1153,31 @@ struct bzip2_istreambuf : public decompressing_istreambuf
 DataSet* guess_and_load_stream(istream &is,
                                string const& path, // only used for guessing
                                string const& format_name,
-                               string const& options)
+                               string const& options,
+                               LoadStatus* status, string* message)
 {
     FormatInfo const* fi = NULL;
     if (format_name.empty()) {
         fi = guess_filetype(path, is, NULL);
-        if (!fi)
-            throw RunTimeError ("Format of the file can not be guessed");
+        if (!fi) {
+            *status = LOAD_UNKNOWN_FORMAT;
+            *message = "Format of the file can not be guessed";
+            return NULL;
+        }
         is.seekg(0);
         is.clear();
     }
     else {
         fi = (FormatInfo const*) xylib_get_format_by_name(format_name.c_str());
-        if (!fi)
-            throw RunTimeError("Unsupported (misspelled?) data format: "
-                                + format_name);
+        if (!fi) {
+            *status = LOAD_UNKNOWN_FORMAT;
+            *message = "Unsupported (misspelled?) data format: " + format_name;
+            return NULL;
+        }
     }
 
-    return load_stream_of_format(is, fi, options, path.c_str());
+    return load_stream_of_format(is, fi, options, path.c_str(),
+                                 status, message);
 }
 
 // MSVC has no S_ISDIR
@@ -549,8 +1194,28 @@ bool is_directory(string const& path)
     // could use PathIsDirectory() on Windows
 }
 
-DataSet* load_file(string const& path, string const& format_name,
-                   string const& options)
+vector<FormatInfo const*> get_possible_filetypes(string const& filename);
+
+// Only binary formats keep large files memory-mapped (see read_file()).
+// If the format is to be guessed, the extension must match a binary format.
+bool may_be_binary(string const& path, string const& format_name)
+{
+    if (!format_name.empty()) {
+        xylibFormat const* xf = xylib_get_format_by_name(format_name.c_str());
+        return xf != NULL && xf->binary;
+    }
+    vector<FormatInfo const*> possible = get_possible_filetypes(path);
+    for (size_t i = 0; i != possible.size(); ++i)
+        if (possible[i]->binary)
+            return true;
+    return false;
+}
+
+// Errors that are expected (can't open file, unknown format, format error)
+// are reported by setting status and message, not by exceptions.
+DataSet* load_file_with_status(string const& path, string const& format_name,
+                               string const& options,
+                               LoadStatus* status, string* message)
 {
     int len = (int)path.size();
 #if defined(_WIN32)
@@ -564,10 +1229,12 @@ DataSet* load_file(string const& path, string const& format_name,
     bool gzipped = (len > 3 && path.substr(len-3) == ".gz");
     bool bz2ed = (len > 4 && path.substr(len-4) == ".bz2");
     if ((gzipped && len > 7 && path.substr(len-7) == ".tar.gz") ||
-            (bz2ed && len > 8 && path.substr(len-8) == ".tar.bz2"))
-        throw RunTimeError("Refusing to read a tarball: " + path);
-    if (is_directory(path)) {
-        throw RunTimeError("It is a directory, not a file: " + path);
+            (bz2ed && len > 8 && path.substr(len-8) == ".tar.bz2")) {
+        *status = LOAD_UNKNOWN_FORMAT;
+        *message = "Refusing to read a tarball: " + path;
+    } else if ((gzipped || bz2ed) && is_directory(path)) {
+        *status = LOAD_CANT_OPEN;
+        *message = "It is a directory, not a file: " + path;
     } else if (gzipped) {
 #ifdef HAVE_LIBZ
 #if defined(_WIN32)
@@ -576,65 +1243,279 @@ DataSet* load_file(string const& path, string const& format_name,
         gzFile gz_stream = gzopen(path.c_str(), "rb");
 #endif
         if (!gz_stream) {
-            throw RunTimeError("can't open .gz input file: " + path);
+            *status = LOAD_CANT_OPEN;
+            *message = "can't open .gz input file: " + path;
+            return NULL;
         }
         gzip_istreambuf istrbuf(gz_stream);
         istream is(&istrbuf);
         ret = guess_and_load_stream(is, path.substr(0, len-3),
-                                    format_name, options);
+                                    format_name, options, status, message);
 #else
-        throw RunTimeError("Program is compiled with disabled zlib support.");
+        *status = LOAD_OTHER_ERROR;
+        *message = "Program is compiled with disabled zlib support.";
 #endif //HAVE_LIBZ
     } else if (bz2ed) {
 #ifdef HAVE_LIBBZ2
         // not used much on Windows I suppose
         BZFILE* bz_stream = BZ2_bzopen(path.c_str(), "rb");
         if (!bz_stream) {
-            throw RunTimeError("can't open .bz2 input file: " + path);
+            *status = LOAD_CANT_OPEN;
+            *message = "can't open .bz2 input file: " + path;
+            return NULL;
         }
         bzip2_istreambuf istrbuf(bz_stream);
         istream is(&istrbuf);
         ret = guess_and_load_stream(is, path.substr(0, len-3),
-                                    format_name, options);
+                                    format_name, options, status, message);
 #else
-        throw RunTimeError("Program is compiled with disabled bzlib support.");
+        *status = LOAD_OTHER_ERROR;
+        *message = "Program is compiled with disabled bzlib support.";
 #endif //HAVE_LIBBZ2
     } else {
+#if !defined(_WIN32)
+        // read the whole file at once, it has fewer syscalls than ifstream
+        file_buffer_ptr buf = read_file(path, message,
+                                        may_be_binary(path, format_name));
+        if (!buf) {
+            *status = LOAD_CANT_OPEN;
+            return NULL;
+        }
+        buffer_istreambuf sb(buf);
+        istream is(&sb);
+        ret = guess_and_load_stream(is, path, format_name, options,
+                                    status, message);
+#else
+        if (is_directory(path)) {
+            *status = LOAD_CANT_OPEN;
+            *message = "It is a directory, not a file: " + path;
+            return NULL;
+        }
 #if defined(_MSC_VER)
         ifstream is(&wpath[0], ios::in | ios::binary);
 #elif defined(_WIN32) && defined(__GLIBCXX__)
         // based on http://stackoverflow.com/a/19271763/104453
         // and https://sf.net/p/mingw-w64/mailman/message/29714455/
         FILE* c_file = _wfopen(&wpath[0], L"rb");
-        if (c_file == NULL)
-            throw RunTimeError("can't open input file: " + path);
+        if (c_file == NULL) {
+            *status = LOAD_CANT_OPEN;
+            *message = "can't open input file: " + path;
+            return NULL;
+        }
         try {
          __gnu_cxx::stdio_filebuf<char> fbuf(c_file, ios::in | ios::binary, 1);
          iostream is(&fbuf);
 #else
         ifstream is(path.c_str(), ios::in | ios::binary);
 #endif
-        if (!is)
-            throw RunTimeError("can't open input file: " + path);
-        ret = guess_and_load_stream(is, path, format_name, options);
-#if defined(_WIN32) && defined(__GLIBCXX__)
+        if (!is) {
+            *status = LOAD_CANT_OPEN;
+            *message = "can't open input file: " + path;
+        } else {
+            ret = guess_and_load_stream(is, path, format_name, options,
+                                        status, message);
+        }
+#if !defined(_MSC_VER) && defined(__GLIBCXX__)
         } catch (...) {
             fclose(c_file);
             throw;
         }
         fclose(c_file);
 #endif
+#endif // _WIN32
     }
     return ret;
 }
 
+DataSet* load_file(string const& path, string const& format_name,
+                   string const& options)
+{
+    LoadStatus status = LOAD_OK;
+    string message;
+    DataSet *ds = load_file_with_status(path, format_name, options,
+                                        &status, &message);
+    if (!ds)
+        throw_load_error(status, message);
+    return ds;
+}
+
+LoadResult try_load_file(string const& path, string const& format_name,
+                         string const& options)
+{
+    LoadResult r;
+    r.status = LOAD_OK;
+    r.dataset = NULL;
+    try {
+        r.dataset = load_file_with_status(path, format_name, options,
+                                          &r.status, &r.message);
+    }
+    // loaders report most errors by status, but other exceptions are
+    // still possible
+    catch (FormatError &e) {
+        r.status = LOAD_FORMAT_ERROR;
+        r.message = e.what();
+    }
+    catch (std::bad_alloc&) {
+        r.status = LOAD_OTHER_ERROR;
+        r.message = "Not enough memory to load file: " + path;
+    }
+    catch (std::exception &e) {
+        r.status = LOAD_OTHER_ERROR;
+        r.message = e.what();
+    }
+    return r;
+}
+
+namespace {
+
+// Files read by read_files() and waiting for parsing.
+// The queue is bounded, so that not too many files are kept in memory.
+class ReadFileQueue
+{
+public:
+    struct Item
+    {
+        size_t idx;
+        file_buffer_ptr buf;
+        string error;
+    };
+
+    explicit ReadFileQueue(size_t capacity)
+        : capacity_(capacity), closed_(false) {}
+
+    void push(Item const& item)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [this] { return items_.size() < capacity_; });
+        items_.push_back(item);
+        not_empty_.notify_one();
+    }
+
+    // returns false if the queue is closed and empty
+    bool pop(Item* item)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [this] { return !items_.empty() || closed_; });
+        if (items_.empty())
+            return false;
+        *item = items_.front();
+        items_.pop_front();
+        not_full_.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        not_empty_.notify_all();
+    }
+
+private:
+    size_t capacity_;
+    bool closed_;
+    std::deque<Item> items_;
+    std::mutex mutex_;
+    std::condition_variable not_empty_, not_full_;
+};
+
+bool is_compressed(string const& path)
+{
+    size_t len = path.size();
+    return (len > 3 && path.compare(len-3, 3, ".gz") == 0) ||
+           (len > 4 && path.compare(len-4, 4, ".bz2") == 0);
+}
+
+} // anonymous namespace
+
+vector<DataSet*> load_files(vector<string> const& paths,
+                            string const& format_name, string const& options,
+                            vector<string>* errors)
+{
+    // max. number of files being read or waiting for parsing
+    const size_t window = 64;
+    vector<DataSet*> result(paths.size(), (DataSet*) NULL);
+    vector<string> messages(paths.size());
+    // compressed files are read by load_file() in parser threads
+    vector<size_t> plain_idx;
+    vector<string> plain_paths;
+    for (size_t i = 0; i != paths.size(); ++i)
+        if (!is_compressed(paths[i])) {
+            plain_idx.push_back(i);
+            plain_paths.push_back(paths[i]);
+        }
+
+    ReadFileQueue queue(window);
+    size_t n_threads = std::thread::hardware_concurrency();
+    if (n_threads == 0)
+        n_threads = 1;
+    if (n_threads > paths.size())
+        n_threads = paths.size();
+    vector<std::thread> threads;
+    for (size_t t = 0; t < n_threads; ++t)
+        threads.push_back(std::thread([&] {
+            // loaders run their parallel loops in this thread
+            ParallelWorker worker;
+            ReadFileQueue::Item item;
+            while (queue.pop(&item)) {
+                string const& path = paths[item.idx];
+                LoadStatus status = LOAD_OK;
+                try {
+                    if (!item.error.empty()) {
+                        messages[item.idx] = item.error;
+                    } else if (!item.buf) {
+                        result[item.idx] = load_file_with_status(path,
+                                         format_name, options,
+                                         &status, &messages[item.idx]);
+                    } else {
+                        buffer_istreambuf sb(item.buf);
+                        istream is(&sb);
+                        result[item.idx] = guess_and_load_stream(is, path,
+                                         format_name, options,
+                                         &status, &messages[item.idx]);
+                    }
+                } catch (std::exception& e) {
+                    messages[item.idx] = e.what();
+                }
+            }
+        }));
+
+    for (size_t i = 0; i != paths.size(); ++i)
+        if (is_compressed(paths[i])) {
+            ReadFileQueue::Item item;
+            item.idx = i;
+            queue.push(item);
+        }
+    read_files(plain_paths, window,
+               [&](size_t idx, file_buffer_ptr const& buf, string const& err) {
+        ReadFileQueue::Item item;
+        item.idx = plain_idx[idx];
+        item.buf = buf;
+        item.error = err;
+        queue.push(item);
+    });
+    queue.close();
+    for (size_t t = 0; t < threads.size(); ++t)
+        threads[t].join();
+
+    if (errors)
+        errors->swap(messages);
+    return result;
+}
+
 
 DataSet* load_stream(istream &is, string const& format_name,
                      string const& options)
 {
     xylibFormat const* xf = xylib_get_format_by_name(format_name.c_str());
     FormatInfo const* fi = static_cast<FormatInfo const*>(xf);
-    return load_stream_of_format(is, fi, options);
+    LoadStatus status = LOAD_OK;
+    string message;
+    DataSet *ds = load_stream_of_format(is, fi, options, NULL,
+                                        &status, &message);
+    if (!ds)
+        throw_load_error(status, message);
+    return ds;
 }
 
 DataSet* load_string(string const& buffer, string const& format_name,
@@ -25,8 +25,9 @@
  **    double y = get_block(0)->get_column(2)->get_value(14);
  ** Note that blocks and points are numbered from 0, but columns are numbered
  ** from 1, because the column 0 returns index of point.
- ** All values are stored as floating-point numbers, even if they are integers
- ** in the file.
+ ** Values from binary files are stored in their native type (for example
+ ** as 16-bit integers or floats, see Column::get_dtype()), other values are
+ ** stored as doubles. get_value() always returns double.
  ** DataSet and Block contain also MetaData, which is a string to string map.
  **
  ** Note that C++ API uses std::string and exceptions, so it is recommended
@@ -54,13 +55,19 @@
  *  XYLIB_VERSION / 100 % 100 is the minor version
  *  XYLIB_VERSION / 10000 is the major version
  */
-#define XYLIB_VERSION 10600 /* 1.6.0 */
+#define XYLIB_VERSION 10700 /* 1.7.0 */
 
 #ifdef __cplusplus
 
 #include <string>
+#include <utility>
 #include <stdexcept>
 #include <fstream>
+#include <memory>
+#include <vector>
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#include <string_view>
+#endif
 
 extern "C" {
 #endif /* __cplusplus */
@@ -160,6 +167,32 @@ public:
 };
 
 
+/// type in which values of a column are stored in memory
+enum DataType
+{
+    DT_FLOAT64, /// double (also used for values computed on the fly)
+    DT_FLOAT32, /// float
+    DT_INT32,
+    DT_UINT32,
+    DT_INT16,
+    DT_UINT16
+};
+
+/// size in bytes of one value of type dt
+XYLIB_API int get_dtype_size(DataType dt);
+
+
+/// statistics of values in a column, see Column::get_stats()
+struct XYLIB_API ColumnStats
+{
+    int count; /// number of values, including NaNs
+    int nan_count; /// number of NaNs; NaNs are ignored in other statistics
+    double min, max;
+    double sum, mean;
+    double variance; /// population variance (divided by count-nan_count)
+    int order; /// 1 - non-decreasing, -1 - non-increasing, 0 - other
+};
+
 /// abstract base class for a column
 class XYLIB_API Column
 {
@@ -185,6 +218,34 @@ public:
 
     /// returns step in the case of fixed step, 0. otherwise
     virtual double get_step() const = 0;
+
+    /// type in which values are stored; get_value() converts them to double
+    virtual DataType get_dtype() const { return DT_FLOAT64; }
+
+    /// pointer to all values stored contiguously as get_dtype() type,
+    /// or NULL if values are not stored this way (e.g. they are computed)
+    virtual const void* get_raw_data() const { return NULL; }
+
+    /// copy count values, starting from first, to out
+    virtual void get_values(int first, int count, double* out) const;
+
+    /// 1 if values are non-decreasing, -1 if non-increasing, 0 otherwise;
+    /// columns that store data check it once and remember the result
+    virtual int get_sort_order() const;
+
+    /// Statistics of all values. Columns that store data calculate it once
+    /// (in one pass, together with min, max and sort order) and remember it.
+    /// point_count must be specified if column has "unlimited" length.
+    virtual ColumnStats get_stats(int point_count=0) const;
+
+    /// index of the first point with value >= x, or get_point_count()
+    /// if there is no such point; uses binary search if values are sorted
+    virtual int lower_bound(double x) const;
+
+    /// Returns the smallest range of indices [first, second) that contains
+    /// all points with values in [lo, hi] (empty range if there are none).
+    /// If values are sorted, all points in the range have values in [lo, hi].
+    virtual std::pair<int, int> find_range(double lo, double hi) const;
 };
 
 
@@ -195,15 +256,59 @@ struct DataSetImp;
 
 /// Map that stores meta-data (additional data, that usually describe x-y data)
 /// for block or dataset. For example: date of the experiment, wavelength, ...
-/// The only way to get all elements is using size(), get_key() and get().
+/// Values are strings, but numbers from binary files are stored as numbers
+/// (see get_double() and get_int()). Elements are sorted by key. They can
+/// be accessed by index (size(), get_key(), get_value()) or by iterating:
+/// for (auto const& e : meta) ..., where e.key() and e.value() are strings.
 class XYLIB_API MetaData
 {
 public:
+    class const_iterator
+    {
+    public:
+        const_iterator(MetaData const* md, size_t i) : md_(md), i_(i) {}
+        std::string const& key() const { return md_->get_key(i_); }
+        std::string const& value() const { return md_->get_value(i_); }
+        // dereferencing returns the iterator itself, with key() and value()
+        const_iterator const& operator*() const { return *this; }
+        const_iterator const* operator->() const { return this; }
+        const_iterator& operator++() { ++i_; return *this; }
+        bool operator==(const_iterator const& o) const { return i_ == o.i_; }
+        bool operator!=(const_iterator const& o) const { return i_ != o.i_; }
+    private:
+        MetaData const* md_;
+        size_t i_;
+    };
+
     // use these functions to query meta data
     bool has_key(std::string const& key) const;
     std::string const& get(std::string const& key) const;
     size_t size() const;
     std::string const& get_key(size_t index) const;
+    std::string const& get_value(size_t index) const;
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, size()); }
+
+    /// returns pointer to the value or NULL if key is not found;
+    /// doesn't require the key to be std::string
+    std::string const* find(const char* key, size_t len) const;
+    std::string const* find(std::string const& key) const
+        { return find(key.data(), key.size()); }
+    std::string const* find(const char* key) const
+        { return find(key, std::char_traits<char>::length(key)); }
+    bool has_key(const char* key) const { return find(key) != NULL; }
+
+    /// returns value converted to number; throws RunTimeError if the key
+    /// is not found or the value is not a number
+    double get_double(std::string const& key) const;
+    /// returns value converted to integer (dates as seconds since the Epoch);
+    /// throws RunTimeError if the key is not found or value is not integer
+    long long get_int(std::string const& key) const;
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+    std::string const* find(std::string_view key) const
+        { return find(key.data(), key.size()); }
+    bool has_key(std::string_view key) const { return find(key) != NULL; }
+#endif
 
     // functions for use only in xylib
     MetaData();
@@ -211,7 +316,17 @@ public:
     void operator=(const MetaData& other);
     void clear();
     bool set(std::string const& key, std::string const& val);
+    // the reference remains valid when other keys are added
     std::string& operator[] (const std::string& x);
+    // numbers are converted to strings only when get() is called;
+    // these functions overwrite existing values
+    void set_double(std::string const& key, double val);
+    void set_float(std::string const& key, float val);
+    void set_int(std::string const& key, long long val);
+    void set_time(std::string const& key, long long unix_time); // UTC
+    // keys are stored in the key table of other; DataSet::add_block() uses
+    // it, so that blocks of one dataset share their keys
+    void share_keys(MetaData& other);
 
 private:
     MetaData(const MetaData&); // disallow
@@ -239,6 +354,9 @@ public:
     int get_column_count() const;
     /// get column, 0-th column is index of point
     const Column& get_column(int n) const;
+    /// the same as get_column(), but the returned pointer keeps the column
+    /// alive, also after this block is deleted
+    std::shared_ptr<const Column> get_column_ptr(int n) const;
 
     /// return number of points or -1 for "unlimited" number of points
     /// each column should have the same number of points (or "unlimited"
@@ -247,7 +365,10 @@ public:
 
     // functions for use in filetype implementations
     void add_column(Column* c, bool append=true);
-    Column* del_column(int n); // removes and returns column
+    /// the same column can be added to more than one block
+    void add_column(std::shared_ptr<const Column> const& c, bool append=true);
+    /// removes and returns column
+    std::shared_ptr<const Column> del_column(int n);
     void set_name(std::string const& name);
 
 private:
@@ -258,8 +379,33 @@ private:
 };
 
 
+/// Views share values with the columns they are made from (no copying),
+/// and keep these columns alive.
+
+/// view of count values of col, starting from first;
+/// count -1 means all values to the end of col;
+/// if the view would cover the whole col, col itself is returned
+XYLIB_API std::shared_ptr<const Column> slice_column(
+                std::shared_ptr<const Column> const& col, int first,
+                int count=-1);
+
+/// view of values of cols, one column after another
+XYLIB_API std::shared_ptr<const Column> concat_columns(
+                std::vector<std::shared_ptr<const Column> > const& cols);
+
+/// Returns new block (that should be deleted by the caller) with selected
+/// columns of block (column numbers as in get_column(), 0 is index),
+/// and with row_count rows starting from first_row (-1 means all rows).
+/// Meta-data and name are copied from block.
+XYLIB_API Block* block_view(Block const& block, std::vector<int> const& columns,
+                            int first_row=0, int row_count=-1);
+
+
 /// DataSet represents data stored typically in one file.
 /// It may consist of one or more block(s) of X-Y data and of meta-data
+/// Loaded DataSet is not modified by const functions (values cached on first
+/// use, like column statistics, are published without locks), so it can be
+/// shared and read from many threads at the same time.
 class XYLIB_API DataSet
 {
 public:
@@ -286,12 +432,26 @@ public:
 
     /// check if options string has this word; t must be valid option
     bool has_option(std::string const& t);
+    /// if option name=VALUE is given, sets value and returns true;
+    /// name must be valid option
+    bool get_option_value(std::string const& name, std::string* value);
 
     // functions for use in filetype implementations
     void add_block(Block* block);
 
+    /// Returns range [first, second) of points that should be read, as
+    /// requested by option x-range or index-range, for a block with n points
+    /// and x column x; [0, n) if these options are not given.
+    /// Loaders that call it must read only this range. Blocks of other
+    /// formats are cut after loading.
+    std::pair<int, int> get_point_range(Column const& x, int n);
+    /// if option x-range is given, sets lo and hi and returns true
+    bool get_x_range(double* lo, double* hi) const;
+
     // if load_data() supports options, set it before it's called
     void set_options(std::string const& options);
+    // called after load_data(), handles options supported by all formats
+    void apply_generic_options();
 
     /// true if this option is handled for this format
     bool is_valid_option(std::string const& opt) const;
@@ -309,11 +469,57 @@ private:
 /// Read file from disk. Optionally supports compressed files (.gz and .bz2).
 /// Parameter path should be in utf8 (ascii also works).
 /// If format_name is not given, it is guessed.
+/// options is a space-separated list of format-specific options.
+/// Options supported by all formats:
+///  - compact -- evenly spaced columns (e.g. 2theta read from text file)
+///    are stored as start and step,
+///  - x-range=LO:HI -- only points with x (the first column) in [LO, HI]
+///    are loaded; x should be sorted; LO or HI can be omitted,
+///  - index-range=FIRST:END -- only points FIRST, ..., END-1 are loaded;
+///    END can be omitted.
+/// Binary formats with fixed layout (e.g. SPE, CNF, RAW) read only
+/// the requested points. The x column keeps the original values.
 /// Return value: pointer to Dataset that contains all data read from file.
 XYLIB_API DataSet* load_file(std::string const& path,
                              std::string const& format_name="",
                              std::string const& options="");
 
+/// status of loading a file, see try_load_file()
+enum LoadStatus
+{
+    LOAD_OK = 0,
+    LOAD_CANT_OPEN, /// file not found, no permission, it's a directory, ...
+    LOAD_UNKNOWN_FORMAT, /// format can't be guessed or is not supported
+    LOAD_FORMAT_ERROR, /// file content is not as expected (FormatError)
+    LOAD_OTHER_ERROR /// other errors, e.g. out of memory
+};
+
+/// result of try_load_file()
+struct XYLIB_API LoadResult
+{
+    LoadStatus status;
+    DataSet* dataset; /// NULL if status != LOAD_OK
+    std::string message; /// error message
+};
+
+/// The same as load_file(), but instead of throwing exceptions it returns
+/// status and error message. Returned DataSet should be deleted by caller.
+XYLIB_API LoadResult try_load_file(std::string const& path,
+                                   std::string const& format_name="",
+                                   std::string const& options="");
+
+/// Read many files, e.g. all files from a directory. Files are read
+/// in batches (on Linux using io_uring, if available) and parsed in parallel.
+/// Arguments format_name and options are the same as in load_file().
+/// Returns vector of the same length as paths, with NULL for files that
+/// could not be read; in such case the error message is stored in errors
+/// (if it's not NULL). Returned DataSets should be deleted by the caller.
+XYLIB_API std::vector<DataSet*> load_files(
+                                  std::vector<std::string> const& paths,
+                                  std::string const& format_name="",
+                                  std::string const& options="",
+                                  std::vector<std::string>* errors=NULL);
+
 /// Read content of a file from stream.
 /// Returns Dataset that stores all the data.
 XYLIB_API DataSet* load_stream(std::istream &is,